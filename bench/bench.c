@@ -0,0 +1,441 @@
+#include "blur.h"
+#include "conv.h"
+#include "integral.h"
+#include "pyramid.h"
+#include "resize.h"
+#include "rotate.h"
+#include "sobel.h"
+#include "thread_pool.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_LIST 16
+
+/**
+ * One benchmarked operator: runs src -> dst once
+ */
+typedef struct {
+  const char *name;
+  int (*run)(const Image *src, Image *dst, int k, int num_threads);
+  int k; // kernel size for the convolutions, radius for the box filters,
+         // 1 to resize through a pyramid
+} BenchOp;
+
+/**
+ * Benchmark settings parsed from the command line
+ */
+typedef struct {
+  int sizes[BENCH_MAX_LIST][2];
+  int nsizes;
+  int channels[BENCH_MAX_LIST];
+  int nchannels;
+  int threads[BENCH_MAX_LIST];
+  int nthreads;
+  const char *ops; // comma-separated operator names, NULL for all
+  double min_time; // seconds of repeated runs per measurement
+  int min_reps;
+} BenchConfig;
+
+/**
+ * Fills a k x k kernel with a normalized disk (non-separable, so
+ * conv_concurrent takes its general 2D path)
+ */
+static void disk_kernel(float *kernel, int k) {
+  int r = k / 2;
+  float sum = 0.0f;
+  for (int y = 0; y < k; y++)
+    for (int x = 0; x < k; x++) {
+      int dx = x - r, dy = y - r;
+      kernel[y * k + x] = dx * dx + dy * dy <= r * r ? 1.0f : 0.0f;
+      sum += kernel[y * k + x];
+    }
+  for (int i = 0; i < k * k; i++)
+    kernel[i] /= sum;
+}
+
+/**
+ * Fills a k x k kernel with normalized binomial weights (rank 1, so
+ * conv_concurrent takes its separable path)
+ */
+static void binomial_kernel(float *kernel, int k) {
+  float row[16] = {1.0f};
+  for (int n = 1; n < k; n++)
+    for (int i = n; i > 0; i--)
+      row[i] += row[i - 1];
+  float sum = 0.0f;
+  for (int i = 0; i < k; i++)
+    sum += row[i];
+  for (int y = 0; y < k; y++)
+    for (int x = 0; x < k; x++)
+      kernel[y * k + x] = row[y] * row[x] / (sum * sum);
+}
+
+static int run_conv_disk(const Image *src, Image *dst, int k, int nt) {
+  float kernel[16 * 16];
+  disk_kernel(kernel, k);
+  return conv_concurrent(src, dst, kernel, k, 1.0f, 0.0f, nt);
+}
+
+static int run_conv_binomial(const Image *src, Image *dst, int k, int nt) {
+  float kernel[16 * 16];
+  binomial_kernel(kernel, k);
+  return conv_concurrent(src, dst, kernel, k, 1.0f, 0.0f, nt);
+}
+
+static int run_sobel(const Image *src, Image *dst, int k, int nt) {
+  (void)k;
+  return sobel_concurrent(src, dst, nt);
+}
+
+static int run_rotate(const Image *src, Image *dst, int k, int nt) {
+  (void)k;
+  return rotate_concurrent(src, dst, 30.0f, nt);
+}
+
+static int run_rotate90(const Image *src, Image *dst, int k, int nt) {
+  (void)k;
+  return rotate90_concurrent(src, dst, 1, nt);
+}
+
+static int run_resize(const Image *src, Image *dst, int k, int nt) {
+  (void)k;
+  return resize_concurrent(src, dst, nt);
+}
+
+static int run_box(const Image *src, Image *dst, int k, int nt) {
+  return box_blur_concurrent(src, dst, k, nt);
+}
+
+static int run_box_sat(const Image *src, Image *dst, int k, int nt) {
+  return integral_box_concurrent(src, dst, k, nt);
+}
+
+static int run_resize_area(const Image *src, Image *dst, int k, int nt) {
+  (void)k;
+  return integral_area_resize_concurrent(src, dst, nt);
+}
+
+/**
+ * Five Lanczos-3 thumbnails: dst (a third of the source) and four successive
+ * halvings of it, through one pyramid (k = 1) or one resize each (k = 0)
+ */
+static int run_thumbs(const Image *src, Image *dst, int k, int nt) {
+  Image outs[5];
+  ResizeFilter filters[5];
+  outs[0] = *dst;
+  for (int i = 1; i < 5; i++) {
+    int w = dst->width >> i, h = dst->height >> i;
+    if (image_alloc_uninit(&outs[i], w > 0 ? w : 1, h > 0 ? h : 1,
+                           dst->channels) != 0) {
+      while (--i > 0)
+        image_free(&outs[i]);
+      return -1;
+    }
+  }
+  for (int i = 0; i < 5; i++)
+    filters[i] = RESIZE_LANCZOS3;
+  int rc = 0;
+  if (k)
+    rc = pyramid_resize_concurrent(src, outs, filters, 5, nt);
+  for (int i = 0; !k && rc == 0 && i < 5; i++)
+    rc = resize_filter_concurrent(src, &outs[i], filters[i], nt);
+  for (int i = 1; i < 5; i++)
+    image_free(&outs[i]);
+  return rc;
+}
+
+static const BenchOp bench_ops[] = {
+    {"conv3", run_conv_disk, 3},       {"conv5", run_conv_disk, 5},
+    {"conv7", run_conv_disk, 7},       {"conv3_sep", run_conv_binomial, 3},
+    {"conv5_sep", run_conv_binomial, 5}, {"conv7_sep", run_conv_binomial, 7},
+    {"sobel", run_sobel, 0},           {"rotate30", run_rotate, 0},
+    {"rotate90", run_rotate90, 0},     {"resize_half", run_resize, 0},
+    {"box16", run_box, 16},            {"box16_sat", run_box_sat, 16},
+    {"resize_half_area", run_resize_area, 0},
+    {"thumbs5", run_thumbs, 1},        {"thumbs5_direct", run_thumbs, 0},
+};
+
+/**
+ * Returns the monotonic clock in seconds
+ */
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Checks whether an operator was selected with --ops
+ *
+ * @param list Comma-separated names, or NULL for all operators
+ * @param name Operator name
+ * @return Nonzero when the operator should run
+ */
+static int op_selected(const char *list, const char *name) {
+  if (!list)
+    return 1;
+  size_t n = strlen(name);
+  for (const char *p = list; (p = strstr(p, name)) != NULL; p += n)
+    if ((p == list || p[-1] == ',') && (p[n] == ',' || p[n] == '\0'))
+      return 1;
+  return 0;
+}
+
+/**
+ * Fills an image with a deterministic pseudo-random pattern
+ */
+static void fill_pattern(Image *img) {
+  unsigned state = 12345u;
+  for (int y = 0; y < img->height; y++) {
+    unsigned char *row = image_row(img, y);
+    for (size_t i = 0; i < (size_t)img->width * img->channels; i++) {
+      state = state * 1664525u + 1013904223u;
+      row[i] = (unsigned char)(state >> 24);
+    }
+  }
+}
+
+/**
+ * Times one operator on one image at one thread count
+ *
+ * Runs once to warm up, then repeats until both min_reps runs and min_time
+ * seconds have elapsed.
+ *
+ * @param op Operator to run
+ * @param src Input image
+ * @param dst Output image of the geometry the operator expects
+ * @param nt Number of row blocks
+ * @param cfg Repetition settings
+ * @param best Fastest run in seconds
+ * @param mean Mean run time in seconds
+ * @param reps Number of timed runs
+ *
+ * @return 0 on success, -1 if the operator failed
+ */
+static int time_op(const BenchOp *op, const Image *src, Image *dst, int nt,
+                   const BenchConfig *cfg, double *best, double *mean,
+                   int *reps) {
+  if (op->run(src, dst, op->k, nt) != 0)
+    return -1;
+  double total = 0.0, fastest = 1e30;
+  int n = 0;
+  while (n < cfg->min_reps || total < cfg->min_time) {
+    double t0 = now_sec();
+    if (op->run(src, dst, op->k, nt) != 0)
+      return -1;
+    double t = now_sec() - t0;
+    total += t;
+    fastest = t < fastest ? t : fastest;
+    n++;
+  }
+  *best = fastest;
+  *mean = total / n;
+  *reps = n;
+  return 0;
+}
+
+/**
+ * Parses a comma-separated list of positive integers
+ *
+ * @return Number of values stored, or -1 on a malformed list
+ */
+static int parse_list(const char *s, int *out) {
+  int n = 0;
+  while (*s && n < BENCH_MAX_LIST) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || v < 1 || (*end && *end != ','))
+      return -1;
+    out[n++] = (int)v;
+    s = *end ? end + 1 : end;
+  }
+  return *s ? -1 : n;
+}
+
+/**
+ * Parses a comma-separated list of WxH sizes (a single number means square)
+ *
+ * @return Number of sizes stored, or -1 on a malformed list
+ */
+static int parse_sizes(const char *s, int out[][2]) {
+  int n = 0;
+  while (*s && n < BENCH_MAX_LIST) {
+    char *end;
+    long w = strtol(s, &end, 10), h = w;
+    if (*end == 'x')
+      h = strtol(end + 1, &end, 10);
+    if (w < 1 || h < 1 || (*end && *end != ','))
+      return -1;
+    out[n][0] = (int)w;
+    out[n][1] = (int)h;
+    n++;
+    s = *end ? end + 1 : end;
+  }
+  return *s ? -1 : n;
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] > results.csv\n"
+          "  --sizes LIST     WxH or N (square), default "
+          "256,1024,2048,4096,7680x4320\n"
+          "  --channels LIST  default 1,3,4\n"
+          "  --threads LIST   default 1,2,4,... up to the CPU count\n"
+          "  --ops LIST       subset of:",
+          prog);
+  for (size_t i = 0; i < sizeof(bench_ops) / sizeof(bench_ops[0]); i++)
+    fprintf(stderr, " %s", bench_ops[i].name);
+  fprintf(stderr, "\n"
+                  "  --min-time SEC   timed seconds per measurement "
+                  "(default 0.3)\n"
+                  "  --quick          256 and 1024 only, 0.05 s per point\n");
+}
+
+/**
+ * Benchmark driver for the concurrent operators
+ *
+ * Generates synthetic images of several sizes and channel counts, times each
+ * operator at each thread count and prints one CSV row per measurement to
+ * stdout: throughput in megapixels per second, memory traffic in GB/s
+ * (bytes read from the source plus bytes written to the destination, once
+ * each) and the speedup over the first thread count of the list. Progress
+ * goes to stderr.
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments (see print_usage)
+ *
+ * @return 0 on success, 1 on invalid arguments or a failed operator
+ */
+int main(int argc, char **argv) {
+  BenchConfig cfg = {.sizes = {{256, 256},
+                               {1024, 1024},
+                               {2048, 2048},
+                               {4096, 4096},
+                               {7680, 4320}},
+                     .nsizes = 5,
+                     .channels = {1, 3, 4},
+                     .nchannels = 3,
+                     .min_time = 0.3,
+                     .min_reps = 3};
+  int cpus = thread_pool_default_threads();
+  for (int t = 1; t < cpus && cfg.nthreads < BENCH_MAX_LIST - 1; t *= 2)
+    cfg.threads[cfg.nthreads++] = t;
+  cfg.threads[cfg.nthreads++] = cpus;
+
+  static const struct option long_opts[] = {
+      {"sizes", required_argument, NULL, 's'},
+      {"channels", required_argument, NULL, 'c'},
+      {"threads", required_argument, NULL, 't'},
+      {"ops", required_argument, NULL, 'o'},
+      {"min-time", required_argument, NULL, 'm'},
+      {"quick", no_argument, NULL, 'q'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  int c;
+  while ((c = getopt_long(argc, argv, "s:c:t:o:m:qh", long_opts, NULL)) !=
+         -1) {
+    int n = 0;
+    switch (c) {
+    case 's':
+      n = cfg.nsizes = parse_sizes(optarg, cfg.sizes);
+      break;
+    case 'c':
+      n = cfg.nchannels = parse_list(optarg, cfg.channels);
+      break;
+    case 't':
+      n = cfg.nthreads = parse_list(optarg, cfg.threads);
+      break;
+    case 'o':
+      cfg.ops = optarg;
+      break;
+    case 'm':
+      cfg.min_time = atof(optarg);
+      break;
+    case 'q':
+      cfg.nsizes = parse_sizes("256,1024", cfg.sizes);
+      cfg.min_time = 0.05;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (n < 0) {
+      fprintf(stderr, "Invalid list '%s'\n", optarg);
+      return 1;
+    }
+  }
+
+  int max_threads = 1;
+  for (int i = 0; i < cfg.nthreads; i++)
+    max_threads = cfg.threads[i] > max_threads ? cfg.threads[i] : max_threads;
+  if (thread_pool_default_init(max_threads) != 0) {
+    fprintf(stderr, "Failed to start %d worker threads\n", max_threads);
+    return 1;
+  }
+
+  printf("op,width,height,channels,threads,reps,best_ms,mean_ms,mpx_per_s,"
+         "gb_per_s,speedup\n");
+  int rc = 0;
+  for (int si = 0; si < cfg.nsizes && rc == 0; si++)
+    for (int ci = 0; ci < cfg.nchannels && rc == 0; ci++) {
+      int w = cfg.sizes[si][0], h = cfg.sizes[si][1], ch = cfg.channels[ci];
+      Image src, dst;
+      if (image_alloc(&src, w, h, ch) != 0) {
+        fprintf(stderr, "Failed to allocate %dx%dx%d image\n", w, h, ch);
+        rc = -1;
+        break;
+      }
+      fill_pattern(&src);
+      for (size_t oi = 0; oi < sizeof(bench_ops) / sizeof(bench_ops[0]);
+           oi++) {
+        const BenchOp *op = &bench_ops[oi];
+        if (!op_selected(cfg.ops, op->name))
+          continue;
+        int dw = w, dh = h;
+        if (op->run == run_rotate90)
+          dw = h, dh = w;
+        else if (op->run == run_resize || op->run == run_resize_area)
+          dw = (w + 1) / 2, dh = (h + 1) / 2;
+        else if (op->run == run_thumbs)
+          dw = (w + 2) / 3, dh = (h + 2) / 3;
+        if (image_alloc(&dst, dw, dh, ch) != 0) {
+          fprintf(stderr, "Failed to allocate %dx%dx%d image\n", dw, dh, ch);
+          rc = -1;
+          break;
+        }
+        double base = 0.0;
+        for (int ti = 0; ti < cfg.nthreads; ti++) {
+          double best, mean;
+          int reps;
+          fprintf(stderr, "%s %dx%dx%d threads=%d\n", op->name, w, h, ch,
+                  cfg.threads[ti]);
+          if (time_op(op, &src, &dst, cfg.threads[ti], &cfg, &best, &mean,
+                      &reps) != 0) {
+            fprintf(stderr, "%s failed\n", op->name);
+            rc = -1;
+            break;
+          }
+          if (ti == 0)
+            base = best;
+          double bytes = (double)w * h * ch + (double)dw * dh * ch;
+          printf("%s,%d,%d,%d,%d,%d,%.3f,%.3f,%.1f,%.2f,%.2f\n", op->name, w,
+                 h, ch, cfg.threads[ti], reps, best * 1e3, mean * 1e3,
+                 (double)dw * dh / best * 1e-6, bytes / best * 1e-9,
+                 base / best);
+          fflush(stdout);
+        }
+        image_free(&dst);
+        if (rc != 0)
+          break;
+      }
+      image_free(&src);
+    }
+  thread_pool_default_shutdown();
+  return rc == 0 ? 0 : 1;
+}
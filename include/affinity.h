@@ -0,0 +1,18 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// Optional placement of pool threads and their memory on multi-socket hosts.
+// Off by default; configured once from the environment:
+//   IMAGEMUGGLE_PIN=compact|scatter  pin thread slot k to one CPU, filling
+//                                    one NUMA node after the other (compact)
+//                                    or round-robin across nodes (scatter)
+//   IMAGEMUGGLE_NUMA=local|interleave  node-local allocation (a new page
+//                                    lands on the node of the worker that
+//                                    first writes it), or pages interleaved
+//                                    across nodes
+
+// Pins the calling thread to the CPU of pool slot 'slot' (0 = submitting
+// thread) and applies the memory policy; no-op when neither is configured
+void affinity_init_thread(int slot);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef BLUR_H
+#define BLUR_H
+#include "pipeline.h"
+#include "utils_conc.h"
+
+// Box blur of window (2 * radius + 1)^2 with running sums: O(1) per pixel
+int box_blur_concurrent(const Image *src, Image *dst, int radius,
+                        int num_threads);
+
+// Gaussian approximation by three box passes whose widths match sigma
+int gaussian_blur_concurrent(const Image *src, Image *dst, float sigma,
+                             int num_threads);
+
+// Pipeline stages of the two blurs (same geometry in and out)
+int box_blur_stage(int width, int height, int channels, int radius,
+                   PipelineStage *st);
+int gaussian_blur_stage(int width, int height, int channels, float sigma,
+                        PipelineStage *st);
+
+#endif
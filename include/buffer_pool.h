@@ -0,0 +1,30 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+#include <stddef.h>
+
+// Process-wide cache of large blocks (image pixels, pipeline scratch) keyed
+// by size class, so repeated operations reuse memory that is already mapped
+// instead of page-faulting fresh allocations. Thread safe.
+
+// Counters of the pool; outstanding = handed out and not yet returned
+typedef struct {
+  size_t outstanding_bytes, outstanding_blocks;
+  size_t peak_outstanding_bytes;
+  size_t cached_bytes, cached_blocks;
+  unsigned long long hits, misses;
+} BufferPoolStats;
+
+// Returns a block of at least bytes, zero-filled if zero is nonzero; its
+// usable size (the size class) is stored in *capacity when not NULL
+void *buffer_pool_get(size_t bytes, int zero, size_t *capacity);
+
+// Gives a block back; bytes is the requested size or the capacity
+void buffer_pool_put(void *block, size_t bytes);
+
+// Frees every cached block
+void buffer_pool_trim(void);
+
+// Snapshot of the counters
+void buffer_pool_stats(BufferPoolStats *out);
+
+#endif
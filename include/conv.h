@@ -2,8 +2,17 @@
 #define CONV_H
 #include "utils_conc.h"
 
-int conv_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                    int height, int channels, const float *kernel, int k,
+int conv_concurrent(const Image *src, Image *dst, const float *kernel, int k,
                     float factor, float bias, int num_threads);
 
+// Separable convolution with horizontal kernel kh and vertical kernel kv
+int conv_separable_concurrent(const Image *src, Image *dst, const float *kh,
+                              const float *kv, int k, float factor, float bias,
+                              int num_threads);
+
+// Float k x k reference path (no separable or fixed-point shortcuts)
+int conv_reference_concurrent(const Image *src, Image *dst,
+                              const float *kernel, int k, float factor,
+                              float bias, int num_threads);
+
 #endif
@@ -0,0 +1,26 @@
+#ifndef CONV_SIMD_H
+#define CONV_SIMD_H
+#include <stdint.h>
+
+// Fixed-point multi-tap row kernels shared by the convolution paths.
+// For every j in [0, len): acc = add + sum_t w[t] * src[t][j], and the output
+// is acc >> shift saturated to the output type. ntaps must be even (pad with a
+// zero weight). Each entry point picks AVX-512, AVX2, SSE2 or scalar code
+// once, as allowed by cpu_isa().
+
+// 8-bit taps to 8-bit output
+void convfx_u8_u8(const unsigned char *const *src, const int16_t *w, int ntaps,
+                  int32_t add, int shift, unsigned char *dst, int len);
+
+// 8-bit taps to 16-bit intermediate
+void convfx_u8_s16(const unsigned char *const *src, const int16_t *w,
+                   int ntaps, int32_t add, int shift, int16_t *dst, int len);
+
+// 16-bit intermediate taps to 8-bit output
+void convfx_s16_u8(const int16_t *const *src, const int16_t *w, int ntaps,
+                   int32_t add, int shift, unsigned char *dst, int len);
+
+// Name of the instruction set selected for the row kernels
+const char *convfx_isa(void);
+
+#endif
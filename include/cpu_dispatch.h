@@ -0,0 +1,26 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+// Instruction set levels of the pixel kernels, in increasing order; a level
+// implies every level below it
+typedef enum {
+  CPU_ISA_SCALAR, // portable C
+  CPU_ISA_SSE2,   // x86-64 baseline
+  CPU_ISA_SSE41,  // SSE4.1 (and SSSE3)
+  CPU_ISA_AVX2,
+  CPU_ISA_AVX512 // AVX-512 F and BW
+} CpuIsa;
+
+// Level the kernels run at: the best the CPU supports (cpuid, read once),
+// capped by IMAGEMUGGLE_ISA=scalar|sse2|sse4.1|avx2|avx512. Every kernel
+// module picks its widest variant at or below this level.
+CpuIsa cpu_isa(void);
+
+// Name of a level as accepted by IMAGEMUGGLE_ISA
+const char *cpu_isa_name(CpuIsa isa);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <stddef.h>
+
+// Flat interleaved 8-bit image: row y starts at data + y * stride and holds
+// width * channels bytes. A view shares the pixel block of its parent.
+typedef struct {
+  unsigned char *data;
+  int width, height, channels;
+  size_t stride;   // bytes between the starts of consecutive rows
+  size_t capacity; // bytes of the pooled block; 0 for an adopted block
+  void *map;       // file mapping holding data (see mapped_io.h), or NULL
+  size_t map_bytes;
+} Image;
+
+// Allocates a zero-filled image with tightly packed rows (stride = w * c)
+int image_alloc(Image *img, int width, int height, int channels);
+
+// Same as image_alloc without clearing the pixels, for images whose every
+// pixel is written before it is read
+int image_alloc_uninit(Image *img, int width, int height, int channels);
+
+// Gives an image a new geometry, keeping its block when it is large enough;
+// the pixel contents are undefined afterwards
+int image_reshape(Image *img, int width, int height, int channels);
+
+// Wraps a malloc'ed, tightly packed pixel block without copying; the image
+// takes ownership of data
+int image_adopt(Image *img, unsigned char *data, int width, int height,
+                int channels);
+
+// Releases the pixel block of an image (back to the buffer pool if it came
+// from there, unmapped if it is a file mapping)
+void image_free(Image *img);
+
+// Pointer to the first byte of row y
+static inline unsigned char *image_row(const Image *img, int y) {
+  return img->data + (size_t)y * img->stride;
+}
+
+// Pointer to the first channel of pixel (x, y)
+static inline unsigned char *image_px(const Image *img, int x, int y) {
+  return img->data + (size_t)y * img->stride + (size_t)x * img->channels;
+}
+
+#endif
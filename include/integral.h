@@ -0,0 +1,64 @@
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+#include "utils_conc.h"
+#include <stdint.h>
+
+// Summed-area table of an image: entry (x, y) of channel c holds the sum of
+// channel c over the pixels [0, x) x [0, y), so a table has (width + 1) x
+// (height + 1) interleaved entries with a zero first row and column, and the
+// sum of any rectangle costs four reads.
+//
+// 32-bit tables wrap past 2^32, but rectangle sums are taken modulo 2^32 and
+// stay exact as long as the rectangle itself sums below 2^32, i.e. for
+// rectangles of at most INTEGRAL_MAX_AREA32 pixels; larger windows need
+// 64-bit entries.
+#define INTEGRAL_MAX_AREA32 16843009u // floor((2^32 - 1) / 255)
+
+typedef struct {
+  void *data; // uint32_t entries, or uint64_t when wide
+  int width, height, channels; // geometry of the summed image
+  int wide;                    // 1 for 64-bit entries
+  size_t stride;               // entries per table row ((width + 1) * ch)
+  size_t bytes;                // size of the data block
+} IntegralImage;
+
+// Builds the table of src in two parallel passes: prefix sums along each row
+// (rows split among tasks), then running sums down the columns (columns
+// split among tasks)
+int integral_build(const Image *src, int wide, IntegralImage *ii,
+                   int num_threads);
+
+// Releases the table of integral_build
+void integral_free(IntegralImage *ii);
+
+// Tells whether windows of area pixels need a 64-bit table
+static inline int integral_wide_for(uint64_t area) {
+  return area > INTEGRAL_MAX_AREA32;
+}
+
+// Sum of channel c over the pixels [x0, x1) x [y0, y1)
+static inline uint64_t integral_rect(const IntegralImage *ii, int x0, int y0,
+                                     int x1, int y1, int c) {
+  size_t a = (size_t)y0 * ii->stride, b = (size_t)y1 * ii->stride;
+  size_t l = (size_t)x0 * ii->channels + c, r = (size_t)x1 * ii->channels + c;
+  if (ii->wide) {
+    const uint64_t *t = (const uint64_t *)ii->data;
+    return t[b + r] - t[b + l] - t[a + r] + t[a + l];
+  }
+  const uint32_t *t = (const uint32_t *)ii->data;
+  return (uint32_t)(t[b + r] - t[b + l] - t[a + r] + t[a + l]);
+}
+
+// Box filter of window (2 * radius + 1)^2 with edge-clamped borders, read
+// from a summed-area table: the cost per pixel does not depend on the radius,
+// and the result matches box_blur_concurrent for radii up to 128
+int integral_box_concurrent(const Image *src, Image *dst, int radius,
+                            int num_threads);
+
+// Area-average resize to the geometry of dst: every output pixel is the mean
+// of its exact (fractional) footprint in the source, at a cost per output
+// pixel that does not depend on the scale factor
+int integral_area_resize_concurrent(const Image *src, Image *dst,
+                                    int num_threads);
+
+#endif
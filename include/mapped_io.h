@@ -0,0 +1,30 @@
+#ifndef MAPPED_IO_H
+#define MAPPED_IO_H
+#include "image.h"
+
+// Uncompressed image files accessed through mmap: Netpbm (P5, P6, P7 with
+// 8-bit samples) and IMRAW, a fixed 64-byte little-endian header followed by
+// tightly packed interleaved rows:
+//   bytes 0-7   magic "IMGRAW01"
+//   bytes 8-19  width, height, channels (uint32)
+//   bytes 20-23 header size in bytes (64; pixel data starts there)
+//   bytes 24-63 zero
+#define IMRAW_MAGIC "IMGRAW01"
+#define IMRAW_HEADER_BYTES 64
+
+// Tells whether a path names a mappable format (.pnm .pgm .ppm .pam .raw)
+int mapped_path(const char *path);
+
+// Maps a file and makes img a view of its pixels (copy-on-write, so the file
+// is never modified); image_free unmaps it
+int image_map_read(const char *path, Image *img);
+
+// Creates a file of the given geometry (Netpbm or IMRAW by extension) and
+// maps it shared: pixels written to img land in the file; image_free unmaps
+int image_map_write(const char *path, int width, int height, int channels,
+                    Image *img);
+
+// Writes a copy of an image to a new mapped file
+int image_map_save(const char *path, const Image *img);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef OPS_H
+#define OPS_H
+#include "resize.h"
+#include "rotate.h"
+#include "utils_conc.h"
+
+typedef enum {
+  OP_BLUR,   // blur[:N]        like N passes of the 3x3 box (menu blur)
+  OP_BOX,    // box:R           box blur of radius R
+  OP_GAUSS,  // gauss:SIGMA     Gaussian approximation
+  OP_SOBEL,  // sobel
+  OP_ROTATE, // rotate:DEG      clockwise, exact for multiples of 90
+  OP_FLIP,   // flip:h | flip:v
+  OP_RESIZE  // resize:WxH[:F]  F = bilinear|box|catmull|lanczos3; 0 keeps
+             //                 the aspect ratio
+} OpType;
+
+// One step of an operation chain
+typedef struct {
+  OpType type;
+  int n;         // blur passes, box radius
+  float value;   // Gaussian sigma, rotation angle
+  int width;     // resize target (0 = derived from the other side)
+  int height;
+  ResizeFilter filter;
+  FlipAxis axis;
+} Op;
+
+typedef struct {
+  Op *ops;
+  int count;
+} OpChain;
+
+// Step that failed, returned by ops_map and ops_file (0 on success)
+typedef enum {
+  OPS_ERR_READ = -1,    // input missing, unreadable or undecodable
+  OPS_ERR_PROCESS = -2, // chain cannot be applied (geometry, memory, pool)
+  OPS_ERR_WRITE = -3    // output cannot be created or written
+} OpsError;
+
+// Parses a comma-separated chain such as "blur:5,sobel,resize:800x600"
+int ops_parse(const char *spec, OpChain *chain);
+void ops_free(OpChain *chain);
+
+// Parses a comma-separated list of output sizes, each in the "WxH[:F]" form
+// of a resize step (e.g. "1600x0,800x0,200x200:box"), into OP_RESIZE steps
+int ops_parse_sizes(const char *spec, OpChain *sizes);
+
+// Applies one operation; the result replaces *img and *scratch is a reusable
+// buffer that is reallocated when the geometry changes
+int op_run(const Op *op, Image *img, Image *scratch, int num_threads);
+
+// Applies every operation of a chain in order, fused into row strips by
+// pipeline_run
+int ops_apply(const OpChain *chain, Image *img, int num_threads);
+
+// Resizes img to every size of a list through one pyramid (pyramid.h), so
+// the full-resolution image is read once; outs receives sizes->count images
+int ops_resize_sizes(const OpChain *sizes, const Image *img, Image *outs,
+                     int num_threads);
+
+// Applies a chain of row-local operations to a PNM file row by row, with
+// memory bounded by the image width; reports the output geometry
+int ops_stream(const OpChain *chain, const char *in_path, const char *out_path,
+               int num_threads, int *width, int *height, int *channels);
+
+// Applies a chain from a mapped Netpbm/IMRAW file straight into a mapped
+// output file (see mapped_io.h); reports the output geometry and returns 0
+// or an OpsError
+int ops_map(const OpChain *chain, const char *in_path, const char *out_path,
+            int num_threads, int *width, int *height, int *channels);
+
+// Applies a chain (possibly empty) to one PNG or mapped file and saves the
+// result in the format of out_path; reports the output geometry and returns
+// 0 or an OpsError
+int ops_file(const OpChain *chain, const char *in_path, const char *out_path,
+             int num_threads, int png_level, int *width, int *height,
+             int *channels);
+
+#endif
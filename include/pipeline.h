@@ -0,0 +1,41 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include "utils_conc.h"
+
+// One operator prepared for strip-wise execution inside a pipeline. The
+// stage builders of the operator modules (box_blur_stage, sobel_stage, ...)
+// fill it; pipeline_run sets src, dst and the row fields of args per strip.
+typedef struct PipelineStage {
+  void *(*worker)(void *); // row worker computing output rows [y0, y1)
+  WorkArgs args;           // prepared arguments (input geometry, parameters)
+  int width, height;       // output geometry (channels are preserved)
+  int halo;                // input rows needed above and below an output row
+  // Input rows [*lo, *hi) needed for output rows [y0, y1); NULL uses halo
+  void (*footprint)(const struct PipelineStage *st, int y0, int y1, int *lo,
+                    int *hi);
+  void *state;                 // operator-private data owned by the stage
+  void (*release)(void *state); // frees state; NULL for plain free()
+} PipelineStage;
+
+// Frees the operator-private state of a stage
+void pipeline_stage_release(PipelineStage *st);
+
+// Runs stages[0..n) over src into dst (shaped like the last stage output),
+// strip by strip with intermediates kept in per-task scratch buffers
+int pipeline_run(const PipelineStage *stages, int n, const Image *src,
+                 Image *dst, int num_threads);
+
+// Row source and sink of pipeline_stream: transfer the next count rows,
+// stride bytes apart; 0 on success, -1 on failure
+typedef int (*PipeReadRows)(void *ctx, unsigned char *rows, size_t stride,
+                            int count);
+typedef int (*PipeWriteRows)(void *ctx, const unsigned char *rows,
+                             size_t stride, int count);
+
+// Runs row-local stages from read to write with memory bounded by the image
+// width: input rows pass through a sliding window, output leaves in strips
+int pipeline_stream(const PipelineStage *stages, int n, PipeReadRows read,
+                    void *read_ctx, PipeWriteRows write, void *write_ctx,
+                    int num_threads);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+#include "image.h"
+
+// Compression levels: 0 stores the filtered rows uncompressed (fastest),
+// 1 to 9 search longer match chains for smaller files
+#define PNG_LEVEL_MIN 0
+#define PNG_LEVEL_MAX 9
+#define PNG_LEVEL_DEFAULT 6
+
+// Writes an 8-bit PNG (1 to 4 channels). Rows are filtered and deflated in
+// independent strips on the shared thread pool and joined into one zlib
+// stream; level is clamped to [PNG_LEVEL_MIN, PNG_LEVEL_MAX].
+int png_write(const char *path, const Image *img, int level);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PNM_H
+#define PNM_H
+#include <stddef.h>
+#include <stdio.h>
+
+// Open binary Netpbm file (P5 gray, P6 RGB, P7 PAM with 1-4 channels, 8-bit)
+// read or written a few rows at a time, so images of any height can be
+// processed without holding them in memory
+typedef struct {
+  FILE *fp;
+  int width, height, channels;
+  int rows_done; // rows read or written so far
+} PnmStream;
+
+// Opens a PNM file and parses its header
+int pnm_open_read(const char *path, PnmStream *s);
+
+// Creates a PNM file and writes its header (P5 for 1 channel, P6 for 3, P7
+// otherwise)
+int pnm_open_write(const char *path, int width, int height, int channels,
+                   PnmStream *s);
+
+// Reads / writes the next count rows; ctx is a PnmStream (the signatures
+// match the row callbacks of pipeline_stream)
+int pnm_read_rows(void *ctx, unsigned char *rows, size_t stride, int count);
+int pnm_write_rows(void *ctx, const unsigned char *rows, size_t stride,
+                   int count);
+
+// Closes the file; -1 if buffered data could not be written
+int pnm_close(PnmStream *s);
+
+// Tells whether a path has a Netpbm extension (.pnm, .pgm, .ppm, .pam)
+int pnm_path(const char *path);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Run profiler: wall time per operator, time and rows per row block and per
+// thread, image bytes allocated and peak RSS, written as a JSON report.
+// Disabled unless profile_start is called; the hooks then cost one branch.
+
+extern int profile_on;
+
+static inline int profile_enabled(void) { return profile_on; }
+
+// Enables recording; the report goes to path ("-" for stderr)
+void profile_start(const char *path);
+
+// Monotonic clock in nanoseconds
+uint64_t profile_now(void);
+
+// One complete call of an operator or I/O phase (load, save, tables, ...)
+void profile_record(const char *op, uint64_t ns, int rows, size_t bytes);
+
+// One row block of an operator, run by the calling thread
+void profile_task(const char *op, uint64_t ns, int rows);
+
+// Summary of one parallel launch: slowest and total block time
+void profile_launch(const char *op, int tasks, uint64_t max_ns,
+                    uint64_t sum_ns);
+
+// Bytes of a pixel buffer allocation
+void profile_alloc(size_t bytes);
+
+// Writes the JSON report if recording is enabled
+int profile_report(void);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+#include "resize.h"
+#include "utils_conc.h"
+
+#define PYRAMID_MAX_LEVELS 32
+
+// Successive 2x reductions of an image: level i + 1 is the exact rounded
+// 2x2 average of level i, (w + 1) / 2 x (h + 1) / 2 pixels, the last column
+// or row of an odd size being paired with itself
+typedef struct {
+  Image levels[PYRAMID_MAX_LEVELS]; // levels[0] is a view of the source
+  int count;                        // levels held, source included
+} Pyramid;
+
+// Builds up to count levels (source included, fewer once a level is 1x1).
+// Runs of up to four levels are fused: each task halves a strip of rows down
+// through the run while it is in cache, so the source is read once
+int pyramid_build(const Image *src, int count, Pyramid *py, int num_threads);
+
+// Releases the levels of pyramid_build (not the source)
+void pyramid_free(Pyramid *py);
+
+// Index of the smallest level of at least width x height pixels (0 when the
+// source itself is smaller), for a source of src_w x src_h
+int pyramid_level_for(int src_w, int src_h, int width, int height);
+
+// Resizes src to the geometry of every dsts[i] with filters[i]: each output
+// is resampled from its pyramid_level_for level, so the full-resolution
+// source is read once instead of once per output
+int pyramid_resize_concurrent(const Image *src, Image *dsts,
+                              const ResizeFilter *filters, int count,
+                              int num_threads);
+
+#endif
@@ -1,8 +1,24 @@
 #ifndef RESIZE_H
 #define RESIZE_H
+#include "pipeline.h"
 #include "utils_conc.h"
 
-int resize_concurrent(unsigned char ***src, int w, int h, int channels,
-                      unsigned char ***dst, int nw, int nh, int num_threads);
+// Resampling filters; supports are widened by the scale factor when shrinking
+typedef enum {
+  RESIZE_BILINEAR,    // triangle, bilinear interpolation when enlarging
+  RESIZE_BOX,         // box, area averaging when shrinking
+  RESIZE_CATMULL_ROM, // cubic convolution with a = -0.5
+  RESIZE_LANCZOS3     // windowed sinc with 3 lobes
+} ResizeFilter;
+
+int resize_concurrent(const Image *src, Image *dst, int num_threads);
+
+// Two-pass fixed-point resize to the geometry of dst with the given filter
+int resize_filter_concurrent(const Image *src, Image *dst, ResizeFilter filter,
+                             int num_threads);
+
+// Pipeline stage of resize_filter_concurrent to out_w x out_h
+int resize_stage(int width, int height, int channels, int out_w, int out_h,
+                 ResizeFilter filter, PipelineStage *st);
 
 #endif
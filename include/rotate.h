@@ -1,8 +1,28 @@
 #ifndef ROTATE_H
 #define ROTATE_H
+#include "pipeline.h"
 #include "utils_conc.h"
 
-int rotate_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                      int height, int channels, float ang_deg, int num_threads);
+// Mirror axis of flip_concurrent
+typedef enum { FLIP_HORIZONTAL, FLIP_VERTICAL } FlipAxis;
+
+int rotate_concurrent(const Image *src, Image *dst, float ang_deg,
+                      int num_threads);
+
+// Exact clockwise rotation by quarter_turns * 90 degrees (pure pixel moves);
+// dst must be src->height x src->width when quarter_turns is odd
+int rotate90_concurrent(const Image *src, Image *dst, int quarter_turns,
+                        int num_threads);
+
+// Exact mirror image; dst has the same geometry as src
+int flip_concurrent(const Image *src, Image *dst, FlipAxis axis,
+                    int num_threads);
+
+// Pipeline stages of the rotations (exact for multiples of 90 degrees, with
+// swapped dimensions for odd quarter turns) and of flip_concurrent
+int rotate_stage(int width, int height, int channels, float ang_deg,
+                 PipelineStage *st);
+int flip_stage(int width, int height, int channels, FlipAxis axis,
+               PipelineStage *st);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+#include "utils_conc.h"
+
+// Fractional bits of sample positions: the four bilinear weights of a pixel
+// are products of multiples of 1/128 and sum to 1 << (2 * SAMPLE_FRAC_BITS)
+#define SAMPLE_FRAC_BITS 7
+
+// Source image of a sampler: image row y (0 <= y < height) starts at
+// data + (y - y0) * stride, so workers can pass pipeline windows
+typedef struct {
+  const unsigned char *data; // row y0
+  size_t stride;
+  int y0;
+  int width, height, channels; // geometry of the whole image
+} SampleSource;
+
+// Bilinear samples along a line: output pixel i (0 <= i < n) interpolates the
+// source at (x + i * dx, y + i * dy), in pixels with centers on integers. All
+// channels of a pixel share one set of fixed-point weights; positions outside
+// [0, width) x [0, height) produce zero pixels, and neighbours past the last
+// row or column are clamped to it. RGB and RGBA use AVX-512, AVX2 or SSE2
+// code as allowed by cpu_isa().
+void sample_bilinear_line(const SampleSource *src, double x, double y,
+                          double dx, double dy, unsigned char *out, int n);
+
+// Name of the instruction set selected for the sampler
+const char *sample_isa(void);
+
+// Sampler view of a worker's source (whole image or pipeline window)
+static inline SampleSource sample_source(const WorkArgs *a) {
+  SampleSource s = {a->src->data, a->src->stride, a->src_y0,
+                    a->width,     a->height,      a->channels};
+  return s;
+}
+
+#endif
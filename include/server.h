@@ -0,0 +1,36 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Longest job line accepted, newline included
+#define SERVER_MAX_LINE 65536
+// Connections served at once on the socket; more are refused
+#define SERVER_MAX_CLIENTS 64
+
+// Serves jobs in one long-running process, so the worker pool, the buffer
+// pools and the tables built on first use stay warm between images. Jobs are
+// newline-delimited JSON objects, one per line:
+//
+//   {"id": 7, "in": "a.png", "out": "a_small.png", "ops": "resize:256x0"}
+//
+// "in" and "out" are required, "ops" is an operation chain (omitted or empty
+// to convert formats) and "id" is any JSON value (up to 256 bytes of text,
+// nested objects and arrays included) echoed in the answer. Other keys are
+// ignored. Each job is answered with one line, in order:
+//
+//   {"id": 7, "ok": true, "width": 256, "height": 192, "channels": 3,
+//    "ms": 3.412}
+//   {"id": 8, "ok": false, "error": "invalid ops"}
+//
+// where "ms" is the latency from the end of the request line to the answer
+// and "error" is "line too long", "invalid job" or "invalid ops" for a line
+// rejected without running, or "cannot read input", "processing failed" or
+// "cannot write output" for the step of a job that failed.
+// With path "-" jobs are read from stdin and answered on stdout until end of
+// input; otherwise a Unix domain socket is created at path and every
+// connection is served by its own thread (jobs of different connections run
+// concurrently on the shared pool) until SIGINT or SIGTERM. A latency
+// summary of the jobs run, with the count of rejected lines, is printed to
+// stderr on exit.
+int server_run(const char *path, int num_threads, int png_level);
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef SOBEL_H
 #define SOBEL_H
+#include "pipeline.h"
 #include "utils_conc.h"
 
-int sobel_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                     int height, int channels, int num_threads);
+int sobel_concurrent(const Image *src, Image *dst, int num_threads);
+
+// Pipeline stage of sobel_concurrent (same geometry in and out)
+int sobel_stage(int width, int height, int channels, PipelineStage *st);
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+typedef struct ThreadPool ThreadPool;
+
+// Body of a parallel-for: called once for every task index in [0, n)
+typedef void (*PoolTaskFn)(void *ctx, int task);
+
+// Creates a pool giving num_threads-way parallelism (the submitting thread
+// counts as one of them, so num_threads - 1 workers are started)
+ThreadPool *thread_pool_create(int num_threads);
+
+// Wakes, joins and frees all workers; no job may be in flight
+void thread_pool_destroy(ThreadPool *pool);
+
+// Parallelism of the pool, including the submitting thread
+int thread_pool_size(const ThreadPool *pool);
+
+// Runs fn(ctx, i) for every i in [0, num_tasks) and waits for completion.
+// Safe to call from several threads at once and from inside a task.
+int thread_pool_parallel_for(ThreadPool *pool, int num_tasks, PoolTaskFn fn,
+                             void *ctx);
+
+// Thread count from IMAGEMUGGLE_THREADS, or the number of online CPUs
+int thread_pool_default_threads(void);
+
+// Process-wide pool shared by all operators; created on first use
+int thread_pool_default_init(int num_threads);
+ThreadPool *thread_pool_default(void);
+void thread_pool_default_shutdown(void);
+
+#endif
@@ -1,15 +1,27 @@
 #ifndef UTILS_CONC_H
 #define UTILS_CONC_H
+#include "image.h"
 #include <pthread.h>
 
+// How launch_threads_by_rows distributes rows among its tasks
+typedef enum {
+  SCHED_STATIC,  // one contiguous block per task (uniform row cost)
+  SCHED_DYNAMIC, // fixed chunks claimed from a shared counter
+  SCHED_GUIDED   // claimed chunks shrink with the remaining rows
+} RowSchedule;
+
 typedef struct {
-  unsigned char ***src; // read
-  unsigned char ***dst; // write
-  int width, height, channels;
+  const Image *src; // read
+  Image *dst;       // write
+  int width, height, channels; // source geometry
   int y0, y1; // range [y0, y1)
+  // First row held by src and dst: 0 for whole images, the first row of the
+  // strip when a pipeline runs the worker on partial buffers
+  int src_y0, dst_y0;
 
   // Convolution
   const float *kernel;
+  const float *kernel_y; // vertical taps of a separable kernel
   int k;
   float factor;
   float bias;
@@ -17,18 +29,34 @@ typedef struct {
   float cx, cy, ang_rad;
   // Resize
   float scale_x, scale_y;
+  // Operator-private parameters (e.g. fixed-point taps)
+  const void *ctx;
+  // Operator name in profiling reports
+  const char *name;
+  // Row distribution of launch_threads_by_rows (default SCHED_STATIC)
+  RowSchedule schedule;
 } WorkArgs;
 
-// Creates 3D matrix [height][width][channels] contiguous in memory
-unsigned char ***create3DMatrix(int height, int width, int channels);
+// Source row y of a worker (src may only hold rows from src_y0 on)
+static inline const unsigned char *work_src_row(const WorkArgs *a, int y) {
+  return image_row(a->src, y - a->src_y0);
+}
+
+// Destination row y of a worker (dst may only hold rows from dst_y0 on)
+static inline unsigned char *work_dst_row(const WorkArgs *a, int y) {
+  return image_row(a->dst, y - a->dst_y0);
+}
+
+// Return value of a worker that could not complete its rows
+#define WORKER_FAILED ((void *)1)
 
-// Launch N threads executing 'worker' with row division
+// Launch N pool tasks executing 'worker' over the rows of base.dst, split
+// as base.schedule says (IMAGEMUGGLE_SCHEDULE overrides it)
 int launch_threads_by_rows(void *(*worker)(void *), WorkArgs base,
                            int num_threads);
 
-// I/O utilities (optional stb)
-int loadPNG(const char *path, unsigned char ****out_px, int *w, int *h,
-            int *ch);
-int savePNG(const char *path, unsigned char ***px, int w, int h, int ch);
+// PNG I/O; loading needs stb (USE_STB), saving uses png_write
+int loadPNG(const char *path, Image *out);
+int savePNG(const char *path, const Image *img, int level);
 
 #endif
@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Nodes considered; enough for every current multi-socket machine
+#define AFFINITY_MAX_NODES 64
+// set_mempolicy modes (linux/mempolicy.h), used without libnuma
+#define AFFINITY_MPOL_INTERLEAVE 3
+#define AFFINITY_MPOL_LOCAL 4
+
+typedef enum { PIN_NONE, PIN_COMPACT, PIN_SCATTER } PinMode;
+typedef enum { MEM_DEFAULT, MEM_LOCAL, MEM_INTERLEAVE } MemMode;
+
+static pthread_once_t affinity_once = PTHREAD_ONCE_INIT;
+static PinMode pin_mode;
+static MemMode mem_mode;
+static int cpu_order[CPU_SETSIZE]; // CPU of every slot, in pinning order
+static int cpu_count;
+static unsigned long node_mask; // nodes with CPUs, for interleaving
+
+/**
+ * Parses a sysfs CPU or node list ("0-3,8,10-11") into a CPU set
+ *
+ * @param text List to parse
+ * @param set Receives the listed numbers
+ */
+static void parse_list(const char *text, cpu_set_t *set) {
+  CPU_ZERO(set);
+  while (*text) {
+    char *end;
+    long lo = strtol(text, &end, 10), hi = lo;
+    if (end == text)
+      break;
+    if (*end == '-')
+      hi = strtol(end + 1, &end, 10);
+    for (long i = lo; i <= hi && i < CPU_SETSIZE; i++)
+      CPU_SET(i, set);
+    text = *end == ',' ? end + 1 : end;
+  }
+}
+
+/**
+ * Reads a sysfs list file
+ *
+ * @param path File to read
+ * @param set Receives the listed numbers
+ * @return 0 on success, -1 if the file is missing
+ */
+static int read_list(const char *path, cpu_set_t *set) {
+  char buf[4096];
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return -1;
+  size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+  parse_list(buf, set);
+  return 0;
+}
+
+/**
+ * Reads the configuration and orders the CPUs this process may run on
+ *
+ * The CPUs of each NUMA node (from /sys/devices/system/node) that are in the
+ * process affinity mask form one group. Compact pinning walks the groups one
+ * after the other, so consecutive slots share a node; scatter pinning takes
+ * one CPU of every node in turn. Without NUMA information all allowed CPUs
+ * form a single group.
+ */
+static void affinity_init(void) {
+  const char *pin = getenv("IMAGEMUGGLE_PIN");
+  const char *mem = getenv("IMAGEMUGGLE_NUMA");
+  pin_mode = !pin                         ? PIN_NONE
+             : strcmp(pin, "compact") == 0 ? PIN_COMPACT
+             : strcmp(pin, "scatter") == 0 ? PIN_SCATTER
+                                           : PIN_NONE;
+  mem_mode = !mem                            ? MEM_DEFAULT
+             : strcmp(mem, "local") == 0      ? MEM_LOCAL
+             : strcmp(mem, "interleave") == 0 ? MEM_INTERLEAVE
+                                              : MEM_DEFAULT;
+  if (pin && pin_mode == PIN_NONE)
+    fprintf(stderr, "Ignoring IMAGEMUGGLE_PIN=%s (compact or scatter)\n", pin);
+  if (mem && mem_mode == MEM_DEFAULT)
+    fprintf(stderr, "Ignoring IMAGEMUGGLE_NUMA=%s (local or interleave)\n",
+            mem);
+  if (pin_mode == PIN_NONE && mem_mode == MEM_DEFAULT)
+    return;
+
+  cpu_set_t allowed, online;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    CPU_ZERO(&allowed);
+  static cpu_set_t node_cpus[AFFINITY_MAX_NODES];
+  int nodes = 0;
+  if (read_list("/sys/devices/system/node/online", &online) == 0) {
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+      char path[64];
+      cpu_set_t cpus;
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+               node);
+      if (!CPU_ISSET(node, &online) || read_list(path, &cpus) != 0)
+        continue;
+      CPU_AND(&node_cpus[nodes], &cpus, &allowed);
+      if (CPU_COUNT(&node_cpus[nodes]) == 0)
+        continue;
+      node_mask |= 1ul << node;
+      nodes++;
+    }
+  }
+  if (nodes == 0) {
+    node_cpus[0] = allowed;
+    nodes = 1;
+  }
+
+  int next[AFFINITY_MAX_NODES] = {0}; // next CPU number examined per node
+  for (int added = 1; added;) {
+    added = 0;
+    for (int g = 0; g < nodes; g++) {
+      // compact drains a node before moving on, scatter takes one CPU each
+      int take = pin_mode == PIN_SCATTER ? 1 : CPU_SETSIZE;
+      for (; take > 0 && next[g] < CPU_SETSIZE; next[g]++)
+        if (CPU_ISSET(next[g], &node_cpus[g])) {
+          cpu_order[cpu_count++] = next[g];
+          take--;
+          added = 1;
+        }
+    }
+  }
+}
+
+/**
+ * Places the calling pool thread
+ *
+ * With pinning, slot k runs on the k-th CPU of the pinning order (wrapping
+ * when there are more threads than CPUs). With IMAGEMUGGLE_NUMA=local the
+ * thread allocates from its own node (overriding a policy inherited from
+ * numactl); with interleave its new pages are spread over all nodes, which
+ * suits buffers filled by a single thread such as decoded PNGs.
+ *
+ * @param slot 0 for the submitting thread, 1.. for pool workers
+ *
+ * @note Failures are ignored: placement only affects performance
+ */
+void affinity_init_thread(int slot) {
+  pthread_once(&affinity_once, affinity_init);
+  if (pin_mode != PIN_NONE && cpu_count > 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu_order[slot % cpu_count], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  if (mem_mode == MEM_LOCAL)
+    syscall(SYS_set_mempolicy, AFFINITY_MPOL_LOCAL, NULL, 0);
+  else if (mem_mode == MEM_INTERLEAVE && node_mask)
+    syscall(SYS_set_mempolicy, AFFINITY_MPOL_INTERLEAVE, &node_mask,
+            sizeof(node_mask) * 8);
+}
@@ -0,0 +1,499 @@
+#include "blur.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BOX_MAX_PASSES 8
+#define BOX_GAUSS_PASSES 3
+
+/**
+ * Sequence of box passes applied along both axes
+ *
+ * Pass i averages a window of 2 * radius[i] + 1 pixels. All horizontal passes
+ * run first on each row, then the vertical passes run in the same order.
+ * The plan must hold at least one pass.
+ */
+typedef struct {
+  int n;
+  int radius[BOX_MAX_PASSES];
+} BoxPlan;
+
+/**
+ * Divides a window sum by the window area with round-half-up
+ *
+ * Uses a 2^31 fixed-point reciprocal and a 32x32->64-bit multiply, which is
+ * exact for every sum of 8-bit values as long as the area is below 2896;
+ * larger areas fall back to an integer division.
+ *
+ * @param sum Sum of the window
+ * @param d Window area (number of summed samples)
+ * @param inv Reciprocal from box_inv(d), or 0 to force the division
+ *
+ * @return round(sum / d)
+ */
+static inline unsigned char box_avg(uint32_t sum, uint32_t d, uint32_t inv) {
+  if (inv)
+    return (unsigned char)(((uint64_t)(sum + d / 2) * inv) >> 31);
+  return (unsigned char)((sum + d / 2) / d);
+}
+
+/**
+ * Returns the reciprocal used by box_avg for a window area
+ *
+ * @param d Window area
+ * @return ceil(2^31 / d), or 0 when the reciprocal would not be exact
+ */
+static inline uint32_t box_inv(uint32_t d) {
+  return d < 2896 ? (uint32_t)(((1ull << 31) + d - 1) / d) : 0;
+}
+
+/**
+ * Horizontal box pass over one row using per-channel running sums
+ *
+ * Each step adds the pixel entering the window and subtracts the pixel
+ * leaving it, so the cost per pixel does not depend on the radius. Pixels
+ * outside the row are clamped to the nearest edge, like conv_concurrent.
+ *
+ * @param in Input row (width * ch bytes)
+ * @param out Output row, must not alias in
+ * @param width Row width in pixels
+ * @param ch Number of interleaved channels
+ * @param r Box radius
+ */
+static void box_row_h(const unsigned char *in, unsigned char *out, int width,
+                      int ch, int r) {
+  uint32_t d = 2 * r + 1, inv = box_inv(d);
+  for (int c = 0; c < ch; c++) {
+    uint32_t sum = 0;
+    for (int i = -r; i <= r; i++) {
+      int xx = i < 0 ? 0 : (i >= width ? width - 1 : i);
+      sum += in[xx * ch + c];
+    }
+    for (int x = 0; x < width; x++) {
+      out[x * ch + c] = box_avg(sum, d, inv);
+      int add = x + r + 1, sub = x - r;
+      add = add >= width ? width - 1 : add;
+      sub = sub < 0 ? 0 : sub;
+      sum += in[add * ch + c];
+      sum -= in[sub * ch + c];
+    }
+  }
+}
+
+/**
+ * Horizontal box pass that keeps the raw window sums
+ *
+ * Used for the last horizontal pass so that the first vertical pass can
+ * divide once by the full 2D window area: a single box pass then rounds only
+ * once, exactly like the k x k kernel of conv_concurrent. Windows wider than
+ * 257 pixels could overflow 16 bits, so they are stored already averaged.
+ *
+ * @param in Input row (width * ch bytes)
+ * @param out Output row of width * ch sums
+ * @param width Row width in pixels
+ * @param ch Number of interleaved channels
+ * @param r Box radius
+ *
+ * @return Number of samples each output value still has to be divided by
+ */
+static uint32_t box_row_h_sum(const unsigned char *in, uint16_t *out,
+                              int width, int ch, int r) {
+  uint32_t d = 2 * r + 1, inv = box_inv(d);
+  int keep = d <= 257;
+  for (int c = 0; c < ch; c++) {
+    uint32_t sum = 0;
+    for (int i = -r; i <= r; i++) {
+      int xx = i < 0 ? 0 : (i >= width ? width - 1 : i);
+      sum += in[xx * ch + c];
+    }
+    for (int x = 0; x < width; x++) {
+      out[x * ch + c] = keep ? (uint16_t)sum : box_avg(sum, d, inv);
+      int add = x + r + 1, sub = x - r;
+      add = add >= width ? width - 1 : add;
+      sub = sub < 0 ? 0 : sub;
+      sum += in[add * ch + c];
+      sum -= in[sub * ch + c];
+    }
+  }
+  return keep ? d : 1;
+}
+
+/**
+ * One vertical pass of a box plan, streamed over a worker's rows
+ *
+ * Input rows arrive top to bottom into a ring that holds the window of the
+ * next output row plus the row it drops, so the running column sums slide
+ * across the whole row block and no input row is computed twice.
+ */
+typedef struct {
+  int r;                // box radius
+  int lo, hi;           // output rows [lo, hi)
+  int next;             // next output row
+  int cap;              // rows held by the input ring
+  size_t stride;        // bytes between ring rows
+  unsigned char *ring;  // input rows; 16-bit window sums for the first pass
+  uint32_t *sum;        // column sums of the window of row next
+  uint32_t d, inv;      // window area and its box_inv
+} BoxPass;
+
+/**
+ * Returns the ring slot of an input row of a pass
+ *
+ * @param p Pass
+ * @param y Input row, clamped to the image rows [0, height)
+ * @param height Image height
+ *
+ * @return Start of the row in the ring
+ */
+static inline unsigned char *pass_row(const BoxPass *p, int y, int height) {
+  y = y < 0 ? 0 : (y >= height ? height - 1 : y);
+  return p->ring + (size_t)(y % p->cap) * p->stride;
+}
+
+/**
+ * Adds one input row to the column sums of a pass
+ *
+ * @param sum Column sums
+ * @param wide Nonzero for 16-bit input rows (first pass)
+ * @param row Input row
+ * @param row_len Values per row (width * channels)
+ */
+static inline void pass_add(uint32_t *sum, int wide, const unsigned char *row,
+                            size_t row_len) {
+  if (wide)
+    for (size_t j = 0; j < row_len; j++)
+      sum[j] += ((const uint16_t *)row)[j];
+  else
+    for (size_t j = 0; j < row_len; j++)
+      sum[j] += row[j];
+}
+
+/**
+ * Slides the window of a pass down one row and writes the output row
+ *
+ * The update and the division share one loop, which the compiler
+ * vectorizes; add and sub are NULL for a window summed by pass_add.
+ *
+ * @param p Pass
+ * @param wide Nonzero for 16-bit input rows (first pass)
+ * @param add Row entering the window
+ * @param sub Row leaving the window
+ * @param out Output row
+ * @param row_len Values per row (width * channels)
+ */
+static inline void pass_slide(const BoxPass *p, int wide,
+                              const unsigned char *add,
+                              const unsigned char *sub, unsigned char *out,
+                              size_t row_len) {
+  uint32_t *sum = p->sum, d = p->d, inv = p->inv;
+  if (!add) {
+    for (size_t j = 0; j < row_len; j++)
+      out[j] = box_avg(sum[j], d, inv);
+  } else if (wide) {
+    const uint16_t *a16 = (const uint16_t *)add, *s16 = (const uint16_t *)sub;
+    for (size_t j = 0; j < row_len; j++) {
+      sum[j] += a16[j] - s16[j];
+      out[j] = box_avg(sum[j], d, inv);
+    }
+  } else {
+    for (size_t j = 0; j < row_len; j++) {
+      sum[j] += add[j] - sub[j];
+      out[j] = box_avg(sum[j], d, inv);
+    }
+  }
+}
+
+/**
+ * Hands the input rows below avail to pass i and emits every output row
+ * whose window is now complete
+ *
+ * The first output row sums its whole window; each later row adds the row
+ * entering the window and subtracts the one leaving it, so the cost per row
+ * does not depend on the radius. Output rows go into the ring of the next
+ * pass, which is fed at once, or for the last pass into the destination.
+ *
+ * @param a Worker arguments (geometry and destination)
+ * @param ps Passes of the plan
+ * @param n Number of passes
+ * @param i Pass to feed
+ * @param avail One past the last input row available to pass i
+ */
+static void box_feed(const WorkArgs *a, BoxPass *ps, int n, int i,
+                     int avail) {
+  BoxPass *p = &ps[i];
+  int h = a->height, r = p->r;
+  size_t row_len = (size_t)a->width * a->channels;
+  while (p->next < p->hi && (p->next + r < h ? p->next + r : h - 1) < avail) {
+    int y = p->next;
+    unsigned char *o =
+        i + 1 < n ? pass_row(&ps[i + 1], y, h) : work_dst_row(a, y);
+    if (y == p->lo) {
+      memset(p->sum, 0, sizeof(uint32_t) * row_len);
+      for (int k = -r; k <= r; k++)
+        pass_add(p->sum, i == 0, pass_row(p, y + k, h), row_len);
+      pass_slide(p, i == 0, NULL, NULL, o, row_len);
+    } else {
+      pass_slide(p, i == 0, pass_row(p, y + r, h), pass_row(p, y - 1 - r, h),
+                 o, row_len);
+    }
+    p->next++;
+    if (i + 1 < n)
+      box_feed(a, ps, n, i + 1, y + 1);
+  }
+}
+
+/**
+ * Worker thread function for multi-pass box blurring.
+ *
+ * Every source row the block needs (the block and its halo, the sum of the
+ * radii) gets all horizontal passes back to back, row-locally, and is fed to
+ * the first vertical pass; each vertical pass streams its rows to the next
+ * through a ring of 2 * radius + 2 rows and the last one writes the
+ * destination. Each row is thus filtered once per worker whatever the radii,
+ * and the rings, not the image height, bound the scratch memory. The
+ * horizontal and vertical halves of the same box pass share a single
+ * rounding step.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src, dst: Source and destination images (same geometry)
+ *          - width, height, channels: Source geometry
+ *          - y0, y1: Destination row range
+ *          - ctx: BoxPlan with the radius of every pass
+ *
+ * @return NULL on success, WORKER_FAILED if scratch allocation fails
+ */
+static void *worker_box(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const BoxPlan *plan = (const BoxPlan *)a->ctx;
+  int h = a->height, ch = a->channels, n = plan->n;
+  size_t row_len = (size_t)a->width * ch;
+  BoxPass ps[BOX_MAX_PASSES];
+  int rest = 0;
+  for (int i = 0; i < n; i++)
+    rest += plan->radius[i];
+  int lo = a->y0 - rest < 0 ? 0 : a->y0 - rest;
+  int hi = a->y1 + rest > h ? h : a->y1 + rest;
+
+  // the sums first, then the 16-bit ring, then the byte rings
+  size_t bytes = sizeof(uint32_t) * row_len * n;
+  for (int i = 0; i < n; i++) {
+    BoxPass *q = &ps[i];
+    int in_lo = i == 0 ? lo : ps[i - 1].lo, in_hi = i == 0 ? hi : ps[i - 1].hi;
+    rest -= plan->radius[i];
+    q->r = plan->radius[i];
+    q->lo = q->next = a->y0 - rest < 0 ? 0 : a->y0 - rest;
+    q->hi = a->y1 + rest > h ? h : a->y1 + rest;
+    // rows further apart than the ring never share a window
+    q->cap = 2 * q->r + 2 < in_hi - in_lo ? 2 * q->r + 2 : in_hi - in_lo;
+    q->stride = i == 0 ? sizeof(uint16_t) * row_len : row_len;
+    q->d = 2 * q->r + 1;
+    q->inv = box_inv(q->d);
+    bytes += q->stride * q->cap;
+  }
+  unsigned char *scratch = (unsigned char *)malloc(bytes);
+  unsigned char *tmp = (unsigned char *)malloc(row_len * 2);
+  if (!scratch || !tmp) {
+    free(scratch);
+    free(tmp);
+    return WORKER_FAILED;
+  }
+  unsigned char *at = scratch + sizeof(uint32_t) * row_len * n;
+  for (int i = 0; i < n; i++) {
+    ps[i].sum = (uint32_t *)scratch + row_len * i;
+    ps[i].ring = at;
+    at += ps[i].stride * ps[i].cap;
+  }
+
+  // horizontal passes, row by row; the last one keeps raw window sums that
+  // the first vertical pass divides by the whole 2D window area
+  for (int y = lo; y < hi; y++) {
+    const unsigned char *in = work_src_row(a, y);
+    for (int i = 0; i < n - 1; i++) {
+      unsigned char *out = tmp + (i % 2) * row_len;
+      box_row_h(in, out, a->width, ch, plan->radius[i]);
+      in = out;
+    }
+    uint32_t scale = box_row_h_sum(in, (uint16_t *)pass_row(&ps[0], y, h),
+                                   a->width, ch, plan->radius[n - 1]);
+    if (y == lo) {
+      ps[0].d = (2 * ps[0].r + 1) * scale;
+      ps[0].inv = box_inv(ps[0].d);
+    }
+    box_feed(a, ps, n, 0, y + 1);
+  }
+  free(scratch);
+  free(tmp);
+  return NULL;
+}
+
+/**
+ * Runs a box plan over the image on the shared thread pool
+ *
+ * @param src Source image
+ * @param dst Destination image with the same geometry as src
+ * @param plan Box passes to apply
+ * @param name Operator name in profiling reports
+ * @param num_threads Number of row blocks
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int run_box_plan(const Image *src, Image *dst, const BoxPlan *plan,
+                        const char *name, int num_threads) {
+  WorkArgs base = {.src = src,
+                   .dst = dst,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .ctx = plan,
+                   .name = name};
+  return launch_threads_by_rows(worker_box, base, num_threads);
+}
+
+/**
+ * Blurs an image with a (2 * radius + 1) x (2 * radius + 1) box filter.
+ *
+ * The filter is computed with sliding running sums along rows and then along
+ * columns, so each pixel costs O(1) regardless of the radius. Borders are
+ * clamped and each pixel is rounded once, so the result matches conv_concurrent
+ * with a normalized box kernel of the same size exactly.
+ *
+ * @param src Source image
+ * @param dst Destination image with the same geometry as src
+ * @param radius Box radius in pixels (0 copies the image)
+ * @param num_threads Number of worker threads to use for parallel processing
+ *
+ * @return 0 on success, -1 on failure (invalid radius or allocation failure)
+ */
+int box_blur_concurrent(const Image *src, Image *dst, int radius,
+                        int num_threads) {
+  if (radius < 0)
+    return -1;
+  BoxPlan plan = {.n = 1, .radius = {radius}};
+  return run_box_plan(src, dst, &plan, "box_blur", num_threads);
+}
+
+/**
+ * Chooses the box passes that approximate a Gaussian
+ *
+ * The box widths are chosen so that the variance of the three passes matches
+ * sigma^2 as closely as possible (two sizes wl and wl + 2, the split picked by
+ * the least-squares formula).
+ *
+ * @param sigma Standard deviation of the Gaussian in pixels (must be > 0)
+ * @param plan Box passes to fill
+ *
+ * @return 0 on success, -1 on invalid sigma
+ */
+static int gauss_box_plan(float sigma, BoxPlan *plan) {
+  if (!(sigma > 0.0f))
+    return -1;
+  int n = BOX_GAUSS_PASSES;
+  float var = 12.0f * sigma * sigma;
+  int wl = (int)floorf(sqrtf(var / n + 1.0f));
+  if (wl % 2 == 0)
+    wl--;
+  if (wl < 1)
+    wl = 1;
+  int m = (int)lroundf((var - n * wl * wl - 4 * n * wl - 3 * n) /
+                       (-4.0f * wl - 4.0f));
+  plan->n = n;
+  for (int i = 0; i < n; i++)
+    plan->radius[i] = ((i < m ? wl : wl + 2) - 1) / 2;
+  return 0;
+}
+
+/**
+ * Approximates a Gaussian blur with three successive box filters.
+ *
+ * The box widths come from gauss_box_plan. All passes run in a single
+ * operator call: the horizontal passes are applied row-locally and the
+ * vertical passes stream through small row rings (see worker_box), so the
+ * cost per pixel is constant in sigma and the image is only read and written
+ * once.
+ *
+ * @param src Source image
+ * @param dst Destination image with the same geometry as src
+ * @param sigma Standard deviation of the Gaussian in pixels (must be > 0)
+ * @param num_threads Number of worker threads to use for parallel processing
+ *
+ * @return 0 on success, -1 on failure (invalid sigma or allocation failure)
+ */
+int gaussian_blur_concurrent(const Image *src, Image *dst, float sigma,
+                             int num_threads) {
+  BoxPlan plan;
+  if (gauss_box_plan(sigma, &plan) != 0)
+    return -1;
+  return run_box_plan(src, dst, &plan, "gaussian_blur", num_threads);
+}
+
+/**
+ * Prepares a multi-pass box blur as a pipeline stage
+ *
+ * @param plan Box passes; copied into the stage
+ * @param name Operator name in profiling reports
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param st Stage to fill
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int box_plan_stage(const BoxPlan *plan, const char *name, int width,
+                          int height, int channels, PipelineStage *st) {
+  PipelineStage empty = {0};
+  *st = empty;
+  BoxPlan *copy = (BoxPlan *)malloc(sizeof(BoxPlan));
+  if (!copy)
+    return -1;
+  *copy = *plan;
+  for (int i = 0; i < plan->n; i++)
+    st->halo += plan->radius[i];
+  st->worker = worker_box;
+  st->args.width = st->width = width;
+  st->args.height = st->height = height;
+  st->args.channels = channels;
+  st->args.ctx = copy;
+  st->args.name = name;
+  st->state = copy;
+  return 0;
+}
+
+/**
+ * Prepares box_blur_concurrent as a pipeline stage (halo = radius)
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param radius Box radius in pixels
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on invalid radius or allocation failure
+ */
+int box_blur_stage(int width, int height, int channels, int radius,
+                   PipelineStage *st) {
+  if (radius < 0)
+    return -1;
+  BoxPlan plan = {.n = 1, .radius = {radius}};
+  return box_plan_stage(&plan, "box_blur", width, height, channels, st);
+}
+
+/**
+ * Prepares gaussian_blur_concurrent as a pipeline stage (halo = sum of the
+ * three box radii)
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param sigma Standard deviation of the Gaussian in pixels (must be > 0)
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on invalid sigma or allocation failure
+ */
+int gaussian_blur_stage(int width, int height, int channels, float sigma,
+                        PipelineStage *st) {
+  BoxPlan plan;
+  if (gauss_box_plan(sigma, &plan) != 0)
+    return -1;
+  return box_plan_stage(&plan, "gaussian_blur", width, height, channels, st);
+}
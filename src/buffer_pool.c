@@ -0,0 +1,163 @@
+#include "buffer_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest class; a cached block holds the free-list link in its first bytes
+#define POOL_MIN_BYTES 64
+// Classes per power of two: a block wastes at most a quarter of its size
+#define POOL_SUBCLASSES 4
+#define POOL_CLASSES (POOL_SUBCLASSES * 58 + 1)
+// Cached bytes kept by default; IMAGEMUGGLE_POOL_MB overrides (0 disables
+// caching, blocks are then freed on return)
+#define POOL_DEFAULT_LIMIT_MB 256
+
+/**
+ * Free-list link stored in a cached block
+ */
+typedef struct PoolBlock {
+  struct PoolBlock *next;
+} PoolBlock;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static size_t pool_limit;
+static PoolBlock *pool_free[POOL_CLASSES];
+static BufferPoolStats pool_stats;
+
+static void pool_limit_init(void) {
+  const char *env = getenv("IMAGEMUGGLE_POOL_MB");
+  char *end;
+  long mb = env ? strtol(env, &end, 10) : -1;
+  if (!env || *end != '\0' || mb < 0)
+    mb = POOL_DEFAULT_LIMIT_MB;
+  pool_limit = (size_t)mb << 20;
+}
+
+/**
+ * Maps a request to its size class
+ *
+ * Sizes above POOL_MIN_BYTES are rounded up to a multiple of a quarter of
+ * their power of two (80, 96, 112, 128, 160, ...).
+ *
+ * @param bytes Requested size
+ * @param index Class index
+ * @return Capacity of the class
+ */
+static size_t size_class(size_t bytes, int *index) {
+  if (bytes <= POOL_MIN_BYTES) {
+    *index = 0;
+    return POOL_MIN_BYTES;
+  }
+  size_t b = bytes - 1;
+  int lg = 63 - __builtin_clzll((unsigned long long)b);
+  size_t step = (size_t)1 << (lg - 2);
+  size_t cap = (b / step + 1) * step;
+  *index = (lg - 6) * POOL_SUBCLASSES + (int)(cap >> (lg - 2)) - 4;
+  return cap;
+}
+
+/**
+ * Returns a block of at least the requested size
+ *
+ * A cached block of the same class is reused when available; it is cleared
+ * only if zero is set, so callers that overwrite every byte skip the pass.
+ * New blocks come from calloc or malloc.
+ *
+ * @param bytes Requested size
+ * @param zero Nonzero to get a zero-filled block
+ * @param capacity Receives the usable size of the block (may be NULL)
+ *
+ * @return The block, or NULL on allocation failure
+ *
+ * @note Return the block with buffer_pool_put, not free
+ */
+void *buffer_pool_get(size_t bytes, int zero, size_t *capacity) {
+  int index;
+  size_t cap = size_class(bytes, &index);
+  pthread_mutex_lock(&pool_lock);
+  PoolBlock *block = pool_free[index];
+  if (block) {
+    pool_free[index] = block->next;
+    pool_stats.cached_bytes -= cap;
+    pool_stats.cached_blocks--;
+    pool_stats.hits++;
+  } else {
+    pool_stats.misses++;
+  }
+  pthread_mutex_unlock(&pool_lock);
+  if (!block) {
+    block = (PoolBlock *)(zero ? calloc(cap, 1) : malloc(cap));
+    if (!block)
+      return NULL;
+  } else if (zero) {
+    memset(block, 0, cap);
+  }
+  pthread_mutex_lock(&pool_lock);
+  pool_stats.outstanding_bytes += cap;
+  pool_stats.outstanding_blocks++;
+  if (pool_stats.outstanding_bytes > pool_stats.peak_outstanding_bytes)
+    pool_stats.peak_outstanding_bytes = pool_stats.outstanding_bytes;
+  pthread_mutex_unlock(&pool_lock);
+  if (capacity)
+    *capacity = cap;
+  return block;
+}
+
+/**
+ * Gives a block back to the pool
+ *
+ * The block is cached for reuse while the cached total stays within the limit
+ * (IMAGEMUGGLE_POOL_MB, default POOL_DEFAULT_LIMIT_MB), otherwise freed.
+ *
+ * @param block Block from buffer_pool_get; NULL is ignored
+ * @param bytes Size it was requested with, or its capacity
+ */
+void buffer_pool_put(void *block, size_t bytes) {
+  if (!block)
+    return;
+  pthread_once(&pool_once, pool_limit_init);
+  int index;
+  size_t cap = size_class(bytes, &index);
+  pthread_mutex_lock(&pool_lock);
+  pool_stats.outstanding_bytes -= cap;
+  pool_stats.outstanding_blocks--;
+  int keep = pool_stats.cached_bytes + cap <= pool_limit;
+  if (keep) {
+    PoolBlock *b = (PoolBlock *)block;
+    b->next = pool_free[index];
+    pool_free[index] = b;
+    pool_stats.cached_bytes += cap;
+    pool_stats.cached_blocks++;
+  }
+  pthread_mutex_unlock(&pool_lock);
+  if (!keep)
+    free(block);
+}
+
+/**
+ * Frees every cached block; outstanding blocks are not affected
+ */
+void buffer_pool_trim(void) {
+  pthread_mutex_lock(&pool_lock);
+  for (int i = 0; i < POOL_CLASSES; i++)
+    while (pool_free[i]) {
+      PoolBlock *b = pool_free[i];
+      pool_free[i] = b->next;
+      free(b);
+    }
+  pool_stats.cached_bytes = 0;
+  pool_stats.cached_blocks = 0;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/**
+ * Copies the pool counters
+ *
+ * @param out Receives the counters
+ */
+void buffer_pool_stats(BufferPoolStats *out) {
+  pthread_mutex_lock(&pool_lock);
+  *out = pool_stats;
+  pthread_mutex_unlock(&pool_lock);
+}
@@ -1,6 +1,13 @@
 #include "conv.h"
+#include "conv_simd.h"
+#include "cpu_dispatch.h"
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 /**
  * Clamps an integer value to the valid range for an unsigned char (0-255).
@@ -47,8 +54,8 @@ static inline void clamp_xy(int *xx, int *yy, int w, int h) {
  * on all channels of the image with proper boundary handling via clamping.
  *
  * @param p Pointer to WorkArgs structure containing:
- *          - src: Source image data (3D array: [height][width][channels])
- *          - dst: Destination image data (3D array: [height][width][channels])
+ *          - src: Source image (flat, row stride in bytes)
+ *          - dst: Destination image with the same geometry as src
  *          - kernel: Convolution kernel (1D array of size k*k)
  *          - width: Image width in pixels
  *          - height: Image height in pixels
@@ -68,20 +75,22 @@ static inline void clamp_xy(int *xx, int *yy, int w, int h) {
 static void *worker_conv(void *p) {
   WorkArgs *a = (WorkArgs *)p;
   int r = a->k / 2;
+  int ch = a->channels;
   for (int y = a->y0; y < a->y1; y++) {
+    unsigned char *out = work_dst_row(a, y);
     for (int x = 0; x < a->width; x++) {
-      for (int c = 0; c < a->channels; c++) {
+      for (int c = 0; c < ch; c++) {
         float acc = 0.0f;
         for (int ky = -r; ky <= r; ky++) {
           for (int kx = -r; kx <= r; kx++) {
             int yy = y + ky, xx = x + kx;
             clamp_xy(&xx, &yy, a->width, a->height);
             int ki = (ky + r) * a->k + (kx + r);
-            acc += a->src[yy][xx][c] * a->kernel[ki];
+            acc += work_src_row(a, yy)[xx * ch + c] * a->kernel[ki];
           }
         }
         int val = (int)roundf(acc * a->factor + a->bias);
-        a->dst[y][x][c] = clampi(val);
+        out[x * ch + c] = clampi(val);
       }
     }
   }
@@ -89,19 +98,724 @@ static void *worker_conv(void *p) {
 }
 
 /**
- * Performs concurrent convolution operation on a 3D image array using multiple
+ * Rounds a float to the nearest integer (halves away from zero) and clamps it
+ * to 0-255, like clampi((int)roundf(v))
+ *
+ * roundf is a libm call on the x86-64 baseline; the value is clamped first so
+ * truncation and the exact fraction v - trunc(v) give the same rounding
+ * inline.
+ *
+ * @param v Value to convert
+ * @return Rounded and clamped value
+ */
+static inline unsigned char round_clamp(float v) {
+  if (v <= -1.0f)
+    return 0;
+  if (v >= 256.0f)
+    return 255;
+  int i = (int)v;
+  float frac = v - (float)i;
+  i += (frac >= 0.5f) - (frac <= -0.5f);
+  return clampi(i);
+}
+
+#ifdef CPU_X86
+/**
+ * Converts four float sums to integers exactly like round_clamp
+ *
+ * @param v Values (sum * factor + bias)
+ * @return Rounded values clamped to [-1, 256], so a saturating pack to bytes
+ * completes the clamp
+ */
+__attribute__((target("sse2"))) static inline __m128i
+round_clamp_sse2(__m128 v) {
+  v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(256.0f));
+  __m128i i = _mm_cvttps_epi32(v);
+  __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(i));
+  // comparison masks are -1 where true
+  i = _mm_sub_epi32(i, _mm_castps_si128(
+                           _mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+  return _mm_add_epi32(i, _mm_castps_si128(
+                              _mm_cmple_ps(frac, _mm_set1_ps(-0.5f))));
+}
+
+/**
+ * Computes interior output bytes of a fixed-shape float convolution, 16 at a
+ * time
+ *
+ * Each lane is one output byte: its taps are accumulated in the same order
+ * and with the same single-precision operations as the scalar loop, so the
+ * bytes are identical; the four accumulators only run independent lanes side
+ * by side.
+ *
+ * @param rows The k clamped source rows, shifted left by r pixels
+ * @param kern Kernel (k x k)
+ * @param k Kernel size (constant after inlining)
+ * @param ch Number of interleaved channels (constant after inlining)
+ * @param factor Scaling factor
+ * @param bias Bias added after scaling
+ * @param out Output row
+ * @param j First output byte
+ * @param end End of the interior in bytes
+ * @return First output byte left for the scalar loop
+ */
+__attribute__((target("sse2"))) static inline int
+conv_interior_sse2(const unsigned char *const *rows, const float *kern, int k,
+                   int ch, float factor, float bias, unsigned char *out, int j,
+                   int end) {
+  __m128i zero = _mm_setzero_si128();
+  for (; j + 16 <= end; j += 16) {
+    __m128 acc[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(),
+                     _mm_setzero_ps()};
+    for (int ky = 0; ky < k; ky++) {
+      for (int kx = 0; kx < k; kx++) {
+        __m128i px =
+            _mm_loadu_si128((const __m128i *)(rows[ky] + j + kx * ch));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        __m128 wt = _mm_set1_ps(kern[ky * k + kx]);
+        __m128i q[4] = {_mm_unpacklo_epi16(lo, zero),
+                        _mm_unpackhi_epi16(lo, zero),
+                        _mm_unpacklo_epi16(hi, zero),
+                        _mm_unpackhi_epi16(hi, zero)};
+        for (int i = 0; i < 4; i++)
+          acc[i] = _mm_add_ps(acc[i], _mm_mul_ps(_mm_cvtepi32_ps(q[i]), wt));
+      }
+    }
+    __m128 f = _mm_set1_ps(factor), b = _mm_set1_ps(bias);
+    __m128i v[4];
+    for (int i = 0; i < 4; i++)
+      v[i] = round_clamp_sse2(_mm_add_ps(_mm_mul_ps(acc[i], f), b));
+    __m128i w16 = _mm_packs_epi32(v[0], v[1]);
+    __m128i w16h = _mm_packs_epi32(v[2], v[3]);
+    _mm_storeu_si128((__m128i *)(out + j), _mm_packus_epi16(w16, w16h));
+  }
+  return j;
+}
+#endif
+
+/**
+ * Computes one output row of the float k x k convolution for a fixed shape
+ *
+ * Inlined with constant k and ch by the specialized workers below, so the tap
+ * loops unroll and the kernel stays in registers. The k source rows are
+ * clamped once per output row; interior pixels, whose window lies inside the
+ * row, then read their taps without any bounds check, and only the r pixels
+ * on each side clamp their columns. Taps are accumulated in the same order as
+ * worker_conv, so both produce identical bytes at every instruction set
+ * level.
+ *
+ * @param a Worker arguments (as for worker_conv)
+ * @param y Output row
+ * @param k Kernel size (compile-time constant, at most 7)
+ * @param ch Number of interleaved channels (compile-time constant)
+ * @param simd Nonzero to run the interior 16 bytes at a time with SSE2
+ */
+static inline void conv_row_shape(const WorkArgs *a, int y, int k, int ch,
+                                  int simd) {
+  int r = k / 2, w = a->width;
+  const unsigned char *rows[7];
+  for (int ky = 0; ky < k; ky++) {
+    int yy = y + ky - r;
+    yy = yy < 0 ? 0 : (yy >= a->height ? a->height - 1 : yy);
+    rows[ky] = work_src_row(a, yy);
+  }
+  unsigned char *out = work_dst_row(a, y);
+  const float *kern = a->kernel;
+  float factor = a->factor, bias = a->bias;
+
+  int x0 = r < w ? r : w;           // first interior pixel
+  int x1 = w - r > x0 ? w - r : x0; // first right border pixel
+  int j = x0 * ch;
+#ifdef CPU_X86
+  if (simd) {
+    const unsigned char *left[7]; // tap kx of byte j is left[ky][j + kx * ch]
+    for (int ky = 0; ky < k; ky++)
+      left[ky] = rows[ky] - r * ch;
+    j = conv_interior_sse2(left, kern, k, ch, factor, bias, out, j, x1 * ch);
+  }
+#endif
+  for (; j < x1 * ch; j++) {
+    float acc = 0.0f;
+    for (int ky = 0; ky < k; ky++) {
+      const unsigned char *s = rows[ky] + j - r * ch;
+      for (int kx = 0; kx < k; kx++)
+        acc += s[kx * ch] * kern[ky * k + kx];
+    }
+    out[j] = round_clamp(acc * factor + bias);
+  }
+  for (int x = 0; x < w; x++) {
+    if (x == x0)
+      x = x1; // skip the interior handled above
+    if (x >= w)
+      break;
+    for (int c = 0; c < ch; c++) {
+      float acc = 0.0f;
+      for (int ky = 0; ky < k; ky++) {
+        for (int kx = 0; kx < k; kx++) {
+          int xx = x + kx - r;
+          xx = xx < 0 ? 0 : (xx >= w ? w - 1 : xx);
+          acc += rows[ky][xx * ch + c] * kern[ky * k + kx];
+        }
+      }
+      out[x * ch + c] = round_clamp(acc * factor + bias);
+    }
+  }
+}
+
+// Defines worker_conv_k<K>c<CH>, worker_conv for one kernel size and channel
+// count
+#define CONV_WORKER_SHAPE(K, CH)                                               \
+  static void *worker_conv_k##K##c##CH(void *p) {                              \
+    WorkArgs *a = (WorkArgs *)p;                                               \
+    int simd = cpu_isa() >= CPU_ISA_SSE2;                                      \
+    for (int y = a->y0; y < a->y1; y++)                                        \
+      conv_row_shape(a, y, K, CH, simd);                                       \
+    return NULL;                                                               \
+  }
+
+CONV_WORKER_SHAPE(3, 1)
+CONV_WORKER_SHAPE(3, 3)
+CONV_WORKER_SHAPE(3, 4)
+CONV_WORKER_SHAPE(5, 1)
+CONV_WORKER_SHAPE(5, 3)
+CONV_WORKER_SHAPE(5, 4)
+CONV_WORKER_SHAPE(7, 1)
+CONV_WORKER_SHAPE(7, 3)
+CONV_WORKER_SHAPE(7, 4)
+
+/**
+ * Picks the float k x k worker for a kernel size and channel count
+ *
+ * @param k Kernel size
+ * @param ch Number of interleaved channels
+ * @return Specialized worker for k in {3, 5, 7} and ch in {1, 3, 4},
+ * worker_conv otherwise
+ */
+static void *(*conv_worker(int k, int ch))(void *) {
+  static void *(*const shaped[3][3])(void *) = {
+      {worker_conv_k3c1, worker_conv_k3c3, worker_conv_k3c4},
+      {worker_conv_k5c1, worker_conv_k5c3, worker_conv_k5c4},
+      {worker_conv_k7c1, worker_conv_k7c3, worker_conv_k7c4}};
+  int ci = ch == 1 ? 0 : (ch == 3 ? 1 : (ch == 4 ? 2 : -1));
+  if ((k != 3 && k != 5 && k != 7) || ci < 0)
+    return worker_conv;
+  return shaped[k / 2 - 1][ci];
+}
+
+/**
+ * Computes the horizontal pass of a separable convolution for one source row
+ *
+ * @param src Source row (width * ch bytes)
+ * @param out Output row of width * ch floats
+ * @param width Row width in pixels
+ * @param ch Number of interleaved channels
+ * @param taps Horizontal kernel (k entries)
+ * @param k Kernel size (odd)
+ */
+static void conv_row_h(const unsigned char *src, float *out, int width, int ch,
+                       const float *taps, int k) {
+  int r = k / 2;
+  for (int x = 0; x < width; x++) {
+    for (int c = 0; c < ch; c++) {
+      float acc = 0.0f;
+      for (int kx = -r; kx <= r; kx++) {
+        int xx = x + kx;
+        if (xx < 0)
+          xx = 0;
+        if (xx >= width)
+          xx = width - 1;
+        acc += src[xx * ch + c] * taps[kx + r];
+      }
+      out[x * ch + c] = acc;
+    }
+  }
+}
+
+/**
+ * Worker thread function for separable 2D convolution.
+ *
+ * The kernel is the outer product of a vertical and a horizontal 1D kernel, so
+ * every output pixel costs 2k taps instead of k*k. Each worker keeps a ring of
+ * k horizontally filtered rows (one slot per source row, indexed modulo k):
+ * every source row in [y0 - r, y1 + r) is filtered once, and each output row
+ * is the vertical combination of the k ring rows around it.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src, dst, width, height, channels: as for worker_conv
+ *          - kernel: Horizontal 1D kernel (k entries)
+ *          - kernel_y: Vertical 1D kernel (k entries)
+ *          - k, factor, bias, y0, y1: as for worker_conv
+ *
+ * @return NULL on success, WORKER_FAILED if the ring buffer could not be
+ * allocated
+ *
+ * @note Borders are clamped exactly like worker_conv, so both paths produce
+ *       the same image up to float rounding.
+ */
+static void *worker_conv_separable(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  int k = a->k, r = k / 2;
+  int ch = a->channels;
+  size_t row_len = (size_t)a->width * ch;
+  float *ring = (float *)malloc(sizeof(float) * row_len * k);
+  if (!ring)
+    return WORKER_FAILED;
+
+  int next = a->y0 - r < 0 ? 0 : a->y0 - r; // next source row to filter
+  for (int y = a->y0; y < a->y1; y++) {
+    int last = y + r < a->height ? y + r : a->height - 1;
+    for (; next <= last; next++)
+      conv_row_h(work_src_row(a, next), ring + (size_t)(next % k) * row_len,
+                 a->width, ch, a->kernel, k);
+
+    unsigned char *out = work_dst_row(a, y);
+    for (size_t i = 0; i < row_len; i++) {
+      float acc = 0.0f;
+      for (int ky = -r; ky <= r; ky++) {
+        int yy = y + ky;
+        if (yy < 0)
+          yy = 0;
+        if (yy >= a->height)
+          yy = a->height - 1;
+        acc += ring[(size_t)(yy % k) * row_len + i] * a->kernel_y[ky + r];
+      }
+      out[i] = clampi((int)roundf(acc * a->factor + a->bias));
+    }
+  }
+  free(ring);
+  return NULL;
+}
+
+/**
+ * Splits a k x k kernel into a vertical and a horizontal 1D kernel if it has
+ * rank one
+ *
+ * The largest-magnitude entry K[pr][pc] is used as pivot: the vertical kernel
+ * is column pc and the horizontal kernel is row pr divided by the pivot. The
+ * kernel is separable when every entry matches the outer product within a
+ * small relative tolerance.
+ *
+ * @param kernel Kernel matrix (k x k, row-major)
+ * @param k Kernel size
+ * @param kh Output horizontal kernel (k entries)
+ * @param kv Output vertical kernel (k entries)
+ *
+ * @return 1 if the kernel is separable (kh and kv are filled), 0 otherwise
+ */
+static int split_separable(const float *kernel, int k, float *kh, float *kv) {
+  int pr = 0, pc = 0;
+  float max = 0.0f;
+  for (int i = 0; i < k * k; i++) {
+    if (fabsf(kernel[i]) > max) {
+      max = fabsf(kernel[i]);
+      pr = i / k;
+      pc = i % k;
+    }
+  }
+  if (max == 0.0f)
+    return 0;
+  float pivot = kernel[pr * k + pc];
+  for (int i = 0; i < k; i++) {
+    kv[i] = kernel[i * k + pc];
+    kh[i] = kernel[pr * k + i] / pivot;
+  }
+  float tol = max * 1e-5f;
+  for (int i = 0; i < k; i++)
+    for (int j = 0; j < k; j++)
+      if (fabsf(kernel[i * k + j] - kv[i] * kh[j]) > tol)
+        return 0;
+  return 1;
+}
+
+/**
+ * Taps of a fixed-point convolution pass
+ *
+ * Weights are stored in 16-bit fixed point so the SIMD row kernels can
+ * multiply-accumulate pixel pairs into exact 32-bit sums; the result of a
+ * pass is (add + sum w[t] * px[t]) >> shift.
+ */
+typedef struct {
+  int16_t *w;  // taps, padded with a zero weight to an even count
+  int n;       // padded tap count
+  int shift;   // fractional bits dropped from the accumulator
+  int32_t add; // bias and rounding half in accumulator units
+} FixedTaps;
+
+/**
+ * Quantizes float taps to 16-bit fixed point
+ *
+ * Picks the largest number of fractional bits (at most 14) such that every
+ * tap fits in int16 and sum |w| * in_max stays below 2^30, leaving headroom
+ * for the bias in a 32-bit accumulator.
+ *
+ * @param taps Float taps
+ * @param n Number of taps
+ * @param in_max Largest input magnitude the taps will be applied to
+ * @param q Output fixed-point taps (n entries, plus one zero if n is odd)
+ * @param err Output quantization error per unit input, sum |taps - q / 2^f|
+ *
+ * @return Number of fractional bits, or -1 if the taps cannot be represented
+ */
+static int quantize_taps(const float *taps, int n, float in_max, int16_t *q,
+                         float *err) {
+  float max = 0.0f, sum = 0.0f;
+  for (int i = 0; i < n; i++) {
+    max = fmaxf(max, fabsf(taps[i]));
+    sum += fabsf(taps[i]);
+  }
+  int frac = 14;
+  while (frac > 0 && (max * (1 << frac) > 32767.0f ||
+                      sum * in_max * (1 << frac) > 1073741824.0f))
+    frac--;
+  if (frac <= 0 || max == 0.0f)
+    return -1;
+  *err = 0.0f;
+  for (int i = 0; i < n; i++) {
+    q[i] = (int16_t)lrintf(taps[i] * (1 << frac));
+    *err += fabsf(taps[i] - (float)q[i] / (1 << frac));
+  }
+  if (n % 2)
+    q[n] = 0;
+  return frac;
+}
+
+/**
+ * Builds the fixed-point taps of a k x k convolution
+ *
+ * The factor is folded into the weights and the bias into the accumulator
+ * offset. The taps are only accepted when the worst-case quantization error
+ * stays below half a level, so the result matches the float path within
+ * +-1 LSB.
+ *
+ * @param kernel Kernel matrix (k x k)
+ * @param k Kernel size
+ * @param factor Scaling factor applied to the convolution result
+ * @param bias Bias added after scaling
+ * @param ft Output taps; ft->w must hold k * k + 1 entries
+ *
+ * @return 1 if the fixed-point path can be used, 0 otherwise
+ */
+static int build_fixed_2d(const float *kernel, int k, float factor, float bias,
+                          FixedTaps *ft) {
+  int n = k * k;
+  float *taps = (float *)malloc(sizeof(float) * n);
+  if (!taps)
+    return 0;
+  for (int i = 0; i < n; i++)
+    taps[i] = kernel[i] * factor;
+  float err;
+  int frac = quantize_taps(taps, n, 255.0f, ft->w, &err);
+  free(taps);
+  if (frac < 0 || fabsf(bias) * (1 << frac) > 1073741824.0f)
+    return 0;
+  if (err * 255.0f + 0.5f / (1 << frac) > 0.5f)
+    return 0;
+  ft->n = n + n % 2;
+  ft->shift = frac;
+  ft->add = (int32_t)lrintf(bias * (1 << frac)) + (1 << (frac - 1));
+  return 1;
+}
+
+/**
+ * Builds the fixed-point taps of a separable convolution
+ *
+ * The horizontal kernel is normalized to unit absolute sum (its scale moves
+ * into the vertical kernel together with the factor) so the horizontal pass
+ * fits a signed 16-bit intermediate with m fractional bits. The vertical pass
+ * removes both the weight and the intermediate fraction. As for the 2D path,
+ * the taps are rejected if the accumulated error could exceed half a level.
+ *
+ * @param kh Horizontal kernel (k entries)
+ * @param kv Vertical kernel (k entries)
+ * @param k Kernel size
+ * @param factor Scaling factor applied to the convolution result
+ * @param bias Bias added after scaling
+ * @param fh Output horizontal taps; fh->w must hold k + 1 entries
+ * @param fv Output vertical taps; fv->w must hold k + 1 entries
+ *
+ * @return 1 if the fixed-point path can be used, 0 otherwise
+ */
+static int build_fixed_separable(const float *kh, const float *kv, int k,
+                                 float factor, float bias, FixedTaps *fh,
+                                 FixedTaps *fv) {
+  float sum_h = 0.0f, sum_v = 0.0f;
+  for (int i = 0; i < k; i++)
+    sum_h += fabsf(kh[i]);
+  if (sum_h == 0.0f || k > 64)
+    return 0;
+  float h[64], v[64];
+  for (int i = 0; i < k; i++) {
+    h[i] = kh[i] / sum_h;
+    v[i] = kv[i] * sum_h * factor;
+    sum_v += fabsf(v[i]);
+  }
+  float err_h, err_v;
+  int frac_h = quantize_taps(h, k, 255.0f, fh->w, &err_h);
+  if (frac_h < 0)
+    return 0;
+  // intermediate fraction m: 255 * sum|qh| >> (frac_h - m) must fit in int16
+  long sum_qh = 0;
+  for (int i = 0; i < k; i++)
+    sum_qh += labs((long)fh->w[i]);
+  int m = frac_h - 1 < 7 ? frac_h - 1 : 7;
+  while (m > 0 && ((255L * sum_qh) >> (frac_h - m)) > 32767)
+    m--;
+  if (m <= 0)
+    return 0;
+  int frac_v = quantize_taps(v, k, 32767.0f, fv->w, &err_v);
+  if (frac_v < 0 || frac_v + m > 30 ||
+      fabsf(bias) * (float)(1L << (frac_v + m)) > 1073741824.0f)
+    return 0;
+  float err = (err_h * 255.0f + 0.5f / (1 << m)) * sum_v + err_v * 255.0f +
+              0.5f / (float)(1L << (frac_v + m));
+  if (err > 0.5f)
+    return 0;
+  fh->n = fv->n = k + k % 2;
+  fh->shift = frac_h - m;
+  fh->add = 1 << (fh->shift - 1);
+  fv->shift = frac_v + m;
+  fv->add = (int32_t)lrintf(bias * (float)(1L << fv->shift)) +
+            (1 << (fv->shift - 1));
+  return 1;
+}
+
+/**
+ * Computes one border pixel of a fixed-point k x k convolution
+ *
+ * @param rows The k clamped source rows around the output row
+ * @param ft Fixed-point taps (row-major, k * k meaningful entries)
+ * @param k Kernel size
+ * @param x Output column
+ * @param width Row width in pixels
+ * @param ch Number of interleaved channels
+ * @param out Output row
+ */
+static void conv_fx_pixel(const unsigned char *const *rows,
+                          const FixedTaps *ft, int k, int x, int width, int ch,
+                          unsigned char *out) {
+  int r = k / 2;
+  for (int c = 0; c < ch; c++) {
+    int32_t acc = ft->add;
+    for (int ky = 0; ky < k; ky++) {
+      for (int kx = 0; kx < k; kx++) {
+        int xx = x + kx - r;
+        if (xx < 0)
+          xx = 0;
+        if (xx >= width)
+          xx = width - 1;
+        acc += ft->w[ky * k + kx] * rows[ky][xx * ch + c];
+      }
+    }
+    out[x * ch + c] = clampi(acc >> ft->shift);
+  }
+}
+
+/**
+ * Worker thread function for fixed-point k x k convolution.
+ *
+ * Interior pixels (whose whole window lies inside the row) are handled by the
+ * SIMD row kernel: with interleaved channels, tap (ky, kx) of output byte j is
+ * simply byte j + kx * channels of source row ky, so whole rows are processed
+ * 16-32 bytes at a time regardless of the channel count. The r border columns
+ * on each side are computed per pixel with clamped coordinates.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src, dst, width, height, channels, k, y0, y1: as for worker_conv
+ *          - ctx: FixedTaps with the k * k quantized weights
+ *
+ * @return NULL on success, WORKER_FAILED if scratch allocation fails
+ */
+static void *worker_conv_fx(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const FixedTaps *ft = (const FixedTaps *)a->ctx;
+  int k = a->k, r = k / 2;
+  int ch = a->channels, w = a->width;
+  const unsigned char **rows =
+      (const unsigned char **)malloc(sizeof(*rows) * (k + ft->n));
+  if (!rows)
+    return WORKER_FAILED;
+  const unsigned char **taps = rows + k;
+  int inner = w - 2 * r;
+  for (int y = a->y0; y < a->y1; y++) {
+    for (int ky = 0; ky < k; ky++) {
+      int yy = y + ky - r;
+      yy = yy < 0 ? 0 : (yy >= a->height ? a->height - 1 : yy);
+      rows[ky] = work_src_row(a, yy);
+    }
+    unsigned char *out = work_dst_row(a, y);
+    if (inner > 0) {
+      for (int t = 0; t < k * k; t++)
+        taps[t] = rows[t / k] + (t % k) * ch;
+      if (ft->n > k * k)
+        taps[k * k] = taps[0];
+      convfx_u8_u8(taps, ft->w, ft->n, ft->add, ft->shift, out + r * ch,
+                   inner * ch);
+    }
+    for (int x = 0; x < w && x < r; x++)
+      conv_fx_pixel(rows, ft, k, x, w, ch, out);
+    for (int x = w - r > r ? w - r : r; x < w; x++)
+      conv_fx_pixel(rows, ft, k, x, w, ch, out);
+  }
+  free(rows);
+  return NULL;
+}
+
+/**
+ * Computes the fixed-point horizontal pass for one source row
+ *
+ * @param src Source row
+ * @param out Output row of 16-bit intermediates (width * ch entries)
+ * @param width Row width in pixels
+ * @param ch Number of interleaved channels
+ * @param fh Horizontal fixed-point taps
+ * @param k Kernel size
+ * @param taps Scratch for fh->n tap pointers
+ */
+static void conv_fx_row_h(const unsigned char *src, int16_t *out, int width,
+                          int ch, const FixedTaps *fh, int k,
+                          const unsigned char **taps) {
+  int r = k / 2;
+  int inner = width - 2 * r;
+  if (inner > 0) {
+    for (int t = 0; t < k; t++)
+      taps[t] = src + t * ch;
+    if (fh->n > k)
+      taps[k] = taps[0];
+    convfx_u8_s16(taps, fh->w, fh->n, fh->add, fh->shift, out + r * ch,
+                  inner * ch);
+  }
+  for (int x = 0; x < width; x++) {
+    if (x == r && inner > 0)
+      x = width - r; // skip the interior handled above
+    for (int c = 0; c < ch; c++) {
+      int32_t acc = fh->add;
+      for (int kx = 0; kx < k; kx++) {
+        int xx = x + kx - r;
+        xx = xx < 0 ? 0 : (xx >= width ? width - 1 : xx);
+        acc += fh->w[kx] * src[xx * ch + c];
+      }
+      acc >>= fh->shift;
+      out[x * ch + c] =
+          (int16_t)(acc < -32768 ? -32768 : (acc > 32767 ? 32767 : acc));
+    }
+  }
+}
+
+/**
+ * Worker thread function for fixed-point separable convolution.
+ *
+ * Same ring-buffer structure as worker_conv_separable, with 16-bit fixed-point
+ * intermediate rows: the horizontal pass runs through the u8 -> s16 SIMD row
+ * kernel and the vertical pass combines k ring rows with the s16 -> u8 kernel.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src, dst, width, height, channels, k, y0, y1: as for worker_conv
+ *          - ctx: Two FixedTaps, horizontal then vertical
+ *
+ * @return NULL on success, WORKER_FAILED if scratch allocation fails
+ */
+static void *worker_conv_separable_fx(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const FixedTaps *fh = (const FixedTaps *)a->ctx, *fv = fh + 1;
+  int k = a->k, r = k / 2;
+  size_t row_len = (size_t)a->width * a->channels;
+  int16_t *ring = (int16_t *)malloc(sizeof(int16_t) * row_len * k);
+  const void **taps = (const void **)malloc(sizeof(void *) * (k + 1));
+  if (!ring || !taps) {
+    free(ring);
+    free(taps);
+    return WORKER_FAILED;
+  }
+
+  int next = a->y0 - r < 0 ? 0 : a->y0 - r; // next source row to filter
+  for (int y = a->y0; y < a->y1; y++) {
+    int last = y + r < a->height ? y + r : a->height - 1;
+    for (; next <= last; next++)
+      conv_fx_row_h(work_src_row(a, next),
+                    ring + (size_t)(next % k) * row_len, a->width,
+                    a->channels, fh, k, (const unsigned char **)taps);
+
+    for (int ky = 0; ky < k; ky++) {
+      int yy = y + ky - r;
+      yy = yy < 0 ? 0 : (yy >= a->height ? a->height - 1 : yy);
+      taps[ky] = ring + (size_t)(yy % k) * row_len;
+    }
+    if (fv->n > k)
+      taps[k] = taps[0];
+    convfx_s16_u8((const int16_t *const *)taps, fv->w, fv->n, fv->add,
+                  fv->shift, work_dst_row(a, y), (int)row_len);
+  }
+  free(taps);
+  free(ring);
+  return NULL;
+}
+
+/**
+ * Performs a separable convolution given its two 1D kernels.
+ *
+ * Equivalent to conv_concurrent with the k x k kernel kv[i] * kh[j], but runs
+ * a horizontal pass followed by a vertical pass through a per-worker ring of
+ * k intermediate rows, which costs O(2k) instead of O(k^2) per pixel. The
+ * passes run in 16-bit fixed point on the SIMD row kernels whenever the
+ * quantized taps reproduce the float result within +-1 LSB.
+ *
+ * @param src        Source image
+ * @param dst        Destination image with the same geometry as src
+ * @param kh         Horizontal kernel (k entries)
+ * @param kv         Vertical kernel (k entries)
+ * @param k          Kernel size (odd)
+ * @param factor     Scaling factor applied to convolution result
+ * @param bias       Bias value added to convolution result after scaling
+ * @param num_threads Number of worker threads to use for parallel processing
+ *
+ * @return 0 on success, -1 on failure (thread pool or scratch allocation)
+ */
+int conv_separable_concurrent(const Image *src, Image *dst, const float *kh,
+                              const float *kv, int k, float factor, float bias,
+                              int num_threads) {
+  WorkArgs base = {.src = src,
+                   .dst = dst,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .kernel = kh,
+                   .kernel_y = kv,
+                   .k = k,
+                   .factor = factor,
+                   .bias = bias,
+                   .name = "conv_separable"};
+  int16_t *w = (int16_t *)malloc(sizeof(int16_t) * 2 * (k + 1));
+  FixedTaps fixed[2] = {{.w = w}, {.w = w + k + 1}};
+  if (w && build_fixed_separable(kh, kv, k, factor, bias, &fixed[0],
+                                 &fixed[1])) {
+    base.ctx = fixed;
+    int rc = launch_threads_by_rows(worker_conv_separable_fx, base,
+                                    num_threads);
+    free(w);
+    return rc;
+  }
+  free(w);
+  return launch_threads_by_rows(worker_conv_separable, base, num_threads);
+}
+
+/**
+ * Performs concurrent convolution operation on an image using multiple
  * threads.
  *
  * This function applies a convolution kernel to the source image and stores the
  * result in the destination array. The operation is parallelized across
  * multiple threads by distributing work by rows to improve performance on
- * multi-core systems.
+ * multi-core systems. Rank-1 kernels (box, Gaussian, ...) are detected and
+ * run through the separable two-pass path; other kernels use SIMD 16-bit
+ * fixed-point row kernels when the quantized weights reproduce the float
+ * result within +-1 LSB, and the float path otherwise. The float path has
+ * variants specialized for k = 3, 5, 7 and 1, 3 or 4 channels, with generic
+ * worker_conv as the fallback.
  *
- * @param src        Source 3D image array (height x width x channels)
- * @param dst        Destination 3D image array to store convolution result
- * @param width      Width of the image in pixels
- * @param height     Height of the image in pixels
- * @param channels   Number of color channels in the image
+ * @param src        Source image (its width, height and channels define the
+ *                   geometry of the operation)
+ * @param dst        Destination image with the same geometry as src
  * @param kernel     Convolution kernel matrix (k x k)
  * @param k          Size of the convolution kernel (kernel is k x k)
  * @param factor     Scaling factor applied to convolution result
@@ -110,17 +824,69 @@ static void *worker_conv(void *p) {
  *
  * @return           Status code indicating success or failure of the operation
  */
-int conv_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                    int height, int channels, const float *kernel, int k,
+int conv_concurrent(const Image *src, Image *dst, const float *kernel, int k,
                     float factor, float bias, int num_threads) {
+  if (k >= 3) {
+    float *taps = (float *)malloc(sizeof(float) * 2 * k);
+    if (taps && split_separable(kernel, k, taps, taps + k)) {
+      int rc = conv_separable_concurrent(src, dst, taps, taps + k, k, factor,
+                                         bias, num_threads);
+      free(taps);
+      return rc;
+    }
+    free(taps);
+  }
+  WorkArgs base = {.src = src,
+                   .dst = dst,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .kernel = kernel,
+                   .k = k,
+                   .factor = factor,
+                   .bias = bias,
+                   .name = "conv"};
+  FixedTaps fixed = {.w = (int16_t *)malloc(sizeof(int16_t) * (k * k + 1))};
+  if (fixed.w && build_fixed_2d(kernel, k, factor, bias, &fixed)) {
+    base.ctx = &fixed;
+    int rc = launch_threads_by_rows(worker_conv_fx, base, num_threads);
+    free(fixed.w);
+    return rc;
+  }
+  free(fixed.w);
+  return launch_threads_by_rows(conv_worker(k, src->channels), base,
+                                num_threads);
+}
+
+/**
+ * Performs the float reference convolution.
+ *
+ * Same contract as conv_concurrent but always runs the generic k x k float
+ * path (one tap at a time, roundf and clamp per channel). The fixed-point and
+ * separable fast paths are validated against it.
+ *
+ * @param src        Source image
+ * @param dst        Destination image with the same geometry as src
+ * @param kernel     Convolution kernel matrix (k x k)
+ * @param k          Size of the convolution kernel (kernel is k x k)
+ * @param factor     Scaling factor applied to convolution result
+ * @param bias       Bias value added to convolution result after scaling
+ * @param num_threads Number of worker threads to use for parallel processing
+ *
+ * @return 0 on success, -1 on failure
+ */
+int conv_reference_concurrent(const Image *src, Image *dst,
+                              const float *kernel, int k, float factor,
+                              float bias, int num_threads) {
   WorkArgs base = {.src = src,
                    .dst = dst,
-                   .width = width,
-                   .height = height,
-                   .channels = channels,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
                    .kernel = kernel,
                    .k = k,
                    .factor = factor,
-                   .bias = bias};
+                   .bias = bias,
+                   .name = "conv_reference"};
   return launch_threads_by_rows(worker_conv, base, num_threads);
 }
@@ -0,0 +1,549 @@
+#include "conv_simd.h"
+#include "cpu_dispatch.h"
+#include <pthread.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*U8U8Fn)(const unsigned char *const *, const int16_t *, int,
+                       int32_t, int, unsigned char *, int);
+typedef void (*U8S16Fn)(const unsigned char *const *, const int16_t *, int,
+                        int32_t, int, int16_t *, int);
+typedef void (*S16U8Fn)(const int16_t *const *, const int16_t *, int, int32_t,
+                        int, unsigned char *, int);
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static U8U8Fn impl_u8_u8;
+static U8S16Fn impl_u8_s16;
+static S16U8Fn impl_s16_u8;
+static const char *impl_name = "scalar";
+
+/**
+ * Saturates a 32-bit value to the unsigned 8-bit range
+ *
+ * @param v Value to saturate
+ * @return v clamped to [0, 255]
+ */
+static inline unsigned char sat_u8(int32_t v) {
+  return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/**
+ * Saturates a 32-bit value to the signed 16-bit range
+ *
+ * @param v Value to saturate
+ * @return v clamped to [-32768, 32767]
+ */
+static inline int16_t sat_s16(int32_t v) {
+  return (int16_t)(v < -32768 ? -32768 : (v > 32767 ? 32767 : v));
+}
+
+// ------- Scalar reference (also used for the tails of the SIMD loops) -------
+
+static void u8_u8_scalar(const unsigned char *const *src, const int16_t *w,
+                         int ntaps, int32_t add, int shift, unsigned char *dst,
+                         int len) {
+  for (int j = 0; j < len; j++) {
+    int32_t acc = add;
+    for (int t = 0; t < ntaps; t++)
+      acc += w[t] * src[t][j];
+    dst[j] = sat_u8(acc >> shift);
+  }
+}
+
+static void u8_s16_scalar(const unsigned char *const *src, const int16_t *w,
+                          int ntaps, int32_t add, int shift, int16_t *dst,
+                          int len) {
+  for (int j = 0; j < len; j++) {
+    int32_t acc = add;
+    for (int t = 0; t < ntaps; t++)
+      acc += w[t] * src[t][j];
+    dst[j] = sat_s16(acc >> shift);
+  }
+}
+
+static void s16_u8_scalar(const int16_t *const *src, const int16_t *w,
+                          int ntaps, int32_t add, int shift, unsigned char *dst,
+                          int len) {
+  for (int j = 0; j < len; j++) {
+    int32_t acc = add;
+    for (int t = 0; t < ntaps; t++)
+      acc += w[t] * src[t][j];
+    dst[j] = sat_u8(acc >> shift);
+  }
+}
+
+#ifdef CPU_X86
+/**
+ * Packs two adjacent 16-bit weights into one 32-bit lane for pmaddwd
+ *
+ * @param w Weight array
+ * @param t Index of the first weight of the pair
+ * @return w[t] in the low half and w[t + 1] in the high half
+ */
+static inline int weight_pair(const int16_t *w, int t) {
+  return (int)((uint32_t)(uint16_t)w[t] | ((uint32_t)(uint16_t)w[t + 1] << 16));
+}
+
+// ------- SSE2: 16 output bytes per iteration -------
+
+/*
+ * Taps are consumed in pairs: the 16-bit pixels of both taps are interleaved
+ * and multiplied by the interleaved weight pair with pmaddwd, which yields
+ * 32-bit partial sums p * w[t] + q * w[t + 1] without overflow.
+ */
+__attribute__((target("sse2"))) static void
+u8_u8_sse2(const unsigned char *const *src, const int16_t *w, int ntaps,
+           int32_t add, int shift, unsigned char *dst, int len) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i vadd = _mm_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 16 <= len; j += 16) {
+    __m128i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m128i wp = _mm_set1_epi32(weight_pair(w, t));
+      __m128i p = _mm_loadu_si128((const __m128i *)(src[t] + j));
+      __m128i q = _mm_loadu_si128((const __m128i *)(src[t + 1] + j));
+      __m128i plo = _mm_unpacklo_epi8(p, zero);
+      __m128i phi = _mm_unpackhi_epi8(p, zero);
+      __m128i qlo = _mm_unpacklo_epi8(q, zero);
+      __m128i qhi = _mm_unpackhi_epi8(q, zero);
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(phi, qhi), wp));
+    }
+    __m128i lo = _mm_packs_epi32(_mm_sra_epi32(a0, vshift),
+                                 _mm_sra_epi32(a1, vshift));
+    __m128i hi = _mm_packs_epi32(_mm_sra_epi32(a2, vshift),
+                                 _mm_sra_epi32(a3, vshift));
+    _mm_storeu_si128((__m128i *)(dst + j), _mm_packus_epi16(lo, hi));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_u8_scalar(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("sse2"))) static void
+u8_s16_sse2(const unsigned char *const *src, const int16_t *w, int ntaps,
+            int32_t add, int shift, int16_t *dst, int len) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i vadd = _mm_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 16 <= len; j += 16) {
+    __m128i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m128i wp = _mm_set1_epi32(weight_pair(w, t));
+      __m128i p = _mm_loadu_si128((const __m128i *)(src[t] + j));
+      __m128i q = _mm_loadu_si128((const __m128i *)(src[t + 1] + j));
+      __m128i plo = _mm_unpacklo_epi8(p, zero);
+      __m128i phi = _mm_unpackhi_epi8(p, zero);
+      __m128i qlo = _mm_unpacklo_epi8(q, zero);
+      __m128i qhi = _mm_unpackhi_epi8(q, zero);
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(phi, qhi), wp));
+    }
+    _mm_storeu_si128((__m128i *)(dst + j),
+                     _mm_packs_epi32(_mm_sra_epi32(a0, vshift),
+                                     _mm_sra_epi32(a1, vshift)));
+    _mm_storeu_si128((__m128i *)(dst + j + 8),
+                     _mm_packs_epi32(_mm_sra_epi32(a2, vshift),
+                                     _mm_sra_epi32(a3, vshift)));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_s16_scalar(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("sse2"))) static void
+s16_u8_sse2(const int16_t *const *src, const int16_t *w, int ntaps,
+            int32_t add, int shift, unsigned char *dst, int len) {
+  const __m128i vadd = _mm_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 16 <= len; j += 16) {
+    __m128i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m128i wp = _mm_set1_epi32(weight_pair(w, t));
+      __m128i p0 = _mm_loadu_si128((const __m128i *)(src[t] + j));
+      __m128i p1 = _mm_loadu_si128((const __m128i *)(src[t] + j + 8));
+      __m128i q0 = _mm_loadu_si128((const __m128i *)(src[t + 1] + j));
+      __m128i q1 = _mm_loadu_si128((const __m128i *)(src[t + 1] + j + 8));
+      a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(p0, q0), wp));
+      a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(p0, q0), wp));
+      a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(p1, q1), wp));
+      a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(p1, q1), wp));
+    }
+    __m128i lo = _mm_packs_epi32(_mm_sra_epi32(a0, vshift),
+                                 _mm_sra_epi32(a1, vshift));
+    __m128i hi = _mm_packs_epi32(_mm_sra_epi32(a2, vshift),
+                                 _mm_sra_epi32(a3, vshift));
+    _mm_storeu_si128((__m128i *)(dst + j), _mm_packus_epi16(lo, hi));
+  }
+  if (j < len) {
+    const int16_t *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    s16_u8_scalar(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+// ------- AVX2: 32 output bytes per iteration -------
+
+/*
+ * Same scheme as SSE2 on 256-bit registers. Unpacks and packs work inside
+ * 128-bit lanes, so an in-lane unpack followed by an in-lane pack restores the
+ * original order; only results that change element width between load and
+ * store need a cross-lane permute.
+ */
+__attribute__((target("avx2"))) static void
+u8_u8_avx2(const unsigned char *const *src, const int16_t *w, int ntaps,
+           int32_t add, int shift, unsigned char *dst, int len) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i vadd = _mm256_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 32 <= len; j += 32) {
+    __m256i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m256i wp = _mm256_set1_epi32(weight_pair(w, t));
+      __m256i p = _mm256_loadu_si256((const __m256i *)(src[t] + j));
+      __m256i q = _mm256_loadu_si256((const __m256i *)(src[t + 1] + j));
+      __m256i plo = _mm256_unpacklo_epi8(p, zero);
+      __m256i phi = _mm256_unpackhi_epi8(p, zero);
+      __m256i qlo = _mm256_unpacklo_epi8(q, zero);
+      __m256i qhi = _mm256_unpackhi_epi8(q, zero);
+      a0 = _mm256_add_epi32(
+          a0, _mm256_madd_epi16(_mm256_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm256_add_epi32(
+          a1, _mm256_madd_epi16(_mm256_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm256_add_epi32(
+          a2, _mm256_madd_epi16(_mm256_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm256_add_epi32(
+          a3, _mm256_madd_epi16(_mm256_unpackhi_epi16(phi, qhi), wp));
+    }
+    __m256i lo = _mm256_packs_epi32(_mm256_sra_epi32(a0, vshift),
+                                    _mm256_sra_epi32(a1, vshift));
+    __m256i hi = _mm256_packs_epi32(_mm256_sra_epi32(a2, vshift),
+                                    _mm256_sra_epi32(a3, vshift));
+    _mm256_storeu_si256((__m256i *)(dst + j), _mm256_packus_epi16(lo, hi));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_u8_sse2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("avx2"))) static void
+u8_s16_avx2(const unsigned char *const *src, const int16_t *w, int ntaps,
+            int32_t add, int shift, int16_t *dst, int len) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i vadd = _mm256_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 32 <= len; j += 32) {
+    __m256i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m256i wp = _mm256_set1_epi32(weight_pair(w, t));
+      __m256i p = _mm256_loadu_si256((const __m256i *)(src[t] + j));
+      __m256i q = _mm256_loadu_si256((const __m256i *)(src[t + 1] + j));
+      __m256i plo = _mm256_unpacklo_epi8(p, zero);
+      __m256i phi = _mm256_unpackhi_epi8(p, zero);
+      __m256i qlo = _mm256_unpacklo_epi8(q, zero);
+      __m256i qhi = _mm256_unpackhi_epi8(q, zero);
+      a0 = _mm256_add_epi32(
+          a0, _mm256_madd_epi16(_mm256_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm256_add_epi32(
+          a1, _mm256_madd_epi16(_mm256_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm256_add_epi32(
+          a2, _mm256_madd_epi16(_mm256_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm256_add_epi32(
+          a3, _mm256_madd_epi16(_mm256_unpackhi_epi16(phi, qhi), wp));
+    }
+    // x = [0..7 | 16..23], y = [8..15 | 24..31]
+    __m256i x = _mm256_packs_epi32(_mm256_sra_epi32(a0, vshift),
+                                   _mm256_sra_epi32(a1, vshift));
+    __m256i y = _mm256_packs_epi32(_mm256_sra_epi32(a2, vshift),
+                                   _mm256_sra_epi32(a3, vshift));
+    _mm256_storeu_si256((__m256i *)(dst + j),
+                        _mm256_permute2x128_si256(x, y, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + j + 16),
+                        _mm256_permute2x128_si256(x, y, 0x31));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_s16_sse2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("avx2"))) static void
+s16_u8_avx2(const int16_t *const *src, const int16_t *w, int ntaps,
+            int32_t add, int shift, unsigned char *dst, int len) {
+  const __m256i vadd = _mm256_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 32 <= len; j += 32) {
+    __m256i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m256i wp = _mm256_set1_epi32(weight_pair(w, t));
+      __m256i p0 = _mm256_loadu_si256((const __m256i *)(src[t] + j));
+      __m256i p1 = _mm256_loadu_si256((const __m256i *)(src[t] + j + 16));
+      __m256i q0 = _mm256_loadu_si256((const __m256i *)(src[t + 1] + j));
+      __m256i q1 = _mm256_loadu_si256((const __m256i *)(src[t + 1] + j + 16));
+      a0 = _mm256_add_epi32(
+          a0, _mm256_madd_epi16(_mm256_unpacklo_epi16(p0, q0), wp));
+      a1 = _mm256_add_epi32(
+          a1, _mm256_madd_epi16(_mm256_unpackhi_epi16(p0, q0), wp));
+      a2 = _mm256_add_epi32(
+          a2, _mm256_madd_epi16(_mm256_unpacklo_epi16(p1, q1), wp));
+      a3 = _mm256_add_epi32(
+          a3, _mm256_madd_epi16(_mm256_unpackhi_epi16(p1, q1), wp));
+    }
+    // lo = [0..15], hi = [16..31]; the byte pack interleaves their lanes
+    __m256i lo = _mm256_packs_epi32(_mm256_sra_epi32(a0, vshift),
+                                    _mm256_sra_epi32(a1, vshift));
+    __m256i hi = _mm256_packs_epi32(_mm256_sra_epi32(a2, vshift),
+                                    _mm256_sra_epi32(a3, vshift));
+    __m256i packed = _mm256_packus_epi16(lo, hi);
+    _mm256_storeu_si256((__m256i *)(dst + j),
+                        _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  if (j < len) {
+    const int16_t *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    s16_u8_sse2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+// ------- AVX-512 (F + BW): 64 output bytes per iteration -------
+
+/*
+ * Same scheme on 512-bit registers. Unpacks and packs still work inside
+ * 128-bit lanes; the 16-bit output interleaves the lanes of its two packed
+ * halves, and the bytes packed from 16-bit taps need a qword permute.
+ */
+__attribute__((target("avx512f,avx512bw"))) static void
+u8_u8_avx512(const unsigned char *const *src, const int16_t *w, int ntaps,
+             int32_t add, int shift, unsigned char *dst, int len) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i vadd = _mm512_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  int j = 0;
+  for (; j + 64 <= len; j += 64) {
+    __m512i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m512i wp = _mm512_set1_epi32(weight_pair(w, t));
+      __m512i p = _mm512_loadu_si512((const void *)(src[t] + j));
+      __m512i q = _mm512_loadu_si512((const void *)(src[t + 1] + j));
+      __m512i plo = _mm512_unpacklo_epi8(p, zero);
+      __m512i phi = _mm512_unpackhi_epi8(p, zero);
+      __m512i qlo = _mm512_unpacklo_epi8(q, zero);
+      __m512i qhi = _mm512_unpackhi_epi8(q, zero);
+      a0 = _mm512_add_epi32(
+          a0, _mm512_madd_epi16(_mm512_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm512_add_epi32(
+          a1, _mm512_madd_epi16(_mm512_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm512_add_epi32(
+          a2, _mm512_madd_epi16(_mm512_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm512_add_epi32(
+          a3, _mm512_madd_epi16(_mm512_unpackhi_epi16(phi, qhi), wp));
+    }
+    __m512i lo = _mm512_packs_epi32(_mm512_sra_epi32(a0, vshift),
+                                    _mm512_sra_epi32(a1, vshift));
+    __m512i hi = _mm512_packs_epi32(_mm512_sra_epi32(a2, vshift),
+                                    _mm512_sra_epi32(a3, vshift));
+    _mm512_storeu_si512((void *)(dst + j), _mm512_packus_epi16(lo, hi));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_u8_avx2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+u8_s16_avx512(const unsigned char *const *src, const int16_t *w, int ntaps,
+              int32_t add, int shift, int16_t *dst, int len) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i vadd = _mm512_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  // qwords of x and y in output order: lanes x0 y0 x1 y1, then x2 y2 x3 y3
+  const __m512i first = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+  const __m512i second = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+  int j = 0;
+  for (; j + 64 <= len; j += 64) {
+    __m512i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m512i wp = _mm512_set1_epi32(weight_pair(w, t));
+      __m512i p = _mm512_loadu_si512((const void *)(src[t] + j));
+      __m512i q = _mm512_loadu_si512((const void *)(src[t + 1] + j));
+      __m512i plo = _mm512_unpacklo_epi8(p, zero);
+      __m512i phi = _mm512_unpackhi_epi8(p, zero);
+      __m512i qlo = _mm512_unpacklo_epi8(q, zero);
+      __m512i qhi = _mm512_unpackhi_epi8(q, zero);
+      a0 = _mm512_add_epi32(
+          a0, _mm512_madd_epi16(_mm512_unpacklo_epi16(plo, qlo), wp));
+      a1 = _mm512_add_epi32(
+          a1, _mm512_madd_epi16(_mm512_unpackhi_epi16(plo, qlo), wp));
+      a2 = _mm512_add_epi32(
+          a2, _mm512_madd_epi16(_mm512_unpacklo_epi16(phi, qhi), wp));
+      a3 = _mm512_add_epi32(
+          a3, _mm512_madd_epi16(_mm512_unpackhi_epi16(phi, qhi), wp));
+    }
+    // lane k of x holds outputs 16k..16k+7, lane k of y 16k+8..16k+15
+    __m512i x = _mm512_packs_epi32(_mm512_sra_epi32(a0, vshift),
+                                   _mm512_sra_epi32(a1, vshift));
+    __m512i y = _mm512_packs_epi32(_mm512_sra_epi32(a2, vshift),
+                                   _mm512_sra_epi32(a3, vshift));
+    _mm512_storeu_si512((void *)(dst + j),
+                        _mm512_permutex2var_epi64(x, first, y));
+    _mm512_storeu_si512((void *)(dst + j + 32),
+                        _mm512_permutex2var_epi64(x, second, y));
+  }
+  if (j < len) {
+    const unsigned char *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    u8_s16_avx2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+s16_u8_avx512(const int16_t *const *src, const int16_t *w, int ntaps,
+              int32_t add, int shift, unsigned char *dst, int len) {
+  const __m512i vadd = _mm512_set1_epi32(add);
+  const __m128i vshift = _mm_cvtsi32_si128(shift);
+  // qword k of every lane packed from lo, then from hi
+  const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+  int j = 0;
+  for (; j + 64 <= len; j += 64) {
+    __m512i a0 = vadd, a1 = vadd, a2 = vadd, a3 = vadd;
+    for (int t = 0; t < ntaps; t += 2) {
+      __m512i wp = _mm512_set1_epi32(weight_pair(w, t));
+      __m512i p0 = _mm512_loadu_si512((const void *)(src[t] + j));
+      __m512i p1 = _mm512_loadu_si512((const void *)(src[t] + j + 32));
+      __m512i q0 = _mm512_loadu_si512((const void *)(src[t + 1] + j));
+      __m512i q1 = _mm512_loadu_si512((const void *)(src[t + 1] + j + 32));
+      a0 = _mm512_add_epi32(
+          a0, _mm512_madd_epi16(_mm512_unpacklo_epi16(p0, q0), wp));
+      a1 = _mm512_add_epi32(
+          a1, _mm512_madd_epi16(_mm512_unpackhi_epi16(p0, q0), wp));
+      a2 = _mm512_add_epi32(
+          a2, _mm512_madd_epi16(_mm512_unpacklo_epi16(p1, q1), wp));
+      a3 = _mm512_add_epi32(
+          a3, _mm512_madd_epi16(_mm512_unpackhi_epi16(p1, q1), wp));
+    }
+    // lo = [0..31], hi = [32..63]; the byte pack interleaves their lanes
+    __m512i lo = _mm512_packs_epi32(_mm512_sra_epi32(a0, vshift),
+                                    _mm512_sra_epi32(a1, vshift));
+    __m512i hi = _mm512_packs_epi32(_mm512_sra_epi32(a2, vshift),
+                                    _mm512_sra_epi32(a3, vshift));
+    __m512i packed = _mm512_packus_epi16(lo, hi);
+    _mm512_storeu_si512((void *)(dst + j),
+                        _mm512_permutexvar_epi64(order, packed));
+  }
+  if (j < len) {
+    const int16_t *tail[ntaps];
+    for (int t = 0; t < ntaps; t++)
+      tail[t] = src[t] + j;
+    s16_u8_avx2(tail, w, ntaps, add, shift, dst + j, len - j);
+  }
+}
+#endif
+
+/**
+ * Selects the widest kernels allowed by cpu_isa()
+ *
+ * Runs once through pthread_once on the first kernel call. SSE4.1 adds
+ * nothing to these kernels, so that level runs the SSE2 code.
+ */
+static void select_isa(void) {
+  impl_u8_u8 = u8_u8_scalar;
+  impl_u8_s16 = u8_s16_scalar;
+  impl_s16_u8 = s16_u8_scalar;
+#ifdef CPU_X86
+  CpuIsa isa = cpu_isa();
+  if (isa >= CPU_ISA_AVX512) {
+    impl_u8_u8 = u8_u8_avx512;
+    impl_u8_s16 = u8_s16_avx512;
+    impl_s16_u8 = s16_u8_avx512;
+    impl_name = "avx512";
+  } else if (isa >= CPU_ISA_AVX2) {
+    impl_u8_u8 = u8_u8_avx2;
+    impl_u8_s16 = u8_s16_avx2;
+    impl_s16_u8 = s16_u8_avx2;
+    impl_name = "avx2";
+  } else if (isa >= CPU_ISA_SSE2) {
+    impl_u8_u8 = u8_u8_sse2;
+    impl_u8_s16 = u8_s16_sse2;
+    impl_s16_u8 = s16_u8_sse2;
+    impl_name = "sse2";
+  }
+#endif
+}
+
+/**
+ * Fixed-point multi-tap row kernel from 8-bit taps to 8-bit output
+ *
+ * @param src Tap rows; output j reads src[t][j] for every tap t
+ * @param w Tap weights (ntaps entries)
+ * @param ntaps Number of taps, even
+ * @param add Accumulator start value (bias and rounding half)
+ * @param shift Fractional bits dropped from the accumulator
+ * @param dst Output row
+ * @param len Number of output bytes
+ */
+void convfx_u8_u8(const unsigned char *const *src, const int16_t *w, int ntaps,
+                  int32_t add, int shift, unsigned char *dst, int len) {
+  pthread_once(&isa_once, select_isa);
+  impl_u8_u8(src, w, ntaps, add, shift, dst, len);
+}
+
+/**
+ * Fixed-point multi-tap row kernel from 8-bit taps to a 16-bit intermediate
+ *
+ * Same parameters as convfx_u8_u8; results saturate to [-32768, 32767].
+ */
+void convfx_u8_s16(const unsigned char *const *src, const int16_t *w,
+                   int ntaps, int32_t add, int shift, int16_t *dst, int len) {
+  pthread_once(&isa_once, select_isa);
+  impl_u8_s16(src, w, ntaps, add, shift, dst, len);
+}
+
+/**
+ * Fixed-point multi-tap row kernel from 16-bit intermediate taps to 8-bit
+ * output
+ *
+ * Same parameters as convfx_u8_u8 with 16-bit tap rows.
+ */
+void convfx_s16_u8(const int16_t *const *src, const int16_t *w, int ntaps,
+                   int32_t add, int shift, unsigned char *dst, int len) {
+  pthread_once(&isa_once, select_isa);
+  impl_s16_u8(src, w, ntaps, add, shift, dst, len);
+}
+
+/**
+ * Returns the instruction set picked for the row kernels
+ *
+ * @return "avx512", "avx2", "sse2" or "scalar"
+ */
+const char *convfx_isa(void) {
+  pthread_once(&isa_once, select_isa);
+  return impl_name;
+}
@@ -0,0 +1,83 @@
+#include "cpu_dispatch.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const isa_names[] = {"scalar", "sse2", "sse4.1", "avx2",
+                                        "avx512"};
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static CpuIsa isa_level = CPU_ISA_SCALAR;
+
+/**
+ * Detects the widest level the CPU and the OS support
+ *
+ * __builtin_cpu_supports reads cpuid and also checks that the OS saves the
+ * wide registers (XCR0), so an AVX-512 CPU under a kernel without AVX-512
+ * state support reports AVX2.
+ *
+ * @return Detected level
+ */
+static CpuIsa detect_isa(void) {
+#ifdef CPU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return CPU_ISA_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return CPU_ISA_AVX2;
+  if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3"))
+    return CPU_ISA_SSE41;
+  if (__builtin_cpu_supports("sse2"))
+    return CPU_ISA_SSE2;
+#endif
+  return CPU_ISA_SCALAR;
+}
+
+/**
+ * Sets the level from the CPU and IMAGEMUGGLE_ISA
+ *
+ * Runs once through pthread_once. A requested level above what the CPU
+ * supports is reported and lowered, since running those kernels would fault.
+ */
+static void isa_init(void) {
+  CpuIsa hw = detect_isa();
+  isa_level = hw;
+  const char *env = getenv("IMAGEMUGGLE_ISA");
+  if (!env)
+    return;
+  for (int i = CPU_ISA_SCALAR; i <= CPU_ISA_AVX512; i++)
+    if (strcmp(env, isa_names[i]) == 0) {
+      if (i > (int)hw)
+        fprintf(stderr, "IMAGEMUGGLE_ISA=%s is not supported here, using %s\n",
+                env, isa_names[hw]);
+      else
+        isa_level = (CpuIsa)i;
+      return;
+    }
+  fprintf(stderr,
+          "Ignoring IMAGEMUGGLE_ISA=%s (scalar, sse2, sse4.1, avx2 or "
+          "avx512)\n",
+          env);
+}
+
+/**
+ * Returns the instruction set level of the pixel kernels
+ *
+ * @return Detected level, capped by IMAGEMUGGLE_ISA
+ */
+CpuIsa cpu_isa(void) {
+  pthread_once(&isa_once, isa_init);
+  return isa_level;
+}
+
+/**
+ * Returns the name of a level
+ *
+ * @param isa Level
+ * @return "scalar", "sse2", "sse4.1", "avx2" or "avx512"
+ */
+const char *cpu_isa_name(CpuIsa isa) {
+  return isa >= CPU_ISA_SCALAR && isa <= CPU_ISA_AVX512 ? isa_names[isa]
+                                                        : "unknown";
+}
@@ -0,0 +1,166 @@
+#include "image.h"
+#include "buffer_pool.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/**
+ * Takes a pixel block from the buffer pool and sets the image geometry
+ *
+ * @param img Image structure to initialize
+ * @param width Number of columns
+ * @param height Number of rows
+ * @param channels Number of channels per pixel
+ * @param zero Nonzero to clear the pixels
+ *
+ * @return 0 on success, -1 on invalid dimensions or allocation failure
+ */
+static int image_alloc_block(Image *img, int width, int height, int channels,
+                             int zero) {
+  Image empty = {0};
+  *img = empty;
+  if (width <= 0 || height <= 0 || channels <= 0)
+    return -1;
+  size_t stride = (size_t)width * channels;
+  img->data = (unsigned char *)buffer_pool_get(stride * height, zero,
+                                               &img->capacity);
+  if (!img->data)
+    return -1;
+  if (profile_enabled())
+    profile_alloc(stride * height);
+  img->width = width;
+  img->height = height;
+  img->channels = channels;
+  img->stride = stride;
+  return 0;
+}
+
+/**
+ * Allocates a flat interleaved image with tightly packed rows
+ *
+ * All pixels live in a single zero-filled block of width * height * channels
+ * bytes. Pixel (x, y) channel c is found at data[y * stride + x * channels +
+ * c], so no per-row or per-pixel pointer tables are needed. The block comes
+ * from the buffer pool, so a recently freed image of a similar size is
+ * reused instead of mapping fresh memory.
+ *
+ * @param img Image structure to initialize
+ * @param width Number of columns
+ * @param height Number of rows
+ * @param channels Number of channels per pixel (e.g., 3 for RGB, 4 for RGBA)
+ *
+ * @return 0 on success, -1 on invalid dimensions or allocation failure. On
+ * failure the structure is left empty (data == NULL).
+ *
+ * @note The image must be released with image_free
+ */
+int image_alloc(Image *img, int width, int height, int channels) {
+  return image_alloc_block(img, width, height, channels, 1);
+}
+
+/**
+ * Allocates a flat interleaved image without clearing its pixels
+ *
+ * For destinations that an operator or pipeline overwrites completely; skips
+ * the zero-filling pass of image_alloc.
+ *
+ * @param img Image structure to initialize
+ * @param width Number of columns
+ * @param height Number of rows
+ * @param channels Number of channels per pixel
+ *
+ * @return 0 on success, -1 on invalid dimensions or allocation failure
+ *
+ * @note The image must be released with image_free
+ */
+int image_alloc_uninit(Image *img, int width, int height, int channels) {
+  return image_alloc_block(img, width, height, channels, 0);
+}
+
+/**
+ * Changes the geometry of an image, reusing its block when it fits
+ *
+ * A pooled block whose capacity covers the new size is kept as is (no
+ * allocation at all, e.g. when a resize alternates between two sizes);
+ * otherwise the block is returned and an uncleared one is taken.
+ *
+ * @param img Image to reshape (may be empty)
+ * @param width Number of columns
+ * @param height Number of rows
+ * @param channels Number of channels per pixel
+ *
+ * @return 0 on success, -1 on invalid dimensions or allocation failure (the
+ * image is then empty)
+ */
+int image_reshape(Image *img, int width, int height, int channels) {
+  size_t stride = (size_t)width * channels;
+  if (img->data && width > 0 && height > 0 && channels > 0 &&
+      stride * height <= img->capacity) {
+    img->width = width;
+    img->height = height;
+    img->channels = channels;
+    img->stride = stride;
+    return 0;
+  }
+  image_free(img);
+  return image_alloc_uninit(img, width, height, channels);
+}
+
+/**
+ * Wraps an existing pixel block as an image without copying
+ *
+ * Used to take over buffers produced by decoders, which saves a second
+ * full-size allocation and a pass over the pixels.
+ *
+ * @param img Image structure to initialize
+ * @param data Block of width * height * channels bytes, rows tightly packed,
+ * allocated with malloc; owned by img afterwards and released with free (it
+ * does not join the buffer pool)
+ * @param width Number of columns
+ * @param height Number of rows
+ * @param channels Number of channels per pixel
+ *
+ * @return 0 on success, -1 on invalid arguments (data is then not adopted
+ * and stays owned by the caller)
+ *
+ * @note The image must be released with image_free
+ */
+int image_adopt(Image *img, unsigned char *data, int width, int height,
+                int channels) {
+  Image empty = {0};
+  *img = empty;
+  if (!data || width <= 0 || height <= 0 || channels <= 0)
+    return -1;
+  img->data = data;
+  img->width = width;
+  img->height = height;
+  img->channels = channels;
+  img->stride = (size_t)width * channels;
+  if (profile_enabled())
+    profile_alloc(img->stride * height);
+  return 0;
+}
+
+/**
+ * Releases the pixel block of an image and resets the structure
+ *
+ * Pooled blocks go back to the buffer pool for reuse, file mappings are
+ * unmapped (shared ones keep their pixels in the file) and adopted blocks
+ * are freed.
+ *
+ * @param img Image to release. Can be NULL or already freed.
+ */
+void image_free(Image *img) {
+  if (!img)
+    return;
+  if (img->map)
+    munmap(img->map, img->map_bytes);
+  else if (img->capacity)
+    buffer_pool_put(img->data, img->capacity);
+  else
+    free(img->data);
+  img->data = NULL;
+  img->map = NULL;
+  img->width = img->height = img->channels = 0;
+  img->stride = img->capacity = img->map_bytes = 0;
+}
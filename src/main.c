@@ -1,202 +1,163 @@
-#include "conv.h"
-#include "resize.h"
-#include "rotate.h"
-#include "sobel.h"
+#include "buffer_pool.h"
+#include "mapped_io.h"
+#include "ops.h"
+#include "png_writer.h"
+#include "pnm.h"
+#include "profile.h"
+#include "server.h"
+#include "thread_pool.h"
 #include "utils_conc.h"
-#include <math.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-// Helpers for full allocation and deallocation (matrix + rows + block)
-typedef struct {
-  unsigned char ***m;
-  unsigned char *contiguous;
-  int w, h, c;
-} Image3D;
-
-/**
- * Allocates and initializes a 3D image structure with specified dimensions.
- *
- * This function creates a 3D image with width, height, and channel dimensions.
- * The image data is stored in a contiguous memory block for efficient access,
- * while maintaining a 3D pointer structure (m[y][x]) that points into this
- * contiguous block. Each pixel contains 'c' channels of unsigned char data.
- *
- * @param w Width of the image (number of pixels horizontally)
- * @param h Height of the image (number of pixels vertically)
- * @param c Number of channels per pixel (e.g., 1 for grayscale, 3 for RGB)
- *
- * @return Image3D structure with allocated memory on success, or an empty
- *         Image3D structure (with NULL pointers) on allocation failure.
- *         The caller is responsible for freeing the returned image using
- *         an appropriate deallocation function.
- *
- * @note The function performs comprehensive error handling - if any allocation
- *       fails, all previously allocated memory is freed before returning.
- * @note Memory layout: contiguous block stores pixels row by row, with each
- *       pixel's channels stored consecutively.
- */
-static Image3D alloc_image3d(int w, int h, int c) {
-  Image3D img = {0};
-  img.w = w;
-  img.h = h;
-  img.c = c;
-  // contiguous block
-  img.contiguous = (unsigned char *)calloc((size_t)w * h * c, 1);
-  if (!img.contiguous) {
-    return img; // Return empty Image3D on failure
-  }
-
-  img.m = (unsigned char ***)malloc(sizeof(unsigned char **) * h);
-  if (!img.m) {
-    free(img.contiguous);
-    img.contiguous = NULL;
-    return img; // Return empty Image3D on failure
-  }
-
-  for (int y = 0; y < h; y++) {
-    img.m[y] = (unsigned char **)malloc(sizeof(unsigned char *) * w);
-    if (!img.m[y]) {
-      // Free previously allocated rows
-      for (int i = 0; i < y; i++) {
-        free(img.m[i]);
-      }
-      free(img.m);
-      free(img.contiguous);
-      img.m = NULL;
-      img.contiguous = NULL;
-      return img; // Return empty Image3D on failure
-    }
-    for (int x = 0; x < w; x++) {
-      img.m[y][x] = img.contiguous + ((size_t)y * w + x) * c;
-    }
-  }
-  return img;
-}
-
-/**
- * Frees all dynamically allocated memory associated with an Image3D structure.
- *
- * This function safely deallocates the 2D array of pointers, the contiguous
- * memory block, and resets the pointers to NULL to prevent dangling references.
- * The function performs null pointer checks to avoid segmentation faults.
- *
- * @param img Pointer to the Image3D structure to be freed. Can be NULL.
- *
- * @note After calling this function, the Image3D structure itself is not freed,
- *       only its internal dynamically allocated members.
- * @note It's safe to call this function with a NULL pointer or partially
- *       initialized Image3D structure.
- */
-static void free_image3d(Image3D *img) {
-  if (!img || !img->m)
-    return;
-  for (int y = 0; y < img->h; y++)
-    free(img->m[y]);
-  free(img->m);
-  free(img->contiguous);
-  img->m = NULL;
-  img->contiguous = NULL;
-}
+#include <strings.h>
+#include <sys/stat.h>
 
 static void print_menu(void) {
   printf("\nImage Processing Menu\n");
-  printf("1) Convolution (3x3 blur)\n");
+  printf("1) Blur (box / Gaussian)\n");
   printf("  1a) Light blur\n");
   printf("  1b) Medium blur\n");
   printf("  1c) Heavy blur\n");
   printf("2) Sobel edge detection\n");
   printf("3) Rotate (degrees)\n");
-  printf("4) Resize (new width/height)\n");
+  printf("4) Resize (new width/height, filter)\n");
   printf("5) Save and exit\n");
+  printf("6) Flip (horizontal / vertical)\n");
   printf("Option: ");
 }
 
 /**
- * Main function for the image processing application
- *
- * This program provides an interactive menu-driven interface for applying
- * various image processing operations to PNG images. It supports loading images
- * from files or generating demo patterns for testing.
- *
- * @param argc Number of command line arguments
- * @param argv Array of command line arguments
- *             argv[1]: Input PNG file path (optional)
- *             argv[2]: Output PNG file path (optional)
+ * Parses a count option such as --threads
  *
- * @return 0 on successful execution, 1 on error
- *
- * @details
- * The program offers the following image processing operations:
- * - Blur with selectable intensity (light/medium/heavy)
- * - Sobel edge detection
- * - Image rotation by specified angle
- * - Image resizing to new dimensions
+ * @param s Option value
+ * @param out Parsed value
+ * @return 0 on success, -1 unless s is a whole integer from 1 to INT_MAX
+ */
+static int parse_count(const char *s, int *out) {
+  char *end;
+  errno = 0;
+  long v = strtol(s, &end, 10);
+  if (end == s || *end || errno || v < 1 || v > INT_MAX)
+    return -1;
+  *out = (int)v;
+  return 0;
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage:\n"
+          "  %s [input.png output.png]          interactive menu\n"
+          "  %s --ops CHAIN [options] in.png out.png [in2.png out2.png ...]\n"
+          "  %s --thumbnails SIZES [--ops CHAIN] [options] in.png out.png ...\n"
+          "  %s --ops CHAIN [options] --output-dir DIR "
+          "[--input-dir DIR] [in.png ...]\n"
+          "  %s --serve SOCKET|- [options]      job server (NDJSON)\n"
+          "\n"
+          "Options:\n"
+          "  -o, --ops CHAIN        operations applied left to right, e.g.\n"
+          "                         \"blur:5,sobel,rotate:30,resize:800x600\"\n"
+          "                         steps: blur[:N] box:R gauss:SIGMA sobel\n"
+          "                         rotate:DEG flip:h|v "
+          "resize:WxH[:bilinear|box|catmull|lanczos3]\n"
+          "  -T, --thumbnails SIZES write one output per size instead, e.g.\n"
+          "                         \"1600x0,800x0,200x200:box\" (resize "
+          "arguments, 0 keeps\n"
+          "                         the aspect ratio), all from one "
+          "pyramid; out.png\n"
+          "                         becomes out-1600x1200.png, "
+          "out-800x600.png, ...\n"
+          "  -S, --serve SOCKET|-   serve JSON jobs, one per line: "
+          "{\"in\": ..., \"out\": ...,\n"
+          "                         \"ops\": ...}, on a Unix socket or "
+          "stdin (\"-\")\n"
+          "  -t, --threads N        worker threads (default: "
+          "IMAGEMUGGLE_THREADS or CPU count)\n"
+          "  -j, --jobs N           images processed at once (default: "
+          "min(images, threads))\n"
+          "  -i, --input-dir DIR    process every .png, PNM and .raw file "
+          "in DIR\n"
+          "  -d, --output-dir DIR   write results to DIR under the input "
+          "file name\n"
+          "  -s, --stream           process PNM files (.pnm .pgm .ppm .pam) "
+          "row by row\n"
+          "                         with memory bounded by the image width\n"
+          "  -p, --profile FILE     write per-operator and per-thread timing "
+          "as JSON\n"
+          "                         (\"-\" for stderr; also "
+          "IMAGEMUGGLE_PROFILE=FILE)\n"
+          "  -z, --png-level N      PNG compression, 0 (fastest) to 9 "
+          "(smallest), default 6\n"
+          "  -h, --help             show this help\n",
+          prog, prog, prog, prog, prog);
+}
+
+/**
+ * Runs the interactive menu on one image
  *
- * Usage modes:
- * - With 2+ args: Load input image, process interactively, save to output
- * - With <2 args: Generate demo pattern for menu demonstration only
+ * Every menu entry is translated into an Op and applied with op_run, so
+ * results can be chained before saving.
  *
- * The program uses double buffering (src/dst) and swaps buffers after each
- * operation to allow chaining of multiple effects. All operations support
- * concurrent processing with 4 threads by default.
+ * @param in Input PNG path, or NULL for a generated demo pattern
+ * @param out Output PNG path, or NULL to skip saving
+ * @param num_threads Number of row blocks per operator
+ * @param png_level PNG compression level of the saved image
  *
- * @note Requires stb headers for PNG support, compile with -DUSE_STB
- * -Ithird_party
+ * @return 0 on success, 1 on error
  */
-int main(int argc, char **argv) {
-  if (argc < 3) {
-    fprintf(stderr, "Usage: %s input.png output.png\n", argv[0]);
-    fprintf(stderr, "Note: PNG support requires stb headers and compile with "
-                    "-DUSE_STB -Ithird_party\n");
-  }
-
+static int run_menu(const char *in, const char *out, int num_threads,
+                    int png_level) {
   // Load image
-  unsigned char ***src = NULL;
-  int w = 0, h = 0, c = 0;
-  if (argc >= 2 && loadPNG(argv[1], &src, &w, &h, &c) != 0) {
+  Image src = {0};
+  if (in && loadPNG(in, &src) != 0) {
     fprintf(stderr,
             "Could not load %s. You can integrate your own I/O functions.\n",
-            argv[1]);
+            in);
     return 1;
-  } else if (argc < 2) {
+  } else if (!in) {
     fprintf(stderr,
             "Continuing without loaded image (menu demonstration only)...\n");
-    w = 256;
-    h = 256;
-    c = 3;
-    Image3D demo = alloc_image3d(w, h, c);
-    src = demo.m;
+    if (image_alloc(&src, 256, 256, 3) != 0) {
+      fprintf(stderr, "Failed to allocate demo image\n");
+      return 1;
+    }
     // simple pattern
-    for (int y = 0; y < h; y++)
-      for (int x = 0; x < w; x++) {
-        src[y][x][0] = x;
-        src[y][x][1] = y;
-        src[y][x][2] = 128;
+    for (int y = 0; y < src.height; y++)
+      for (int x = 0; x < src.width; x++) {
+        unsigned char *px = image_px(&src, x, y);
+        px[0] = x;
+        px[1] = y;
+        px[2] = 128;
       }
   }
 
-  // dst buffer
-  Image3D dst = alloc_image3d(w, h, c);
-  if (!dst.m) {
+  // dst buffer, reused (or reshaped) by every operation
+  Image dst;
+  if (image_alloc_uninit(&dst, src.width, src.height, src.channels) != 0) {
     fprintf(stderr, "Failed to allocate destination buffer\n");
+    image_free(&src);
     return 1;
   }
 
   int exit_flag = 0;
   while (!exit_flag) {
     print_menu();
-    int op;
-    if (scanf("%d", &op) != 1) {
+    int opt;
+    if (scanf("%d", &opt) != 1) {
       break;
     }
-    if (op == 1) {
+    Op op = {0};
+    if (opt == 1) {
       // Blur options
       printf("Choose blur strength:\n");
-      printf("  a) Light blur (1x)\n");
-      printf("  b) Medium blur (3x applications)\n");
-      printf("  c) Heavy blur (5x applications)\n");
+      printf("  a) Light blur (3x3 box)\n");
+      printf("  b) Medium blur (Gaussian, like 3 box passes)\n");
+      printf("  c) Heavy blur (Gaussian, like 5 box passes)\n");
       printf("Choice (a/b/c): ");
       char choice;
       if (scanf(" %c", &choice) != 1) {
@@ -204,111 +165,578 @@ int main(int argc, char **argv) {
         choice = 'a';
       }
 
-      float k[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
-      for (int i = 0; i < 9; i++)
-        k[i] /= 9.0f;
-
-      int applications = 1;
+      op.type = OP_BLUR;
       switch (choice) {
       case 'a':
-        applications = 1;
+        op.n = 1;
         break;
       case 'b':
-        applications = 3;
+        op.n = 3;
         break;
       case 'c':
-        applications = 5;
+        op.n = 5;
         break;
       default:
         printf("Invalid choice, using light blur\n");
-        applications = 1;
-      }
-
-      // Apply blur multiple times for stronger effect
-      for (int i = 0; i < applications; i++) {
-        if (conv_concurrent(src, dst.m, w, h, c, k, 3, 1.0f, 0.0f, 4) != 0) {
-          fprintf(stderr, "Convolution failed\n");
-          break;
-        }
-        // swap buffers
-        unsigned char ***tmp = src;
-        src = dst.m;
-        dst.m = tmp;
+        op.n = 1;
       }
-      printf("Applied blur %d time(s)\n", applications);
-    } else if (op == 2) {
-      if (sobel_concurrent(src, dst.m, w, h, c, 4) != 0) {
+      if (op_run(&op, &src, &dst, num_threads) != 0)
+        fprintf(stderr, "Blur failed\n");
+      else
+        printf("Applied blur equivalent to %d 3x3 pass(es)\n", op.n);
+    } else if (opt == 2) {
+      op.type = OP_SOBEL;
+      if (op_run(&op, &src, &dst, num_threads) != 0)
         fprintf(stderr, "Sobel edge detection failed\n");
-      } else {
-        unsigned char ***tmp = src;
-        src = dst.m;
-        dst.m = tmp;
-      }
-    } else if (op == 3) {
-      float ang;
+    } else if (opt == 3) {
+      op.type = OP_ROTATE;
       printf("Angle (degrees): ");
-      if (scanf("%f", &ang) != 1) {
+      if (scanf("%f", &op.value) != 1) {
         fprintf(stderr, "Invalid input for angle\n");
         continue;
       }
-      if (rotate_concurrent(src, dst.m, w, h, c, ang, 4) != 0) {
+      if (op_run(&op, &src, &dst, num_threads) != 0)
         fprintf(stderr, "Rotation failed\n");
-      } else {
-        unsigned char ***tmp = src;
-        src = dst.m;
-        dst.m = tmp;
-      }
-    } else if (op == 4) {
-      int nw, nh;
+    } else if (opt == 4) {
+      op.type = OP_RESIZE;
       printf("New width: ");
-      if (scanf("%d", &nw) != 1) {
+      if (scanf("%d", &op.width) != 1 || op.width < 1) {
         fprintf(stderr, "Invalid input for width\n");
         continue;
       }
       printf("New height: ");
-      if (scanf("%d", &nh) != 1) {
+      if (scanf("%d", &op.height) != 1 || op.height < 1) {
         fprintf(stderr, "Invalid input for height\n");
         continue;
       }
-      Image3D out = alloc_image3d(nw, nh, c);
-      if (!out.m) {
-        fprintf(stderr, "Failed to allocate memory for resized image\n");
+      int filter;
+      printf("Filter (0 bilinear, 1 box, 2 Catmull-Rom, 3 Lanczos-3): ");
+      if (scanf("%d", &filter) != 1 || filter < RESIZE_BILINEAR ||
+          filter > RESIZE_LANCZOS3) {
+        fprintf(stderr, "Invalid input for filter\n");
         continue;
       }
-      if (resize_concurrent(src, w, h, c, out.m, nw, nh, 4) != 0) {
+      op.filter = (ResizeFilter)filter;
+      if (op_run(&op, &src, &dst, num_threads) != 0)
         fprintf(stderr, "Resize failed\n");
-        free_image3d(&out);
-      } else {
-        free_image3d(&dst);
-        dst = out;
-        // swap: we want src to be the new resized image
-        unsigned char ***tmp = src;
-        src = dst.m;
-        dst.m = tmp;
-        w = nw;
-        h = nh;
-      }
-    } else if (op == 5) {
+    } else if (opt == 5) {
       exit_flag = 1;
+    } else if (opt == 6) {
+      char axis;
+      printf("Axis (h = left-right, v = top-bottom): ");
+      if (scanf(" %c", &axis) != 1 || (axis != 'h' && axis != 'v')) {
+        fprintf(stderr, "Invalid input for axis\n");
+        continue;
+      }
+      op.type = OP_FLIP;
+      op.axis = axis == 'h' ? FLIP_HORIZONTAL : FLIP_VERTICAL;
+      if (op_run(&op, &src, &dst, num_threads) != 0)
+        fprintf(stderr, "Flip failed\n");
     } else {
       printf("Invalid option.\n");
     }
   }
 
-  if (argc >= 3) {
-    if (savePNG(argv[2], src, w, h, c) != 0) {
-      fprintf(stderr,
-              "PNG not saved (missing stb or integrate your save function).\n");
+  int rc = 0;
+  if (out) {
+    if (savePNG(out, &src, png_level) != 0) {
+      fprintf(stderr, "Could not save %s\n", out);
+      rc = 1;
     } else {
-      printf("Saved to %s\n", argv[2]);
+      printf("Saved to %s\n", out);
     }
   } else {
-    printf("Suggestion: run with ./reto2 input.png output.png\n");
+    printf("Suggestion: run with ./imagemuggle input.png output.png\n");
   }
 
   // cleanup
-  // Note: 'src' may point to different contiguous blocks due to swaps; for
-  // simplicity let OS free on exit.
-  free_image3d(&dst);
+  image_free(&src);
+  image_free(&dst);
+  return rc;
+}
+
+/**
+ * One input/output pair of a batch run
+ */
+typedef struct {
+  char *in;
+  char *out;
+} BatchItem;
+
+/**
+ * Shared state of a batch run; jobs claim images through next
+ */
+typedef struct {
+  BatchItem *items;
+  int count;
+  const OpChain *chain; // may be empty when sizes is set
+  const OpChain *sizes; // output sizes (--thumbnails), or NULL
+  int num_threads;
+  int stream;    // stream PNM rows instead of loading whole images
+  int png_level; // compression level of the saved PNGs
+  atomic_int next;
+  atomic_int failed;
+} Batch;
+
+/**
+ * Appends an input/output pair to a batch
+ *
+ * @param b Batch to extend; items grows by one
+ * @param in Input path (copied)
+ * @param out Output path (copied)
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int batch_add(Batch *b, const char *in, const char *out) {
+  BatchItem *items =
+      (BatchItem *)realloc(b->items, sizeof(BatchItem) * (b->count + 1));
+  if (!items)
+    return -1;
+  b->items = items;
+  items[b->count].in = strdup(in);
+  items[b->count].out = strdup(out);
+  if (!items[b->count].in || !items[b->count].out) {
+    free(items[b->count].in);
+    free(items[b->count].out);
+    return -1;
+  }
+  b->count++;
   return 0;
 }
+
+/**
+ * Adds an input whose output goes to a directory under the same file name
+ *
+ * @param b Batch to extend
+ * @param in Input path
+ * @param out_dir Output directory
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int batch_add_to_dir(Batch *b, const char *in, const char *out_dir) {
+  const char *base = strrchr(in, '/');
+  base = base ? base + 1 : in;
+  size_t n = strlen(out_dir) + strlen(base) + 2;
+  char *out = (char *)malloc(n);
+  if (!out)
+    return -1;
+  snprintf(out, n, "%s/%s", out_dir, base);
+  int rc = batch_add(b, in, out);
+  free(out);
+  return rc;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Adds every input file of a directory to a batch, in name order
+ *
+ * Batches scan for .png and uncompressed (PNM, IMRAW) files, or for PNM
+ * files only when streaming.
+ *
+ * @param b Batch to extend
+ * @param in_dir Directory to scan (not recursive)
+ * @param out_dir Output directory
+ *
+ * @return 0 on success, -1 if the directory cannot be read or on allocation
+ * failure
+ */
+static int batch_add_dir(Batch *b, const char *in_dir, const char *out_dir) {
+  DIR *dir = opendir(in_dir);
+  if (!dir) {
+    fprintf(stderr, "Cannot open directory %s: %s\n", in_dir, strerror(errno));
+    return -1;
+  }
+  char **names = NULL;
+  int n = 0, rc = 0;
+  struct dirent *e;
+  while ((e = readdir(dir)) != NULL) {
+    size_t len = strlen(e->d_name);
+    if (b->stream ? !pnm_path(e->d_name)
+                  : !mapped_path(e->d_name) &&
+                        (len <= 4 ||
+                         strcasecmp(e->d_name + len - 4, ".png") != 0))
+      continue;
+    size_t size = strlen(in_dir) + len + 2;
+    char **grown = (char **)realloc(names, sizeof(char *) * (n + 1));
+    if (grown)
+      names = grown;
+    char *path = grown ? (char *)malloc(size) : NULL;
+    if (!path) {
+      rc = -1;
+      break;
+    }
+    snprintf(path, size, "%s/%s", in_dir, e->d_name);
+    names[n++] = path;
+  }
+  closedir(dir);
+  if (n > 1)
+    qsort(names, n, sizeof(char *), compare_names);
+  for (int i = 0; i < n; i++) {
+    if (rc == 0)
+      rc = batch_add_to_dir(b, names[i], out_dir);
+    free(names[i]);
+  }
+  free(names);
+  if (rc != 0)
+    fprintf(stderr, "Failed to allocate the file list\n");
+  return rc;
+}
+
+/**
+ * Saves an image as PNG, or as a mapped file for PNM and .raw paths
+ *
+ * @return 0 on success, -1 on error
+ */
+static int save_image(const char *path, const Image *img, int png_level) {
+  return mapped_path(path) ? image_map_save(path, img)
+                           : savePNG(path, img, png_level);
+}
+
+/**
+ * Output path of one size: "-WxH" inserted before the extension of out
+ *
+ * @param out Output path of the batch item
+ * @param w Width of the size
+ * @param h Height of the size
+ *
+ * @return Malloc'ed path, or NULL on allocation failure
+ */
+static char *sized_path(const char *out, int w, int h) {
+  const char *base = strrchr(out, '/');
+  base = base ? base + 1 : out;
+  const char *dot = strrchr(base, '.');
+  size_t stem = dot && dot != base ? (size_t)(dot - out) : strlen(out);
+  size_t n = strlen(out) + 32;
+  char *path = (char *)malloc(n);
+  if (path)
+    snprintf(path, n, "%.*s-%dx%d%s", (int)stem, out, w, h, out + stem);
+  return path;
+}
+
+/**
+ * Resizes a processed image to every size of the batch and saves each
+ *
+ * @param b Batch with the size list
+ * @param it Item being processed; its output path names the sizes
+ * @param img Processed image
+ *
+ * @return 0 on success, -1 if resizing or any save failed
+ */
+static int save_sizes(const Batch *b, const BatchItem *it, const Image *img) {
+  int n = b->sizes->count, rc = 0;
+  Image *outs = (Image *)calloc(n, sizeof(Image));
+  if (!outs || ops_resize_sizes(b->sizes, img, outs, b->num_threads) != 0) {
+    fprintf(stderr, "%s: resizing failed\n", it->in);
+    free(outs);
+    return -1;
+  }
+  for (int i = 0; i < n; i++) {
+    char *path = sized_path(it->out, outs[i].width, outs[i].height);
+    if (!path || save_image(path, &outs[i], b->png_level) != 0) {
+      fprintf(stderr, "%s: could not save %s\n", it->in,
+              path ? path : it->out);
+      rc = -1;
+    } else {
+      printf("%s -> %s (%dx%dx%d)\n", it->in, path, outs[i].width,
+             outs[i].height, outs[i].channels);
+    }
+    free(path);
+    image_free(&outs[i]);
+  }
+  free(outs);
+  return rc;
+}
+
+/**
+ * Pool task body of a batch job: processes images until none are left
+ *
+ * Each job loads, transforms and saves one image at a time. PNM and IMRAW
+ * files are mapped instead of decoded; when both sides are, the chain writes
+ * straight into the output file (ops_map). With a size list, the result is
+ * resized to every size and each is saved under a suffixed name. The
+ * operators it calls submit their row blocks to the same pool, so
+ * image-level and row-level parallelism share the workers.
+ *
+ * @param ctx Pointer to the Batch
+ * @param task Job index (unused)
+ */
+static void run_batch_job(void *ctx, int task) {
+  (void)task;
+  Batch *b = (Batch *)ctx;
+  int i;
+  while ((i = atomic_fetch_add(&b->next, 1)) < b->count) {
+    const BatchItem *it = &b->items[i];
+    if (b->stream) {
+      int w, h, ch;
+      if (ops_stream(b->chain, it->in, it->out, b->num_threads, &w, &h,
+                     &ch) == 0)
+        printf("%s -> %s (%dx%dx%d, streamed)\n", it->in, it->out, w, h, ch);
+      else
+        atomic_fetch_add(&b->failed, 1);
+      continue;
+    }
+    if (!b->sizes) {
+      int w, h, ch;
+      if (ops_file(b->chain, it->in, it->out, b->num_threads, b->png_level,
+                   &w, &h, &ch) == 0)
+        printf("%s -> %s (%dx%dx%d%s)\n", it->in, it->out, w, h, ch,
+               mapped_path(it->in) && mapped_path(it->out) ? ", mapped" : "");
+      else
+        atomic_fetch_add(&b->failed, 1);
+      continue;
+    }
+    Image img = {0};
+    int rc = mapped_path(it->in) ? image_map_read(it->in, &img)
+                                 : loadPNG(it->in, &img);
+    if (rc == 0 && b->chain->count > 0 &&
+        (rc = ops_apply(b->chain, &img, b->num_threads)) != 0)
+      fprintf(stderr, "%s: processing failed\n", it->in);
+    if (rc != 0 || save_sizes(b, it, &img) != 0)
+      atomic_fetch_add(&b->failed, 1);
+    image_free(&img);
+  }
+}
+
+/**
+ * Processes every item of a batch with up to jobs images in flight
+ *
+ * @param b Batch to run
+ * @param jobs Number of images processed concurrently
+ *
+ * @return Number of images that failed
+ */
+static int run_batch(Batch *b, int jobs) {
+  atomic_init(&b->next, 0);
+  atomic_init(&b->failed, 0);
+  if (jobs > b->count)
+    jobs = b->count;
+  if (jobs > 0 && thread_pool_parallel_for(thread_pool_default(), jobs,
+                                           run_batch_job, b) != 0)
+    return b->count;
+  return atomic_load(&b->failed);
+}
+
+/**
+ * Main function for the image processing application
+ *
+ * Without --ops the program provides an interactive menu-driven interface
+ * for applying image processing operations to one PNG image (or a generated
+ * demo pattern). With --ops it runs non-interactively: the operation chain
+ * is applied to every input/output pair given on the command line, or to
+ * every PNG file of --input-dir, and the results are saved. --thumbnails
+ * saves each result at several sizes instead. With --stream PNM files are
+ * processed row by row instead of being loaded whole. --serve keeps the
+ * process running and takes jobs from a Unix socket or stdin (server.h).
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments (see print_usage)
+ *
+ * @return 0 on successful execution, 1 on error (in batch mode: if any image
+ * failed)
+ *
+ * @details
+ * The program offers the following image processing operations:
+ * - Blur with selectable intensity (light/medium/heavy) or explicit box
+ *   radius and Gaussian sigma
+ * - Sobel edge detection
+ * - Image rotation by specified angle (exact for multiples of 90 degrees)
+ * - Horizontal or vertical flip
+ * - Image resizing to new dimensions, or to several sizes at once through a
+ *   2x pyramid
+ *
+ * All operations run on a shared thread pool sized by --threads, the
+ * IMAGEMUGGLE_THREADS environment variable, or the number of online CPUs.
+ * In batch mode --jobs images are processed at once on that same pool.
+ * --profile (or IMAGEMUGGLE_PROFILE) writes a JSON timing report at exit.
+ *
+ * @note Requires stb headers for PNG support, compile with -DUSE_STB
+ * -Ithird_party
+ */
+int main(int argc, char **argv) {
+  static const struct option long_opts[] = {
+      {"ops", required_argument, NULL, 'o'},
+      {"thumbnails", required_argument, NULL, 'T'},
+      {"serve", required_argument, NULL, 'S'},
+      {"threads", required_argument, NULL, 't'},
+      {"jobs", required_argument, NULL, 'j'},
+      {"input-dir", required_argument, NULL, 'i'},
+      {"output-dir", required_argument, NULL, 'd'},
+      {"stream", no_argument, NULL, 's'},
+      {"profile", required_argument, NULL, 'p'},
+      {"png-level", required_argument, NULL, 'z'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  const char *ops = NULL, *thumbs = NULL, *serve = NULL;
+  const char *in_dir = NULL, *out_dir = NULL;
+  const char *profile = getenv("IMAGEMUGGLE_PROFILE");
+  int num_threads = 0, jobs = 0, stream = 0, c;
+  int png_level = PNG_LEVEL_DEFAULT;
+  while ((c = getopt_long(argc, argv, "o:T:S:t:j:i:d:sp:z:h", long_opts,
+                          NULL)) != -1) {
+    switch (c) {
+    case 'o':
+      ops = optarg;
+      break;
+    case 'T':
+      thumbs = optarg;
+      break;
+    case 'S':
+      serve = optarg;
+      break;
+    case 't':
+      if (parse_count(optarg, &num_threads) != 0) {
+        fprintf(stderr, "--threads must be a positive integer\n");
+        return 1;
+      }
+      break;
+    case 'j':
+      if (parse_count(optarg, &jobs) != 0) {
+        fprintf(stderr, "--jobs must be a positive integer\n");
+        return 1;
+      }
+      break;
+    case 'i':
+      in_dir = optarg;
+      break;
+    case 'd':
+      out_dir = optarg;
+      break;
+    case 's':
+      stream = 1;
+      break;
+    case 'p':
+      profile = optarg;
+      break;
+    case 'z':
+      png_level = atoi(optarg);
+      if (png_level < PNG_LEVEL_MIN || png_level > PNG_LEVEL_MAX) {
+        fprintf(stderr, "--png-level must be between %d and %d\n",
+                PNG_LEVEL_MIN, PNG_LEVEL_MAX);
+        return 1;
+      }
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (num_threads < 1)
+    num_threads = thread_pool_default_threads();
+  if (profile && *profile)
+    profile_start(profile);
+  int npos = argc - optind;
+
+  if (serve) {
+    if (ops || thumbs || in_dir || out_dir || jobs || stream || npos > 0) {
+      fprintf(stderr, "--serve takes its jobs from the socket or stdin only\n");
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (thread_pool_default_init(num_threads) != 0) {
+      fprintf(stderr, "Failed to start %d worker threads\n", num_threads);
+      return 1;
+    }
+    int rc = server_run(serve, num_threads, png_level);
+    thread_pool_default_shutdown();
+    profile_report();
+    buffer_pool_trim();
+    return rc != 0 ? 1 : 0;
+  }
+
+  if (!ops && !thumbs) {
+    if (in_dir || out_dir || jobs || stream || npos > 2) {
+      fprintf(stderr, "--input-dir, --output-dir, --jobs and --stream need "
+                      "--ops or --thumbnails\n");
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (npos < 2) {
+      print_usage(argv[0]);
+      fprintf(stderr, "Note: PNG support requires stb headers and compile "
+                      "with -DUSE_STB -Ithird_party\n");
+    }
+    if (thread_pool_default_init(num_threads) != 0) {
+      fprintf(stderr, "Failed to start %d worker threads\n", num_threads);
+      return 1;
+    }
+    int rc = run_menu(npos >= 1 ? argv[optind] : NULL,
+                      npos >= 2 ? argv[optind + 1] : NULL, num_threads,
+                      png_level);
+    thread_pool_default_shutdown();
+    profile_report();
+    buffer_pool_trim();
+    return rc;
+  }
+
+  OpChain chain = {0}, sizes = {0};
+  if (ops && ops_parse(ops, &chain) != 0)
+    return 1;
+  if (thumbs && ops_parse_sizes(thumbs, &sizes) != 0) {
+    ops_free(&chain);
+    return 1;
+  }
+  Batch batch = {
+      .chain = &chain,
+      .sizes = thumbs ? &sizes : NULL,
+      .num_threads = num_threads,
+      .stream = stream,
+      .png_level = png_level};
+  int rc = 0;
+  if (thumbs && stream) {
+    fprintf(stderr, "--thumbnails cannot be combined with --stream\n");
+    rc = -1;
+  } else if (in_dir && !out_dir) {
+    fprintf(stderr, "--input-dir needs --output-dir\n");
+    rc = -1;
+  } else if (!out_dir && (npos == 0 || npos % 2 != 0)) {
+    fprintf(stderr, "Expected input/output pairs\n");
+    rc = -1;
+  } else if (out_dir && mkdir(out_dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Cannot create %s: %s\n", out_dir, strerror(errno));
+    rc = -1;
+  }
+  if (rc == 0 && in_dir)
+    rc = batch_add_dir(&batch, in_dir, out_dir);
+  for (int i = optind; rc == 0 && i < argc; i += out_dir ? 1 : 2)
+    rc = out_dir ? batch_add_to_dir(&batch, argv[i], out_dir)
+                 : batch_add(&batch, argv[i], argv[i + 1]);
+  for (int i = 0; rc == 0 && stream && i < batch.count; i++)
+    if (!pnm_path(batch.items[i].in) || !pnm_path(batch.items[i].out)) {
+      fprintf(stderr, "--stream reads and writes PNM files: %s\n",
+              batch.items[i].in);
+      rc = -1;
+    }
+
+  int failed = 0;
+  if (rc == 0 && batch.count == 0) {
+    fprintf(stderr, "No input images\n");
+    rc = -1;
+  } else if (rc == 0 && thread_pool_default_init(num_threads) != 0) {
+    fprintf(stderr, "Failed to start %d worker threads\n", num_threads);
+    rc = -1;
+  } else if (rc == 0) {
+    failed = run_batch(&batch, jobs > 0 ? jobs : num_threads);
+    thread_pool_default_shutdown();
+    profile_report();
+    buffer_pool_trim();
+    if (failed)
+      fprintf(stderr, "%d of %d image(s) failed\n", failed, batch.count);
+  }
+  if (rc != 0)
+    print_usage(argv[0]);
+
+  for (int i = 0; i < batch.count; i++) {
+    free(batch.items[i].in);
+    free(batch.items[i].out);
+  }
+  free(batch.items);
+  ops_free(&chain);
+  ops_free(&sizes);
+  return rc != 0 || failed ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+#include "mapped_io.h"
+#include "pnm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Tells whether a path has the IMRAW extension
+ *
+ * @param path File path
+ * @return Nonzero for .raw (any case)
+ */
+static int raw_path(const char *path) {
+  size_t len = strlen(path);
+  return len > 4 && strcasecmp(path + len - 4, ".raw") == 0;
+}
+
+/**
+ * Tells whether a path names a format that can be memory-mapped
+ *
+ * @param path File path
+ * @return Nonzero for Netpbm extensions and .raw
+ */
+int mapped_path(const char *path) { return pnm_path(path) || raw_path(path); }
+
+static uint32_t get_le32(const unsigned char *p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+/**
+ * Reads the geometry and pixel offset of an IMRAW or Netpbm file
+ *
+ * @param path File to inspect
+ * @param width Image width
+ * @param height Image height
+ * @param channels Channel count
+ * @param offset Byte offset of the first pixel row
+ *
+ * @return 0 on success, -1 if the file cannot be read or has an unsupported
+ * header (an error is printed to stderr)
+ */
+static int read_geometry(const char *path, int *width, int *height,
+                         int *channels, size_t *offset) {
+  if (!raw_path(path)) {
+    PnmStream s;
+    if (pnm_open_read(path, &s) != 0)
+      return -1;
+    long pos = ftell(s.fp);
+    *width = s.width;
+    *height = s.height;
+    *channels = s.channels;
+    *offset = pos > 0 ? (size_t)pos : 0;
+    pnm_close(&s);
+    return pos > 0 ? 0 : -1;
+  }
+  unsigned char head[IMRAW_HEADER_BYTES];
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "Error opening %s\n", path);
+    return -1;
+  }
+  size_t got = fread(head, 1, sizeof(head), fp);
+  fclose(fp);
+  uint32_t w = get_le32(head + 8), h = get_le32(head + 12);
+  uint32_t c = get_le32(head + 16), hdr = get_le32(head + 20);
+  if (got != sizeof(head) || memcmp(head, IMRAW_MAGIC, 8) != 0 || w < 1 ||
+      w > 1 << 24 || h < 1 || h > 1 << 24 || c < 1 || c > 4 ||
+      hdr < IMRAW_HEADER_BYTES) {
+    fprintf(stderr, "%s: not an IMRAW file\n", path);
+    return -1;
+  }
+  *width = (int)w;
+  *height = (int)h;
+  *channels = (int)c;
+  *offset = hdr;
+  return 0;
+}
+
+/**
+ * Maps a file whose pixels start at offset and makes img a view of them
+ *
+ * @param fd Open file (closed by the caller)
+ * @param len Bytes to map: header plus pixels
+ * @param offset Header size
+ * @param shared Nonzero for a writable shared mapping, 0 for copy-on-write
+ * @param img Image to initialize (width, height and channels already set)
+ *
+ * @return 0 on success, -1 if mmap fails
+ */
+static int map_pixels(int fd, size_t len, size_t offset, int shared,
+                      Image *img) {
+  void *map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  // inputs are read front to back by the pipeline: start readahead now
+  if (!shared)
+    madvise(map, len, MADV_WILLNEED);
+  img->map = map;
+  img->map_bytes = len;
+  img->data = (unsigned char *)map + offset;
+  img->stride = (size_t)img->width * img->channels;
+  return 0;
+}
+
+/**
+ * Maps an uncompressed image file for reading
+ *
+ * The pixels are used in place from the page cache: no decoder and no copy.
+ * The mapping is private (copy-on-write), so writing to img never changes
+ * the file.
+ *
+ * @param path Netpbm (P5, P6, P7, 8-bit) or IMRAW file
+ * @param img Image to initialize as a view of the file; release with
+ * image_free
+ *
+ * @return 0 on success, -1 on an unsupported, truncated or unmappable file
+ * (an error is printed to stderr)
+ */
+int image_map_read(const char *path, Image *img) {
+  Image empty = {0};
+  *img = empty;
+  int w, h, ch;
+  size_t offset;
+  if (read_geometry(path, &w, &h, &ch, &offset) != 0)
+    return -1;
+  size_t len = offset + (size_t)w * h * ch;
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < len) {
+    fprintf(stderr, "%s: file is truncated\n", path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  img->width = w;
+  img->height = h;
+  img->channels = ch;
+  int rc = map_pixels(fd, len, offset, 0, img);
+  close(fd);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot map %s\n", path);
+    *img = empty;
+  }
+  return rc;
+}
+
+/**
+ * Extends a new file to its final size with its blocks allocated
+ *
+ * Only file systems that cannot reserve blocks (EOPNOTSUPP, or EINVAL from
+ * some network and FUSE file systems) fall back to a sparse ftruncate. Any
+ * other error, ENOSPC and EFBIG in particular, fails here.
+ *
+ * @param fd File opened for writing
+ * @param len Final size in bytes
+ * @param path File name for the error message
+ *
+ * @return 0 on success, -1 on failure (an error is printed to stderr)
+ */
+static int reserve_file(int fd, size_t len, const char *path) {
+  int err = posix_fallocate(fd, 0, (off_t)len);
+  if (err == EOPNOTSUPP || err == EINVAL)
+    err = ftruncate(fd, (off_t)len) == 0 ? 0 : errno;
+  if (err != 0)
+    fprintf(stderr, "%s: %s\n", path, strerror(err));
+  return err == 0 ? 0 : -1;
+}
+
+/**
+ * Creates an uncompressed image file and maps its pixel area
+ *
+ * The header is written first (P5/P6/P7 for Netpbm extensions, IMRAW for
+ * .raw), then the file is extended to its final size with its blocks
+ * reserved (see reserve_file), so a full disk is reported here rather than
+ * as a fault while an operator writes the pixels. Operators can use img as
+ * their destination and write straight into the file.
+ *
+ * @param path File to create
+ * @param width Image width
+ * @param height Image height
+ * @param channels Channel count (1 to 4)
+ * @param img Image to initialize as a view of the file; its pixels are
+ * undefined until written. image_free unmaps it, which leaves the pixels in
+ * the file.
+ *
+ * @return 0 on success, -1 on failure (an error is printed to stderr)
+ */
+int image_map_write(const char *path, int width, int height, int channels,
+                    Image *img) {
+  Image empty = {0};
+  *img = empty;
+  size_t offset;
+  if (raw_path(path)) {
+    if (width < 1 || height < 1 || channels < 1 || channels > 4) {
+      fprintf(stderr, "%s: cannot store %dx%dx%d as IMRAW\n", path, width,
+              height, channels);
+      return -1;
+    }
+    unsigned char head[IMRAW_HEADER_BYTES] = {0};
+    memcpy(head, IMRAW_MAGIC, 8);
+    put_le32(head + 8, (uint32_t)width);
+    put_le32(head + 12, (uint32_t)height);
+    put_le32(head + 16, (uint32_t)channels);
+    put_le32(head + 20, IMRAW_HEADER_BYTES);
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fwrite(head, 1, sizeof(head), fp) != sizeof(head)) {
+      fprintf(stderr, "Error creating %s\n", path);
+      if (fp)
+        fclose(fp);
+      return -1;
+    }
+    if (fclose(fp) != 0)
+      return -1;
+    offset = IMRAW_HEADER_BYTES;
+  } else {
+    PnmStream s;
+    if (pnm_open_write(path, width, height, channels, &s) != 0)
+      return -1;
+    fflush(s.fp);
+    long pos = ftell(s.fp);
+    if (pnm_close(&s) != 0 || pos <= 0)
+      return -1;
+    offset = (size_t)pos;
+  }
+  size_t len = offset + (size_t)width * height * channels;
+  int fd = open(path, O_RDWR);
+  int rc = fd >= 0 ? reserve_file(fd, len, path) : -1;
+  img->width = width;
+  img->height = height;
+  img->channels = channels;
+  if (rc == 0)
+    rc = map_pixels(fd, len, offset, 1, img);
+  if (fd >= 0)
+    close(fd);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot map %s for writing\n", path);
+    *img = empty;
+    remove(path);
+  }
+  return rc;
+}
+
+/**
+ * Writes an image to a new uncompressed file through a mapping
+ *
+ * For images that do not already live in a mapped output (e.g. decoded
+ * PNGs); the rows are copied straight into the file pages, without stdio
+ * buffering.
+ *
+ * @param path File to create (format chosen by extension as in
+ * image_map_write)
+ * @param img Image to save
+ *
+ * @return 0 on success, -1 on failure
+ */
+int image_map_save(const char *path, const Image *img) {
+  Image out;
+  if (image_map_write(path, img->width, img->height, img->channels, &out) !=
+      0)
+    return -1;
+  size_t row_bytes = (size_t)img->width * img->channels;
+  for (int y = 0; y < img->height; y++)
+    memcpy(image_row(&out, y), image_row(img, y), row_bytes);
+  image_free(&out);
+  return 0;
+}
@@ -0,0 +1,729 @@
+#include "ops.h"
+#include "blur.h"
+#include "mapped_io.h"
+#include "pipeline.h"
+#include "pnm.h"
+#include "pyramid.h"
+#include "sobel.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Resize filter names accepted after the size of a resize step
+ */
+static const struct {
+  const char *name;
+  ResizeFilter filter;
+} filter_names[] = {
+    {"bilinear", RESIZE_BILINEAR},
+    {"box", RESIZE_BOX},
+    {"catmull", RESIZE_CATMULL_ROM},
+    {"lanczos3", RESIZE_LANCZOS3},
+};
+
+/**
+ * Parses a non-negative integer (at most 1 << 24) that must span the whole
+ * string
+ *
+ * Zero is accepted (box:0, or a 0 side of a resize size that keeps the
+ * aspect ratio); callers that need a positive value check it themselves.
+ *
+ * @param s Text to parse
+ * @param out Parsed value
+ * @return 0 on success, -1 if s is not such an integer
+ */
+static int parse_int(const char *s, int *out) {
+  char *end;
+  long v = strtol(s, &end, 10);
+  if (end == s || *end || v < 0 || v > 1 << 24)
+    return -1;
+  *out = (int)v;
+  return 0;
+}
+
+/**
+ * Parses a float that must span the whole string
+ *
+ * @param s Text to parse
+ * @param out Parsed value
+ * @return 0 on success, -1 if s is not a finite number
+ */
+static int parse_float(const char *s, float *out) {
+  char *end;
+  float v = strtof(s, &end);
+  if (end == s || *end || !isfinite(v))
+    return -1;
+  *out = v;
+  return 0;
+}
+
+/**
+ * Parses the "WxH[:filter]" arguments of a resize step
+ *
+ * @param arg Arguments; modified in place
+ * @param op Operation receiving the size and filter
+ * @return 0 on success, -1 on a malformed size or unknown filter
+ */
+static int parse_size(char *arg, Op *op) {
+  op->filter = RESIZE_BILINEAR;
+  char *x = strchr(arg, 'x');
+  if (!x)
+    return -1;
+  *x++ = '\0';
+  char *name = strchr(x, ':');
+  if (name) {
+    *name++ = '\0';
+    size_t i, n = sizeof(filter_names) / sizeof(filter_names[0]);
+    for (i = 0; i < n && strcmp(name, filter_names[i].name) != 0; i++)
+      ;
+    if (i == n)
+      return -1;
+    op->filter = filter_names[i].filter;
+  }
+  if (parse_int(arg, &op->width) || parse_int(x, &op->height) ||
+      (op->width == 0 && op->height == 0))
+    return -1;
+  return 0;
+}
+
+/**
+ * Parses one "name[:args]" step of an operation chain
+ *
+ * @param tok Step text; modified in place
+ * @param op Parsed operation
+ * @return 0 on success, -1 on an unknown name or malformed arguments
+ */
+static int parse_op(char *tok, Op *op) {
+  Op empty = {0};
+  *op = empty;
+  char *arg = strchr(tok, ':');
+  if (arg)
+    *arg++ = '\0';
+
+  if (strcmp(tok, "blur") == 0) {
+    op->type = OP_BLUR;
+    op->n = 1;
+    return !arg || (parse_int(arg, &op->n) == 0 && op->n > 0) ? 0 : -1;
+  }
+  if (strcmp(tok, "box") == 0) {
+    op->type = OP_BOX;
+    return arg && parse_int(arg, &op->n) == 0 ? 0 : -1;
+  }
+  if (strcmp(tok, "gauss") == 0) {
+    op->type = OP_GAUSS;
+    return arg && parse_float(arg, &op->value) == 0 && op->value > 0 ? 0 : -1;
+  }
+  if (strcmp(tok, "sobel") == 0) {
+    op->type = OP_SOBEL;
+    return arg ? -1 : 0;
+  }
+  if (strcmp(tok, "rotate") == 0) {
+    op->type = OP_ROTATE;
+    return arg && parse_float(arg, &op->value) == 0 ? 0 : -1;
+  }
+  if (strcmp(tok, "flip") == 0) {
+    op->type = OP_FLIP;
+    if (!arg || (strcmp(arg, "h") != 0 && strcmp(arg, "v") != 0))
+      return -1;
+    op->axis = arg[0] == 'h' ? FLIP_HORIZONTAL : FLIP_VERTICAL;
+    return 0;
+  }
+  if (strcmp(tok, "resize") == 0) {
+    op->type = OP_RESIZE;
+    return arg ? parse_size(arg, op) : -1;
+  }
+  return -1;
+}
+
+/**
+ * Parses a comma-separated list of steps
+ *
+ * @param spec List text
+ * @param sizes Nonzero if every item is the arguments of a resize step
+ * @param chain Parsed list; release with ops_free
+ *
+ * @return 0 on success, -1 on a malformed list (an error naming the bad
+ * item is printed to stderr)
+ */
+static int parse_list(const char *spec, int sizes, OpChain *chain) {
+  const char *what = sizes ? "size" : "operation";
+  const char *list = sizes ? "size list" : "operation chain";
+  chain->ops = NULL;
+  chain->count = 0;
+  char *copy = strdup(spec);
+  size_t cap = 1;
+  for (const char *c = spec; *c; c++)
+    cap += *c == ',';
+  chain->ops = (Op *)malloc(sizeof(Op) * cap);
+  if (!copy || !chain->ops) {
+    free(copy);
+    ops_free(chain);
+    fprintf(stderr, "Failed to allocate %s\n", list);
+    return -1;
+  }
+  char *save = NULL;
+  for (char *tok = strtok_r(copy, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    char step[64];
+    snprintf(step, sizeof(step), "%s", tok);
+    Op *op = &chain->ops[chain->count];
+    if (sizes) {
+      Op empty = {.type = OP_RESIZE};
+      *op = empty;
+    }
+    if ((sizes ? parse_size(tok, op) : parse_op(tok, op)) != 0) {
+      fprintf(stderr, "Invalid %s '%s'\n", what, step);
+      free(copy);
+      ops_free(chain);
+      return -1;
+    }
+    chain->count++;
+  }
+  free(copy);
+  if (chain->count == 0) {
+    fprintf(stderr, "Empty %s\n", list);
+    ops_free(chain);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Parses a comma-separated operation chain
+ *
+ * Steps are applied left to right, e.g. "blur:5,sobel,rotate:30,
+ * resize:800x600:lanczos3". See OpType for the accepted steps.
+ *
+ * @param spec Chain text
+ * @param chain Parsed chain; release with ops_free
+ *
+ * @return 0 on success, -1 on a malformed chain (an error naming the bad
+ * step is printed to stderr)
+ */
+int ops_parse(const char *spec, OpChain *chain) {
+  return parse_list(spec, 0, chain);
+}
+
+/**
+ * Parses a comma-separated list of output sizes
+ *
+ * Each size takes the arguments of a resize step, e.g.
+ * "1600x0,800x0,200x200:box"; a zero side keeps the aspect ratio.
+ *
+ * @param spec List text
+ * @param sizes Parsed list of OP_RESIZE operations; release with ops_free
+ *
+ * @return 0 on success, -1 on a malformed list (an error naming the bad
+ * size is printed to stderr)
+ */
+int ops_parse_sizes(const char *spec, OpChain *sizes) {
+  return parse_list(spec, 1, sizes);
+}
+
+/**
+ * Releases a chain filled by ops_parse
+ *
+ * @param chain Chain to release; can be empty
+ */
+void ops_free(OpChain *chain) {
+  free(chain->ops);
+  chain->ops = NULL;
+  chain->count = 0;
+}
+
+/**
+ * Output geometry of an operation
+ *
+ * @param op Operation
+ * @param in_w Input width
+ * @param in_h Input height
+ * @param out_w Output width
+ * @param out_h Output height
+ */
+static void op_geometry(const Op *op, int in_w, int in_h, int *out_w,
+                        int *out_h) {
+  int w = in_w, h = in_h;
+  switch (op->type) {
+  case OP_ROTATE: {
+    // quarter turns of a non-square image swap the canvas dimensions
+    float turns = op->value / 90.0f;
+    if (turns == rintf(turns) && fabsf(turns) < 1e6f && (int)turns % 2 != 0)
+      w = in_h, h = in_w;
+    break;
+  }
+  case OP_RESIZE:
+    w = op->width ? op->width : (int)lrint((double)in_w * op->height / in_h);
+    h = op->height ? op->height : (int)lrint((double)in_h * op->width / in_w);
+    w = w < 1 ? 1 : w;
+    h = h < 1 ? 1 : h;
+    break;
+  default:
+    break;
+  }
+  *out_w = w;
+  *out_h = h;
+}
+
+/**
+ * Applies one operation to an image
+ *
+ * The operator writes into scratch, which is then exchanged with img, so a
+ * chain ping-pongs between two buffers. Operations that change the geometry
+ * (resize, quarter turns of non-square images) reshape scratch first, which
+ * keeps its block whenever it is large enough.
+ *
+ * @param op Operation to apply
+ * @param img Input image; holds the result on success and is unchanged on
+ * failure
+ * @param scratch Work buffer of any geometry (may be empty)
+ * @param num_threads Number of row blocks per operator
+ *
+ * @return 0 on success, -1 on failure
+ */
+int op_run(const Op *op, Image *img, Image *scratch, int num_threads) {
+  int w, h, ch = img->channels;
+  int rc;
+  op_geometry(op, img->width, img->height, &w, &h);
+  if (image_reshape(scratch, w, h, ch) != 0) {
+    fprintf(stderr, "Failed to allocate %dx%dx%d buffer\n", w, h, ch);
+    return -1;
+  }
+
+  switch (op->type) {
+  case OP_BLUR:
+    // n passes of the 3x3 box have variance n * (3^2 - 1) / 12; the
+    // Gaussian mode matches it in one pass whose cost does not grow with n
+    rc = op->n == 1 ? box_blur_concurrent(img, scratch, 1, num_threads)
+                    : gaussian_blur_concurrent(img, scratch,
+                                               sqrtf(op->n * 8.0f / 12.0f),
+                                               num_threads);
+    break;
+  case OP_BOX:
+    rc = box_blur_concurrent(img, scratch, op->n, num_threads);
+    break;
+  case OP_GAUSS:
+    rc = gaussian_blur_concurrent(img, scratch, op->value, num_threads);
+    break;
+  case OP_SOBEL:
+    rc = sobel_concurrent(img, scratch, num_threads);
+    break;
+  case OP_ROTATE:
+    rc = w != img->width ? rotate90_concurrent(img, scratch,
+                                               (int)(op->value / 90.0f),
+                                               num_threads)
+                         : rotate_concurrent(img, scratch, op->value,
+                                             num_threads);
+    break;
+  case OP_FLIP:
+    rc = flip_concurrent(img, scratch, op->axis, num_threads);
+    break;
+  case OP_RESIZE:
+    rc = resize_filter_concurrent(img, scratch, op->filter, num_threads);
+    break;
+  default:
+    rc = -1;
+  }
+  if (rc != 0)
+    return -1;
+  Image tmp = *img;
+  *img = *scratch;
+  *scratch = tmp;
+  return 0;
+}
+
+/**
+ * Prepares one operation as a pipeline stage
+ *
+ * @param op Operation
+ * @param w Input width
+ * @param h Input height
+ * @param ch Number of channels
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int op_stage(const Op *op, int w, int h, int ch, PipelineStage *st) {
+  int ow, oh;
+  switch (op->type) {
+  case OP_BLUR:
+    // same box / Gaussian choice as op_run
+    return op->n == 1 ? box_blur_stage(w, h, ch, 1, st)
+                      : gaussian_blur_stage(w, h, ch,
+                                            sqrtf(op->n * 8.0f / 12.0f), st);
+  case OP_BOX:
+    return box_blur_stage(w, h, ch, op->n, st);
+  case OP_GAUSS:
+    return gaussian_blur_stage(w, h, ch, op->value, st);
+  case OP_SOBEL:
+    return sobel_stage(w, h, ch, st);
+  case OP_ROTATE:
+    return rotate_stage(w, h, ch, op->value, st);
+  case OP_FLIP:
+    return flip_stage(w, h, ch, op->axis, st);
+  case OP_RESIZE:
+    op_geometry(op, w, h, &ow, &oh);
+    return resize_stage(w, h, ch, ow, oh, op->filter, st);
+  default:
+    return -1;
+  }
+}
+
+/**
+ * Prepares the stages of a whole chain
+ *
+ * @param chain Operations in order
+ * @param w Input width
+ * @param h Input height
+ * @param ch Number of channels
+ * @param stages Array of chain->count stages to fill; on failure the stages
+ * already prepared are released
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int chain_stages(const OpChain *chain, int w, int h, int ch,
+                        PipelineStage *stages) {
+  for (int i = 0; i < chain->count; i++) {
+    if (op_stage(&chain->ops[i], w, h, ch, &stages[i]) != 0) {
+      fprintf(stderr, "Failed to prepare operation %d\n", i + 1);
+      while (i-- > 0)
+        pipeline_stage_release(&stages[i]);
+      return -1;
+    }
+    w = stages[i].width;
+    h = stages[i].height;
+  }
+  return 0;
+}
+
+/**
+ * Applies an operation chain to an image
+ *
+ * The chain runs through pipeline_run, which fuses consecutive row-local
+ * operations into strip-sized tiles, so intermediate images are only
+ * materialized in front of transposes and large rotations. The result is
+ * identical to applying the operations one by one with op_run.
+ *
+ * @param chain Operations to apply in order
+ * @param img Image to transform; holds the result on success
+ * @param num_threads Number of pool tasks per fused segment
+ *
+ * @return 0 on success, -1 on failure (img is then unchanged)
+ */
+int ops_apply(const OpChain *chain, Image *img, int num_threads) {
+  PipelineStage *stages =
+      (PipelineStage *)calloc(chain->count, sizeof(PipelineStage));
+  if (!stages) {
+    fprintf(stderr, "Failed to allocate pipeline stages\n");
+    return -1;
+  }
+  int n = chain->count, ch = img->channels;
+  if (chain_stages(chain, img->width, img->height, ch, stages) != 0) {
+    free(stages);
+    return -1;
+  }
+  int w = stages[n - 1].width, h = stages[n - 1].height;
+  Image out = {0};
+  int rc = image_alloc_uninit(&out, w, h, ch);
+  if (rc != 0)
+    fprintf(stderr, "Failed to allocate %dx%dx%d buffer\n", w, h, ch);
+  else
+    rc = pipeline_run(stages, n, img, &out, num_threads);
+  if (rc == 0) {
+    image_free(img);
+    *img = out;
+  } else {
+    image_free(&out);
+  }
+  for (int i = 0; i < n; i++)
+    pipeline_stage_release(&stages[i]);
+  free(stages);
+  return rc;
+}
+
+/**
+ * Resizes an image to every size of a list
+ *
+ * All outputs come from one pyramid_resize_concurrent call, so the image is
+ * read once at full resolution however many sizes are listed.
+ *
+ * @param sizes List of OP_RESIZE operations (see ops_parse_sizes)
+ * @param img Image to resize
+ * @param outs Array of sizes->count images to fill; release each with
+ * image_free. They are left empty on failure.
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure
+ */
+int ops_resize_sizes(const OpChain *sizes, const Image *img, Image *outs,
+                     int num_threads) {
+  int n = sizes->count, ch = img->channels, rc = 0;
+  ResizeFilter *filters = (ResizeFilter *)calloc(n, sizeof(ResizeFilter));
+  for (int i = 0; i < n; i++) {
+    Image empty = {0};
+    outs[i] = empty;
+  }
+  if (!filters) {
+    fprintf(stderr, "Failed to allocate the size list\n");
+    return -1;
+  }
+  for (int i = 0; rc == 0 && i < n; i++) {
+    int w, h;
+    op_geometry(&sizes->ops[i], img->width, img->height, &w, &h);
+    filters[i] = sizes->ops[i].filter;
+    if ((rc = image_alloc_uninit(&outs[i], w, h, ch)) != 0)
+      fprintf(stderr, "Failed to allocate %dx%dx%d buffer\n", w, h, ch);
+  }
+  if (rc == 0)
+    rc = pyramid_resize_concurrent(img, outs, filters, n, num_threads);
+  if (rc != 0)
+    for (int i = 0; i < n; i++)
+      image_free(&outs[i]);
+  free(filters);
+  return rc;
+}
+
+/**
+ * Chooses the file an output is written to
+ *
+ * Creating the output truncates it, which would destroy an input that is the
+ * same file (same path or a hard link: same device and inode) while it is
+ * still mapped or streamed. The output then goes to a new file in the same
+ * directory, with the extension and permissions of out_path, and end_output
+ * renames it over out_path once complete.
+ *
+ * @param in_path Input file
+ * @param out_path Requested output file
+ * @param tmp Buffer of PATH_MAX bytes receiving the temporary name
+ *
+ * @return out_path or tmp, NULL if the temporary file cannot be created (an
+ * error is printed to stderr)
+ */
+static const char *begin_output(const char *in_path, const char *out_path,
+                                char *tmp) {
+  struct stat in, out;
+  if (stat(in_path, &in) != 0 || stat(out_path, &out) != 0 ||
+      in.st_dev != out.st_dev || in.st_ino != out.st_ino)
+    return out_path;
+  const char *base = strrchr(out_path, '/');
+  const char *ext = strrchr(base ? base : out_path, '.');
+  if (!ext)
+    ext = out_path + strlen(out_path);
+  int fd = -1;
+  if (snprintf(tmp, PATH_MAX, "%.*s.XXXXXX%s", (int)(ext - out_path),
+               out_path, ext) < PATH_MAX)
+    fd = mkstemps(tmp, (int)strlen(ext));
+  if (fd < 0) {
+    fprintf(stderr, "Cannot create a temporary file for %s\n", out_path);
+    return NULL;
+  }
+  fchmod(fd, out.st_mode & 07777);
+  close(fd);
+  return tmp;
+}
+
+/**
+ * Completes an output opened with begin_output
+ *
+ * @param target Path returned by begin_output
+ * @param out_path Requested output file
+ * @param rc Result of writing target
+ *
+ * @return rc, or -1 if the temporary file cannot be renamed; a temporary
+ * file is removed on failure
+ */
+static int end_output(const char *target, const char *out_path, int rc) {
+  if (target == out_path)
+    return rc;
+  if (rc == 0 && rename(target, out_path) != 0) {
+    perror(out_path);
+    rc = -1;
+  }
+  if (rc != 0)
+    remove(target);
+  return rc;
+}
+
+/**
+ * Applies an operation chain to a PNM file without loading it
+ *
+ * Rows are read, transformed and written by pipeline_stream, so peak memory
+ * depends on the image width and the chain, not on the image height. Only
+ * chains of row-local operations that read their input top to bottom can be
+ * streamed (no vertical flips, 180-degree or quarter turns). When out_path
+ * is the input file itself, rows are streamed to a temporary file renamed
+ * over it on success, so the input is never truncated or removed.
+ *
+ * @param chain Operations to apply in order
+ * @param in_path Input file (P5, P6 or P7)
+ * @param out_path Output file, written in the matching PNM format
+ * @param num_threads Number of strips processed in parallel
+ * @param width Output width (may be NULL)
+ * @param height Output height (may be NULL)
+ * @param channels Output channel count (may be NULL)
+ *
+ * @return 0 on success, -1 on failure (an error is printed to stderr; a
+ * partially written output file is removed)
+ */
+int ops_stream(const OpChain *chain, const char *in_path, const char *out_path,
+               int num_threads, int *width, int *height, int *channels) {
+  PnmStream in, out = {0};
+  char tmp[PATH_MAX];
+  if (pnm_open_read(in_path, &in) != 0)
+    return -1;
+  PipelineStage *stages =
+      (PipelineStage *)calloc(chain->count, sizeof(PipelineStage));
+  int n = chain->count, ch = in.channels;
+  int rc = stages ? chain_stages(chain, in.width, in.height, ch, stages) : -1;
+  if (rc == 0) {
+    int w = stages[n - 1].width, h = stages[n - 1].height;
+    const char *target = begin_output(in_path, out_path, tmp);
+    rc = target ? pnm_open_write(target, w, h, ch, &out) : -1;
+    if (rc == 0)
+      rc = pipeline_stream(stages, n, pnm_read_rows, &in, pnm_write_rows, &out,
+                           num_threads);
+    if (pnm_close(&out) != 0)
+      rc = -1;
+    if (target) {
+      if (rc != 0)
+        remove(target);
+      rc = end_output(target, out_path, rc);
+    }
+    if (width)
+      *width = w;
+    if (height)
+      *height = h;
+    if (channels)
+      *channels = ch;
+    for (int i = 0; i < n; i++)
+      pipeline_stage_release(&stages[i]);
+  }
+  free(stages);
+  pnm_close(&in);
+  return rc;
+}
+
+/**
+ * Applies a chain from one mapped file to another
+ *
+ * The input pixels are read in place from the page cache and the pipeline
+ * writes its output straight into the mapped output file, so no decoder,
+ * encoder or staging buffer is involved. Any chain is accepted (unlike
+ * ops_stream, the whole input is addressable). When out_path is the input
+ * file itself, the output is mapped from a temporary file renamed over it on
+ * success (see begin_output).
+ *
+ * @param chain Operations to apply in order
+ * @param in_path Input file (Netpbm or IMRAW, see mapped_io.h)
+ * @param out_path Output file; its extension selects the format
+ * @param num_threads Number of pool tasks per segment
+ * @param width Output width (may be NULL)
+ * @param height Output height (may be NULL)
+ * @param channels Output channel count (may be NULL)
+ *
+ * @return 0 on success, or the OpsError of the step that failed (an error is
+ * printed to stderr; a partially written output file is removed)
+ */
+int ops_map(const OpChain *chain, const char *in_path, const char *out_path,
+            int num_threads, int *width, int *height, int *channels) {
+  Image in, out = {0};
+  char tmp[PATH_MAX];
+  if (image_map_read(in_path, &in) != 0)
+    return OPS_ERR_READ;
+  PipelineStage *stages =
+      (PipelineStage *)calloc(chain->count, sizeof(PipelineStage));
+  int n = chain->count, ch = in.channels;
+  int rc = stages && chain_stages(chain, in.width, in.height, ch, stages) == 0
+               ? 0
+               : OPS_ERR_PROCESS;
+  if (rc == 0) {
+    int w = stages[n - 1].width, h = stages[n - 1].height;
+    const char *target = begin_output(in_path, out_path, tmp);
+    if (!target || image_map_write(target, w, h, ch, &out) != 0)
+      rc = OPS_ERR_WRITE;
+    if (rc == 0) {
+      if (pipeline_run(stages, n, &in, &out, num_threads) != 0)
+        rc = OPS_ERR_PROCESS;
+      image_free(&out);
+      if (rc != 0)
+        remove(target);
+      if (end_output(target, out_path, rc) != 0 && rc == 0)
+        rc = OPS_ERR_WRITE;
+    }
+    if (width)
+      *width = w;
+    if (height)
+      *height = h;
+    if (channels)
+      *channels = ch;
+    for (int i = 0; i < n; i++)
+      pipeline_stage_release(&stages[i]);
+  }
+  free(stages);
+  image_free(&in);
+  return rc;
+}
+
+/**
+ * Applies a chain to one image file and saves the result
+ *
+ * PNG and mapped files (Netpbm, IMRAW) can be mixed. When both sides are
+ * mapped the work goes through ops_map, so the output file is written in
+ * place; otherwise the image is loaded, transformed by ops_apply and saved.
+ * An output that is the input file itself is written to a temporary file
+ * and renamed over it, so in-place runs keep their input intact until done.
+ *
+ * @param chain Operations to apply in order; may be empty to convert formats
+ * @param in_path Input file
+ * @param out_path Output file; its extension selects the format
+ * @param num_threads Number of pool tasks per segment
+ * @param png_level Compression level of a PNG output
+ * @param width Output width (may be NULL)
+ * @param height Output height (may be NULL)
+ * @param channels Output channel count (may be NULL)
+ *
+ * @return 0 on success, or the OpsError of the step that failed (an error is
+ * printed to stderr)
+ */
+int ops_file(const OpChain *chain, const char *in_path, const char *out_path,
+             int num_threads, int png_level, int *width, int *height,
+             int *channels) {
+  if (chain->count > 0 && mapped_path(in_path) && mapped_path(out_path))
+    return ops_map(chain, in_path, out_path, num_threads, width, height,
+                   channels);
+  Image img = {0};
+  int rc = (mapped_path(in_path) ? image_map_read(in_path, &img)
+                                 : loadPNG(in_path, &img)) == 0
+               ? 0
+               : OPS_ERR_READ;
+  if (rc == 0 && chain->count > 0 &&
+      ops_apply(chain, &img, num_threads) != 0) {
+    fprintf(stderr, "%s: processing failed\n", in_path);
+    rc = OPS_ERR_PROCESS;
+  }
+  if (rc == 0) {
+    char tmp[PATH_MAX];
+    const char *target = begin_output(in_path, out_path, tmp);
+    int saved = !target                 ? -1
+                : mapped_path(out_path) ? image_map_save(target, &img)
+                                        : savePNG(target, &img, png_level);
+    if (!target || end_output(target, out_path, saved) != 0) {
+      fprintf(stderr, "%s: could not save %s\n", in_path, out_path);
+      rc = OPS_ERR_WRITE;
+    }
+  }
+  if (rc == 0) {
+    if (width)
+      *width = img.width;
+    if (height)
+      *height = img.height;
+    if (channels)
+      *channels = img.channels;
+  }
+  image_free(&img);
+  return rc;
+}
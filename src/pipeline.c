@@ -0,0 +1,574 @@
+#include "pipeline.h"
+#include "buffer_pool.h"
+#include "profile.h"
+#include "thread_pool.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scratch budget of one strip (all intermediates plus output rows); sized so
+// that a strip and its halos stay in a per-core L2 cache
+#define PIPE_STRIP_BYTES (1024 * 1024)
+#define PIPE_MIN_ROWS 16
+#define PIPE_MAX_ROWS 256
+
+// Strips are at least this many times taller than the rows their halos add,
+// which bounds the recomputed fraction of a strip (1 / PIPE_HALO_RATIO)
+#define PIPE_HALO_RATIO 4
+
+// Longest run of stages fused into one segment
+#define PIPE_MAX_STAGES 16
+
+/**
+ * Input rows a stage needs for a range of its output rows
+ *
+ * @param st Stage
+ * @param y0 First output row
+ * @param y1 One past the last output row
+ * @param lo First needed input row
+ * @param hi One past the last needed input row
+ */
+static void stage_footprint(const PipelineStage *st, int y0, int y1, int *lo,
+                            int *hi) {
+  if (st->footprint) {
+    st->footprint(st, y0, y1, lo, hi);
+    return;
+  }
+  int h = st->args.height;
+  *lo = y0 - st->halo < 0 ? 0 : y0 - st->halo;
+  *hi = y1 + st->halo > h ? h : y1 + st->halo;
+}
+
+/**
+ * Input rows read for the middle output row of a stage
+ *
+ * @param st Stage
+ * @return Height of the footprint of one output row
+ */
+static int stage_span(const PipelineStage *st) {
+  int mid = st->height / 2, lo, hi;
+  stage_footprint(st, mid, mid + 1, &lo, &hi);
+  return hi - lo;
+}
+
+/**
+ * Tells whether a stage can join the segment that produces its input
+ *
+ * Fusing recomputes the rows of the previous stages that a strip needs, so
+ * it only pays off for operators whose output rows depend on a narrow band
+ * of input rows (filters, resize, flips, small rotations). Transposes and
+ * large rotations read most of their input for every strip and start a new
+ * segment on a fully materialized image instead.
+ *
+ * @param st Stage to test
+ * @return Nonzero if the stage is row-local enough to be fused
+ */
+static int stage_fusable(const PipelineStage *st) {
+  int span = stage_span(st);
+  return span <= PIPE_MAX_ROWS && span <= st->args.height / 2;
+}
+
+/**
+ * Tells whether a stage can run from a sliding input window
+ *
+ * Either an output row reads few input rows, or the rows it reads move down
+ * the input with the output row (strong reductions). Transposes and large
+ * rotations read the same full-height band for every output row.
+ *
+ * @param st Stage to test
+ * @return Nonzero if the window of the stage stays narrow or slides
+ */
+static int stage_streamable(const PipelineStage *st) {
+  int lo0, hi0, lo1, hi1;
+  stage_footprint(st, 0, 1, &lo0, &hi0);
+  stage_footprint(st, st->height - 1, st->height, &lo1, &hi1);
+  return stage_span(st) <= PIPE_MAX_ROWS || lo1 > lo0;
+}
+
+/**
+ * One fused segment: stages run strip by strip from src to dst
+ */
+typedef struct {
+  const PipelineStage *stages;
+  int n;
+  const Image *src;
+  int src_y0; // first segment input row held by src
+  Image *dst;
+  int dst_y0; // first output row held by dst
+  int height; // output height of the segment
+  int strip_rows;
+  int end_strip;              // one past the last strip of this run
+  atomic_int next_strip;      // first strip not yet claimed by a task
+  size_t scratch_bytes;       // largest intermediate buffer of any strip
+  unsigned char **scratch;    // 2 buffers per task, or NULL to allocate
+  uint64_t *task_ns;          // time of every task when profiling
+  atomic_int failed;
+} PipeJob;
+
+/**
+ * Computes the row ranges every stage of a segment produces for one strip
+ *
+ * @param job Segment
+ * @param strip Strip index
+ * @param lo lo[i + 1] is the first output row of stage i; lo[0] the first
+ * row read from the segment input
+ * @param hi One past the last rows, same layout
+ */
+static void strip_ranges(const PipeJob *job, int strip, int *lo, int *hi) {
+  int n = job->n;
+  lo[n] = strip * job->strip_rows;
+  hi[n] = lo[n] + job->strip_rows;
+  hi[n] = hi[n] > job->height ? job->height : hi[n];
+  for (int i = n - 1; i >= 0; i--)
+    stage_footprint(&job->stages[i], lo[i + 1], hi[i + 1], &lo[i], &hi[i]);
+}
+
+/**
+ * Largest intermediate buffer any strip of [first, end) needs
+ *
+ * @param job Segment
+ * @param first First strip
+ * @param end One past the last strip
+ * @return Size in bytes (0 for a single stage)
+ */
+static size_t strip_scratch_bytes(const PipeJob *job, int first, int end) {
+  int lo[PIPE_MAX_STAGES + 1], hi[PIPE_MAX_STAGES + 1];
+  size_t max = 0;
+  for (int s = first; s < end; s++) {
+    strip_ranges(job, s, lo, hi);
+    for (int i = 0; i + 1 < job->n; i++) {
+      const PipelineStage *st = &job->stages[i];
+      size_t bytes =
+          (size_t)(hi[i + 1] - lo[i + 1]) * st->width * st->args.channels;
+      max = bytes > max ? bytes : max;
+    }
+  }
+  return max;
+}
+
+/**
+ * Picks the strip height of a segment
+ *
+ * Strips target PIPE_STRIP_BYTES of rows across all stages, but are at least
+ * PIPE_HALO_RATIO times taller than the rows the halos add, and small enough
+ * that every one of num_threads tasks gets one.
+ *
+ * @param stages First stage of the segment
+ * @param n Number of stages
+ * @param height Output height of the segment
+ * @param num_threads Number of pool tasks
+ * @return Rows per strip
+ */
+static int strip_rows(const PipelineStage *stages, int n, int height,
+                      int num_threads) {
+  size_t row_bytes = 0;
+  for (int i = 0; i < n; i++)
+    row_bytes += (size_t)stages[i].width * stages[i].args.channels;
+  // rows a one-row strip pulls in through the halos of all stages
+  int r0 = height / 2, r1 = r0 + 1;
+  for (int i = n - 1; i >= 0; i--)
+    stage_footprint(&stages[i], r0, r1, &r0, &r1);
+  size_t rows = PIPE_STRIP_BYTES / row_bytes;
+  size_t min_rows = (size_t)(r1 - r0 - 1) * PIPE_HALO_RATIO;
+  min_rows = min_rows < PIPE_MIN_ROWS ? PIPE_MIN_ROWS : min_rows;
+  rows = rows < min_rows ? min_rows : rows;
+  rows = rows > PIPE_MAX_ROWS ? PIPE_MAX_ROWS : rows;
+  int per_thread = (height + num_threads - 1) / num_threads;
+  if ((int)rows > per_thread)
+    rows = per_thread < 1 ? 1 : per_thread;
+  return (int)rows;
+}
+
+/**
+ * Runs every stage of a segment over one strip
+ *
+ * Intermediate rows live in two ping-pong scratch buffers that hold exactly
+ * the rows the next stage needs (the strip plus halos); the workers address
+ * them through WorkArgs.src_y0 / dst_y0. The last stage writes its rows
+ * straight into the segment output.
+ *
+ * @param job Segment
+ * @param strip Strip index
+ * @param buf Two scratch buffers of job->scratch_bytes (unused when the
+ * segment has a single stage)
+ *
+ * @return 0 on success, -1 if a worker failed
+ */
+static int run_strip(const PipeJob *job, int strip, unsigned char *buf[2]) {
+  int n = job->n;
+  int lo[PIPE_MAX_STAGES + 1], hi[PIPE_MAX_STAGES + 1];
+  strip_ranges(job, strip, lo, hi);
+
+  const Image *in = job->src;
+  int in_y0 = job->src_y0;
+  Image view[2];
+  for (int i = 0; i < n; i++) {
+    const PipelineStage *st = &job->stages[i];
+    WorkArgs a = st->args;
+    a.src = in;
+    a.src_y0 = in_y0;
+    a.y0 = lo[i + 1];
+    a.y1 = hi[i + 1];
+    if (i == n - 1) {
+      a.dst = job->dst;
+      a.dst_y0 = job->dst_y0;
+    } else {
+      Image *v = &view[i % 2];
+      v->data = buf[i % 2];
+      v->width = st->width;
+      v->height = a.y1 - a.y0;
+      v->channels = a.channels;
+      v->stride = (size_t)st->width * a.channels;
+      a.dst = v;
+      a.dst_y0 = a.y0;
+    }
+    uint64_t t0 = profile_enabled() ? profile_now() : 0;
+    if (a.y0 < a.y1 && st->worker(&a) == WORKER_FAILED)
+      return -1;
+    if (profile_enabled())
+      profile_task(a.name, profile_now() - t0, a.y1 - a.y0);
+    in = a.dst;
+    in_y0 = a.dst_y0;
+  }
+  return 0;
+}
+
+/**
+ * Pool task body: claims strips from the job until none are left
+ *
+ * The scratch buffers are allocated once per task (or provided by the job)
+ * and reused by all of its strips, so they stay resident in cache and are
+ * not faulted in again for every strip.
+ *
+ * @param ctx Pointer to the PipeJob
+ * @param task Band index
+ */
+static void run_band(void *ctx, int task) {
+  PipeJob *job = (PipeJob *)ctx;
+  uint64_t t0 = job->task_ns ? profile_now() : 0;
+  unsigned char *buf[2] = {NULL, NULL};
+  if (job->scratch) {
+    buf[0] = job->scratch[2 * task];
+    buf[1] = job->scratch[2 * task + 1];
+  } else if (job->n > 1) {
+    buf[0] = (unsigned char *)buffer_pool_get(job->scratch_bytes, 0, NULL);
+    buf[1] = (unsigned char *)buffer_pool_get(job->scratch_bytes, 0, NULL);
+    if (!buf[0] || !buf[1]) {
+      buffer_pool_put(buf[0], job->scratch_bytes);
+      buffer_pool_put(buf[1], job->scratch_bytes);
+      atomic_store(&job->failed, 1);
+      return;
+    }
+  }
+  // strips are claimed one at a time, so a band that hits expensive rows
+  // (a rotation corner, a heavy resampling region) does not hold the others
+  for (int s; !atomic_load(&job->failed) &&
+              (s = atomic_fetch_add(&job->next_strip, 1)) < job->end_strip;)
+    if (run_strip(job, s, buf) != 0)
+      atomic_store(&job->failed, 1);
+  if (!job->scratch) {
+    buffer_pool_put(buf[0], job->scratch_bytes);
+    buffer_pool_put(buf[1], job->scratch_bytes);
+  }
+  if (job->task_ns)
+    job->task_ns[task] = profile_now() - t0;
+}
+
+/**
+ * Runs tasks [0, tasks) of a job on the pool, recording their balance under
+ * "pipeline" when profiling
+ *
+ * @param pool Thread pool
+ * @param job Segment or batch to run
+ * @param tasks Number of bands
+ * @param rows Output rows produced by the bands
+ */
+static void run_bands(ThreadPool *pool, PipeJob *job, int tasks, int rows) {
+  uint64_t t0 = 0;
+  if (profile_enabled()) {
+    job->task_ns = (uint64_t *)calloc(tasks, sizeof(uint64_t));
+    t0 = profile_now();
+  }
+  thread_pool_parallel_for(pool, tasks, run_band, job);
+  if (job->task_ns) {
+    uint64_t max = 0, sum = 0;
+    for (int i = 0; i < tasks; i++) {
+      max = job->task_ns[i] > max ? job->task_ns[i] : max;
+      sum += job->task_ns[i];
+    }
+    profile_launch("pipeline", tasks, max, sum);
+    profile_record("pipeline", profile_now() - t0, rows, 0);
+    free(job->task_ns);
+    job->task_ns = NULL;
+  }
+}
+
+/**
+ * Runs one fused segment over the default pool
+ *
+ * @param stages First stage of the segment
+ * @param n Number of stages (at most PIPE_MAX_STAGES)
+ * @param src Segment input (full image)
+ * @param dst Segment output (full image)
+ * @param num_threads Number of bands of strips submitted to the pool
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int run_segment(const PipelineStage *stages, int n, const Image *src,
+                       Image *dst, int num_threads) {
+  PipeJob job = {.stages = stages,
+                 .n = n,
+                 .src = src,
+                 .dst = dst,
+                 .height = dst->height,
+                 .strip_rows = strip_rows(stages, n, dst->height, num_threads)};
+  atomic_init(&job.failed, 0);
+  job.end_strip = (dst->height + job.strip_rows - 1) / job.strip_rows;
+  atomic_init(&job.next_strip, 0);
+  int bands = num_threads < job.end_strip ? num_threads : job.end_strip;
+  job.scratch_bytes = strip_scratch_bytes(&job, 0, job.end_strip);
+  ThreadPool *pool = thread_pool_default();
+  if (!pool) {
+    fprintf(stderr, "Failed to create thread pool\n");
+    return -1;
+  }
+  run_bands(pool, &job, bands, dst->height);
+  return atomic_load(&job.failed) ? -1 : 0;
+}
+
+/**
+ * Frees the operator-private state of a stage
+ *
+ * @param st Stage to release; safe to call on a zeroed stage
+ */
+void pipeline_stage_release(PipelineStage *st) {
+  if (st->release)
+    st->release(st->state);
+  else
+    free(st->state);
+  st->state = NULL;
+}
+
+/**
+ * Runs a chain of operator stages with tile (row-strip) fusion
+ *
+ * The chain is split into segments of row-local stages. Each segment cuts
+ * its output into strips and hands num_threads bands of consecutive strips
+ * to the pool. For every strip a task walks back through the stages to
+ * find the input rows every stage needs (each stage's halo or computed
+ * footprint), then produces them front to back in private scratch buffers
+ * sized to stay in L2, so intermediates never travel through DRAM. A stage
+ * that needs most of its input for every strip (transposes, large
+ * rotations) starts a new segment, and the previous segment's output is
+ * materialized as a full image for it.
+ *
+ * @param stages Stages in application order; stage i + 1 must accept the
+ * output geometry of stage i
+ * @param n Number of stages
+ * @param src Input image, matching the input geometry of stages[0]
+ * @param dst Output image, shaped like the output of stages[n - 1]
+ * @param num_threads Number of pool tasks per segment, each walking a band of
+ * consecutive strips
+ *
+ * @return 0 on success, -1 on failure (allocation or worker failure)
+ */
+int pipeline_run(const PipelineStage *stages, int n, const Image *src,
+                 Image *dst, int num_threads) {
+  if (n < 1)
+    return -1;
+  if (num_threads < 1)
+    num_threads = 1;
+  const Image *in = src;
+  Image tmp[2] = {{0}, {0}};
+  int rc = 0, s = 0, seg = 0;
+  while (s < n && rc == 0) {
+    int e = s + 1;
+    while (e < n && e - s < PIPE_MAX_STAGES && stage_fusable(&stages[e]))
+      e++;
+    Image *out = dst;
+    if (e < n) {
+      out = &tmp[seg % 2];
+      if (image_reshape(out, stages[e - 1].width, stages[e - 1].height,
+                        src->channels) != 0) {
+        fprintf(stderr, "Pipeline: failed to allocate intermediate image\n");
+        rc = -1;
+        break;
+      }
+    }
+    rc = run_segment(stages + s, e - s, in, out, num_threads);
+    in = out;
+    s = e;
+    seg++;
+  }
+  image_free(&tmp[0]);
+  image_free(&tmp[1]);
+  return rc;
+}
+
+/**
+ * Footprint of the strips [first, end) on the pipeline input
+ */
+static void batch_window(const PipeJob *job, int first, int end, int *lo,
+                         int *hi) {
+  int l[PIPE_MAX_STAGES + 1], h[PIPE_MAX_STAGES + 1];
+  strip_ranges(job, first, l, h);
+  *lo = l[0];
+  strip_ranges(job, end - 1, l, h);
+  *hi = h[0];
+}
+
+/**
+ * Runs a chain of row-local stages from a row source to a row sink
+ *
+ * The output is produced in batches of num_threads strips. Before each batch
+ * the input rows it needs are read into a sliding window: rows that the
+ * batch no longer needs are dropped, the overlap (the halos shared with the
+ * previous batch) is moved to the front and only new rows are read. The
+ * strips of the batch then run in parallel exactly as in pipeline_run, and
+ * the finished rows are written out in order. Memory is bounded by the
+ * window, the output rows of one batch and the per-task scratch, so it
+ * grows with the image width but not with its height.
+ *
+ * Every stage must be row-local (see stage_streamable) and read its input
+ * top to bottom, i.e. later strips never need earlier input rows; blurs, Sobel,
+ * resize, horizontal flips and small rotations qualify, while vertical
+ * flips, 180-degree turns and transposes do not.
+ *
+ * @param stages Stages in application order (at most PIPE_MAX_STAGES)
+ * @param n Number of stages
+ * @param read Reads the next rows of the input (geometry of stages[0])
+ * @param read_ctx Context passed to read
+ * @param write Appends rows to the output (geometry of stages[n - 1])
+ * @param write_ctx Context passed to write
+ * @param num_threads Number of strips processed in parallel per batch
+ *
+ * @return 0 on success, -1 on failure (a stage that cannot stream, an I/O
+ * error, allocation or worker failure; an error is printed to stderr)
+ */
+int pipeline_stream(const PipelineStage *stages, int n, PipeReadRows read,
+                    void *read_ctx, PipeWriteRows write, void *write_ctx,
+                    int num_threads) {
+  if (n < 1 || n > PIPE_MAX_STAGES) {
+    fprintf(stderr, "Pipeline: %d stages cannot be streamed\n", n);
+    return -1;
+  }
+  for (int i = 0; i < n; i++)
+    if (!stage_streamable(&stages[i])) {
+      fprintf(stderr, "Pipeline: step %d is not row-local\n", i + 1);
+      return -1;
+    }
+  if (num_threads < 1)
+    num_threads = 1;
+  int ch = stages[0].args.channels;
+  int in_w = stages[0].args.width;
+  int out_w = stages[n - 1].width, out_h = stages[n - 1].height;
+  PipeJob job = {.stages = stages,
+                 .n = n,
+                 .height = out_h,
+                 .strip_rows = strip_rows(stages, n, out_h, num_threads)};
+  atomic_init(&job.failed, 0);
+  int nstrips = (out_h + job.strip_rows - 1) / job.strip_rows;
+  int batch = num_threads;
+
+  // the window must slide forward; size it for the widest batch
+  int win_rows = 0, prev_lo = 0, prev_hi = 0;
+  for (int b0 = 0; b0 < nstrips; b0 += batch) {
+    int b1 = b0 + batch < nstrips ? b0 + batch : nstrips;
+    int lo, hi;
+    for (int s = b0; s < b1; s++) {
+      batch_window(&job, s, s + 1, &lo, &hi);
+      if (lo < prev_lo || hi < prev_hi) {
+        fprintf(stderr, "Pipeline: the chain does not read its input top to "
+                        "bottom and cannot be streamed\n");
+        return -1;
+      }
+      prev_lo = lo;
+      prev_hi = hi;
+    }
+    batch_window(&job, b0, b1, &lo, &hi);
+    win_rows = hi - lo > win_rows ? hi - lo : win_rows;
+  }
+  job.scratch_bytes = strip_scratch_bytes(&job, 0, nstrips);
+
+  Image win = {0}, out = {0};
+  unsigned char **scratch =
+      (unsigned char **)calloc(2 * (size_t)batch, sizeof(unsigned char *));
+  int rc = scratch &&
+                   image_alloc_uninit(&win, in_w, win_rows > 0 ? win_rows : 1,
+                                      ch) == 0 &&
+                   image_alloc_uninit(&out, out_w, job.strip_rows * batch,
+                                      ch) == 0
+               ? 0
+               : -1;
+  for (int i = 0; rc == 0 && n > 1 && i < 2 * batch; i++)
+    if (!(scratch[i] = (unsigned char *)buffer_pool_get(job.scratch_bytes, 0,
+                                                        NULL)))
+      rc = -1;
+  if (rc != 0)
+    fprintf(stderr, "Pipeline: failed to allocate stream buffers\n");
+  job.scratch = n > 1 ? scratch : NULL;
+  job.src = &win;
+  job.dst = &out;
+
+  ThreadPool *pool = thread_pool_default();
+  if (rc == 0 && !pool) {
+    fprintf(stderr, "Failed to create thread pool\n");
+    rc = -1;
+  }
+  int win_lo = 0, win_hi = 0; // input rows [win_lo, win_hi) held in win
+  for (int b0 = 0; rc == 0 && b0 < nstrips; b0 += batch) {
+    int b1 = b0 + batch < nstrips ? b0 + batch : nstrips;
+    int lo, hi;
+    batch_window(&job, b0, b1, &lo, &hi);
+    // keep the rows shared with the previous batch, skip unused ones
+    int keep = win_hi > lo ? win_hi - lo : 0;
+    if (keep > 0 && lo > win_lo)
+      memmove(win.data, image_row(&win, lo - win_lo), keep * win.stride);
+    while (rc == 0 && win_hi < lo) {
+      int skip = lo - win_hi < win_rows ? lo - win_hi : win_rows;
+      rc = read(read_ctx, win.data, win.stride, skip);
+      win_hi += skip;
+    }
+    win_lo = lo;
+    uint64_t t0 = profile_enabled() ? profile_now() : 0;
+    if (rc == 0 && hi > win_hi)
+      rc = read(read_ctx, image_row(&win, win_hi - win_lo), win.stride,
+                hi - win_hi);
+    if (profile_enabled() && hi > win_hi)
+      profile_record("stream_read", profile_now() - t0, hi - win_hi,
+                     (size_t)(hi - win_hi) * win.stride);
+    if (rc != 0) {
+      fprintf(stderr, "Pipeline: failed to read input rows\n");
+      break;
+    }
+    win_hi = hi > win_hi ? hi : win_hi;
+
+    job.src_y0 = win_lo;
+    job.dst_y0 = b0 * job.strip_rows;
+    job.end_strip = b1;
+    atomic_store(&job.next_strip, b0);
+    int y1 = b1 * job.strip_rows < out_h ? b1 * job.strip_rows : out_h;
+    run_bands(pool, &job, b1 - b0, y1 - job.dst_y0);
+    if (atomic_load(&job.failed)) {
+      rc = -1;
+      break;
+    }
+    t0 = profile_enabled() ? profile_now() : 0;
+    rc = write(write_ctx, out.data, out.stride, y1 - job.dst_y0);
+    if (profile_enabled())
+      profile_record("stream_write", profile_now() - t0, y1 - job.dst_y0,
+                     (size_t)(y1 - job.dst_y0) * out.stride);
+    if (rc != 0) {
+      fprintf(stderr, "Pipeline: failed to write output rows\n");
+      rc = -1;
+    }
+  }
+
+  for (int i = 0; scratch && i < 2 * batch; i++)
+    buffer_pool_put(scratch[i], job.scratch_bytes);
+  free(scratch);
+  image_free(&win);
+  image_free(&out);
+  return rc;
+}
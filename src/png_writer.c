@@ -0,0 +1,613 @@
+#include "png_writer.h"
+#include "buffer_pool.h"
+#include "profile.h"
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Filtered bytes per strip; every strip is filtered and deflated by one task
+#define PNG_STRIP_BYTES (256 * 1024)
+// stdio buffer of the output file
+#define PNG_IO_BUFFER (1 << 20)
+// Deflate window, also the history a strip inherits from the strips before
+#define LZ_WINDOW 32768
+#define LZ_HASH_BITS 15
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 258
+#define STORED_MAX 65535
+#define ADLER_MOD 65521
+
+/**
+ * Match search effort of one compression level
+ */
+typedef struct {
+  int chain; // candidates examined per position
+  int nice;  // match length that stops the search
+  int lazy;  // also try a match one byte later before emitting
+} LzLevel;
+
+static const LzLevel lz_levels[PNG_LEVEL_MAX + 1] = {
+    {0, 0, 0},     {4, 8, 0},      {8, 16, 0},     {16, 32, 0},
+    {16, 32, 1},   {32, 64, 1},    {64, 128, 1},   {128, 258, 1},
+    {512, 258, 1}, {2048, 258, 1}};
+
+static const uint16_t len_base[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                      11, 13, 15, 17,  19,  23,  27,  31,
+                                      35, 43, 51, 59,  67,  83,  99,  115,
+                                      131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                      1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                      4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Fixed Huffman codes (bit-reversed for the LSB-first stream), the length
+// and distance symbol of every match length and distance, and the CRC table
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static uint16_t lit_code[288];
+static uint8_t lit_bits[288];
+static uint8_t dist_code[30];
+static uint8_t len_sym[LZ_MAX_MATCH + 1];
+static uint8_t dist_sym_small[257];  // distances 1..256
+static uint8_t dist_sym_large[256];  // (distance - 1) >> 7 for larger ones
+static uint32_t crc_table[256];
+
+static unsigned reverse_bits(unsigned code, int bits) {
+  unsigned r = 0;
+  for (int i = 0; i < bits; i++, code >>= 1)
+    r = r << 1 | (code & 1);
+  return r;
+}
+
+static void tables_init(void) {
+  for (int v = 0; v < 288; v++) {
+    int bits = v < 144 ? 8 : v < 256 ? 9 : v < 280 ? 7 : 8;
+    int code = v < 144   ? 0x30 + v
+               : v < 256 ? 0x190 + (v - 144)
+               : v < 280 ? v - 256
+                         : 0xC0 + (v - 280);
+    lit_code[v] = (uint16_t)reverse_bits(code, bits);
+    lit_bits[v] = (uint8_t)bits;
+  }
+  for (int i = 0; i < 30; i++)
+    dist_code[i] = (uint8_t)reverse_bits(i, 5);
+  for (int i = 0; i < 29; i++)
+    for (int len = len_base[i]; len < len_base[i] + (1 << len_extra[i]) &&
+                                len <= LZ_MAX_MATCH;
+         len++)
+      len_sym[len] = (uint8_t)i;
+  len_sym[LZ_MAX_MATCH] = 28; // 258 has its own symbol
+  for (int i = 0; i < 30; i++)
+    for (int d = dist_base[i]; d < dist_base[i] + (1 << dist_extra[i]); d++) {
+      if (d <= 256)
+        dist_sym_small[d] = (uint8_t)i;
+      else
+        dist_sym_large[(d - 1) >> 7] = (uint8_t)i;
+    }
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t crc_update(uint32_t crc, const unsigned char *p, size_t n) {
+  while (n--)
+    crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+/**
+ * Adler-32 of a block, continuing from a previous value (1 for none)
+ */
+static uint32_t adler32(uint32_t adler, const unsigned char *p, size_t n) {
+  uint32_t a = adler & 0xFFFF, b = adler >> 16;
+  while (n > 0) {
+    size_t k = n < 5552 ? n : 5552; // largest run that cannot overflow b
+    n -= k;
+    while (k--) {
+      a += *p++;
+      b += a;
+    }
+    a %= ADLER_MOD;
+    b %= ADLER_MOD;
+  }
+  return b << 16 | a;
+}
+
+/**
+ * Adler-32 of two concatenated blocks from the checksums of each
+ *
+ * @param a1 Checksum of the first block
+ * @param a2 Checksum of the second block
+ * @param len2 Length of the second block
+ * @return Checksum of the concatenation
+ */
+static uint32_t adler32_combine(uint32_t a1, uint32_t a2, size_t len2) {
+  uint32_t s1 = a1 & 0xFFFF, t1 = a1 >> 16;
+  uint32_t s2 = a2 & 0xFFFF, t2 = a2 >> 16;
+  uint32_t rem = (uint32_t)(len2 % ADLER_MOD);
+  uint32_t s = (s1 + s2 + ADLER_MOD - 1) % ADLER_MOD;
+  uint32_t t = (uint32_t)((t1 + t2 + (uint64_t)rem * ((s1 + ADLER_MOD - 1) %
+                                                      ADLER_MOD)) %
+                          ADLER_MOD);
+  return t << 16 | s;
+}
+
+/**
+ * LSB-first bit writer into a buffer large enough for the whole strip
+ */
+typedef struct {
+  unsigned char *out;
+  size_t len;
+  uint64_t bits;
+  int nbits;
+} BitWriter;
+
+static inline void bw_put(BitWriter *bw, uint32_t value, int n) {
+  bw->bits |= (uint64_t)value << bw->nbits;
+  bw->nbits += n;
+  while (bw->nbits >= 8) {
+    bw->out[bw->len++] = (unsigned char)bw->bits;
+    bw->bits >>= 8;
+    bw->nbits -= 8;
+  }
+}
+
+static inline void bw_align(BitWriter *bw) {
+  if (bw->nbits > 0)
+    bw_put(bw, 0, 8 - bw->nbits);
+}
+
+static inline void emit_literal(BitWriter *bw, int v) {
+  bw_put(bw, lit_code[v], lit_bits[v]);
+}
+
+static inline void emit_match(BitWriter *bw, int len, int dist) {
+  int i = len_sym[len];
+  emit_literal(bw, 257 + i);
+  if (len_extra[i])
+    bw_put(bw, len - len_base[i], len_extra[i]);
+  int j = dist <= 256 ? dist_sym_small[dist] : dist_sym_large[(dist - 1) >> 7];
+  bw_put(bw, dist_code[j], 5);
+  if (dist_extra[j])
+    bw_put(bw, dist - dist_base[j], dist_extra[j]);
+}
+
+/**
+ * Hash chains of one strip: head[h] is the latest position with hash h,
+ * prev[p % LZ_WINDOW] the previous position with the same hash as p
+ */
+typedef struct {
+  int32_t *head;
+  int32_t *prev;
+} LzChains;
+
+static inline uint32_t lz_hash(const unsigned char *p) {
+  uint32_t v = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline void lz_insert(LzChains *lz, const unsigned char *buf, int p,
+                             int end) {
+  if (p + LZ_MIN_MATCH > end)
+    return;
+  uint32_t h = lz_hash(buf + p);
+  lz->prev[p & (LZ_WINDOW - 1)] = lz->head[h];
+  lz->head[h] = p;
+}
+
+/**
+ * Finds the longest earlier match of the bytes at p within the window
+ *
+ * @return Match length (0 if shorter than LZ_MIN_MATCH); *dist receives its
+ * distance
+ */
+static int lz_find(const LzChains *lz, const unsigned char *buf, int p,
+                   int end, const LzLevel *cfg, int *dist) {
+  if (p + LZ_MIN_MATCH > end)
+    return 0;
+  int max = end - p < LZ_MAX_MATCH ? end - p : LZ_MAX_MATCH;
+  int best = LZ_MIN_MATCH - 1, chain = cfg->chain;
+  const unsigned char *s = buf + p;
+  int cand = lz->head[lz_hash(s)];
+  while (cand >= 0 && p - cand <= LZ_WINDOW && chain-- > 0) {
+    const unsigned char *c = buf + cand;
+    if (c[best] == s[best] && c[0] == s[0]) {
+      int n = 0;
+      while (n < max && c[n] == s[n])
+        n++;
+      if (n > best) {
+        best = n;
+        *dist = p - cand;
+        if (n >= cfg->nice || n == max)
+          break;
+      }
+    }
+    int next = lz->prev[cand & (LZ_WINDOW - 1)];
+    if (next >= cand) // slot reused by a newer position: chain ends
+      break;
+    cand = next;
+  }
+  return best >= LZ_MIN_MATCH ? best : 0;
+}
+
+/**
+ * Deflates bytes [start, end) of buf as non-final blocks ending on a byte
+ * boundary
+ *
+ * Bytes [0, start) are history: matches may reach back into them, as they
+ * were already emitted by the previous strip. Levels 1 to 9 produce one
+ * fixed-Huffman block closed by an empty stored block (a sync flush); level
+ * 0 produces stored blocks. Either way the output can be concatenated with
+ * the next strip's.
+ *
+ * @param buf Filtered bytes
+ * @param start First byte to compress
+ * @param end One past the last byte
+ * @param level Compression level
+ * @param lz Hash chain storage
+ * @param bw Output
+ */
+static void deflate_strip(const unsigned char *buf, int start, int end,
+                          int level, LzChains *lz, BitWriter *bw) {
+  if (level == 0) {
+    for (int p = start; p < end;) {
+      int n = end - p < STORED_MAX ? end - p : STORED_MAX;
+      bw_put(bw, 0, 3); // not final, stored
+      bw_align(bw);
+      bw_put(bw, n, 16);
+      bw_put(bw, ~n & 0xFFFF, 16);
+      memcpy(bw->out + bw->len, buf + p, n);
+      bw->len += n;
+      p += n;
+    }
+    return;
+  }
+  const LzLevel *cfg = &lz_levels[level];
+  memset(lz->head, 0xFF, sizeof(int32_t) << LZ_HASH_BITS);
+  for (int p = start > LZ_WINDOW ? start - LZ_WINDOW : 0; p < start; p++)
+    lz_insert(lz, buf, p, end);
+  bw_put(bw, 1 << 1, 3); // not final, fixed Huffman
+  int p = start;
+  while (p < end) {
+    int dist = 0, len = lz_find(lz, buf, p, end, cfg, &dist);
+    lz_insert(lz, buf, p, end);
+    if (cfg->lazy && len && len < cfg->nice) {
+      int dist2 = 0, len2 = lz_find(lz, buf, p + 1, end, cfg, &dist2);
+      if (len2 > len) {
+        emit_literal(bw, buf[p++]);
+        lz_insert(lz, buf, p, end);
+        len = len2;
+        dist = dist2;
+      }
+    }
+    if (len) {
+      emit_match(bw, len, dist);
+      for (int q = p + 1; q < p + len; q++)
+        lz_insert(lz, buf, q, end);
+      p += len;
+    } else {
+      emit_literal(bw, buf[p++]);
+    }
+  }
+  emit_literal(bw, 256); // end of block
+  bw_put(bw, 0, 3);      // empty stored block: realigns to a byte boundary
+  bw_align(bw);
+  bw_put(bw, 0, 16);
+  bw_put(bw, 0xFFFF, 16);
+}
+
+static inline int paeth(int a, int b, int c) {
+  int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/**
+ * Filters one row with the given PNG filter type
+ *
+ * @param type 0 none, 1 sub, 2 up, 3 average, 4 Paeth
+ * @param cur Row to filter
+ * @param up Previous row (all zeros for the first row)
+ * @param n Bytes per row
+ * @param bpp Bytes per pixel
+ * @param out Filtered bytes
+ */
+static void filter_row(int type, const unsigned char *cur,
+                       const unsigned char *up, size_t n, int bpp,
+                       unsigned char *out) {
+  for (size_t i = 0; i < n; i++) {
+    int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+    int c = i >= (size_t)bpp ? up[i - bpp] : 0;
+    int pred = type == 0   ? 0
+               : type == 1 ? a
+               : type == 2 ? up[i]
+               : type == 3 ? (a + up[i]) >> 1
+                           : paeth(a, up[i], c);
+    out[i] = (unsigned char)(cur[i] - pred);
+  }
+}
+
+/**
+ * One strip of rows and its compressed IDAT payload
+ */
+typedef struct {
+  int y0, y1;
+  unsigned char *out;
+  size_t out_len, out_cap;
+  uint32_t adler; // Adler-32 of the filtered bytes of the strip
+  uint32_t crc;   // CRC of the IDAT chunk holding out
+} PngStrip;
+
+typedef struct {
+  const Image *img;
+  int level;
+  size_t line; // filter byte plus row bytes
+  PngStrip *strips;
+  atomic_int failed;
+} PngJob;
+
+/**
+ * Filters rows, choosing per row the filter whose output has the smallest
+ * sum of absolute (signed) values (level 0 stores every row unfiltered)
+ *
+ * A row depends only on itself and the row above, so any range of rows
+ * filters to the same bytes wherever it starts.
+ *
+ * @param job Image and level
+ * @param y0 First row
+ * @param y1 One past the last row
+ * @param out Receives job->line bytes per row: filter type, then the row
+ * @param trial Zeroed scratch of 6 row lengths
+ */
+static void filter_rows(const PngJob *job, int y0, int y1, unsigned char *out,
+                        unsigned char *trial) {
+  const Image *img = job->img;
+  size_t n = job->line - 1;
+  const unsigned char *zero = trial + 5 * n;
+  for (int y = y0; y < y1; y++, out += job->line) {
+    const unsigned char *cur = image_row(img, y);
+    const unsigned char *up = y > 0 ? image_row(img, y - 1) : zero;
+    int best = 0;
+    if (job->level > 0) {
+      uint64_t best_sum = UINT64_MAX;
+      for (int t = 0; t < 5; t++) {
+        unsigned char *f = trial + (size_t)t * n;
+        filter_row(t, cur, up, n, img->channels, f);
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++)
+          sum += (uint64_t)abs((signed char)f[i]);
+        if (sum < best_sum) {
+          best_sum = sum;
+          best = t;
+        }
+      }
+      memcpy(out + 1, trial + (size_t)best * n, n);
+    } else {
+      memcpy(out + 1, cur, n);
+    }
+    out[0] = (unsigned char)best;
+  }
+}
+
+/**
+ * Pool task: filters one strip, deflates it with the preceding filtered
+ * bytes as history and checksums it
+ *
+ * The history (up to LZ_WINDOW bytes, a few rows) is filtered again here
+ * rather than read from the task of the previous strip, so each task only
+ * holds its own rows and no filtered copy of the whole image exists.
+ *
+ * @param ctx Pointer to the PngJob
+ * @param task Strip index
+ */
+static void png_strip_task(void *ctx, int task) {
+  PngJob *job = (PngJob *)ctx;
+  PngStrip *st = &job->strips[task];
+  uint64_t t0 = profile_enabled() ? profile_now() : 0;
+  size_t begin = (size_t)st->y0 * job->line, n = (st->y1 - st->y0) * job->line;
+  size_t hist = begin < LZ_WINDOW ? begin : LZ_WINDOW;
+  int hist_rows = (int)((hist + job->line - 1) / job->line);
+  size_t filtered_len = n + (size_t)hist_rows * job->line;
+  // fixed Huffman codes are at most 9 bits per byte; stored blocks add 5
+  // bytes per STORED_MAX
+  st->out_cap = n + n / 8 + 5 * (n / STORED_MAX + 1) + 64;
+  st->out = (unsigned char *)buffer_pool_get(st->out_cap, 0, NULL);
+  unsigned char *filtered =
+      (unsigned char *)buffer_pool_get(filtered_len, 0, NULL);
+  unsigned char *trial = (unsigned char *)calloc(6, job->line - 1);
+  LzChains lz = {0};
+  if (job->level > 0) {
+    lz.head = (int32_t *)buffer_pool_get(sizeof(int32_t) << LZ_HASH_BITS, 0,
+                                         NULL);
+    lz.prev = (int32_t *)buffer_pool_get(sizeof(int32_t) * LZ_WINDOW, 0, NULL);
+  }
+  if (!st->out || !filtered || !trial ||
+      (job->level > 0 && (!lz.head || !lz.prev))) {
+    atomic_store(&job->failed, 1);
+  } else {
+    filter_rows(job, st->y0 - hist_rows, st->y1, filtered, trial);
+    if (profile_enabled()) {
+      uint64_t t1 = profile_now();
+      profile_task("png_filter", t1 - t0, st->y1 - st->y0 + hist_rows);
+      t0 = t1;
+    }
+    // the last hist bytes before the strip, then the strip
+    const unsigned char *data = filtered + (size_t)hist_rows * job->line - hist;
+    BitWriter bw = {.out = st->out};
+    if (task == 0) {
+      // zlib header: deflate with a 32K window, FLEVEL from the level
+      int flevel = job->level < 2   ? 0
+                   : job->level < 6 ? 1
+                   : job->level == 6 ? 2
+                                     : 3;
+      int flg = flevel << 6;
+      flg += 31 - (0x7800 + flg) % 31;
+      bw_put(&bw, 0x78, 8);
+      bw_put(&bw, flg, 8);
+    }
+    size_t start = bw.len;
+    deflate_strip(data, (int)hist, (int)(hist + n), job->level, &lz, &bw);
+    // noise grows under the fixed codes: store such strips instead
+    if (job->level > 0 && bw.len - start > n + 5 * (n / STORED_MAX + 1)) {
+      bw.len = start;
+      deflate_strip(data + hist, 0, (int)n, 0, &lz, &bw);
+    }
+    st->out_len = bw.len;
+    st->adler = adler32(1, data + hist, n);
+    uint32_t crc = crc_update(0xFFFFFFFFu, (const unsigned char *)"IDAT", 4);
+    st->crc = crc_update(crc, st->out, st->out_len) ^ 0xFFFFFFFFu;
+    if (profile_enabled())
+      profile_task("png_deflate", profile_now() - t0, st->y1 - st->y0);
+  }
+  free(trial);
+  buffer_pool_put(filtered, filtered_len);
+  buffer_pool_put(lz.head, sizeof(int32_t) << LZ_HASH_BITS);
+  buffer_pool_put(lz.prev, sizeof(int32_t) * LZ_WINDOW);
+}
+
+static void put_be32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)(v >> 24);
+  p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >> 8);
+  p[3] = (unsigned char)v;
+}
+
+/**
+ * Writes one PNG chunk
+ *
+ * @param fp Output file
+ * @param type Four-letter chunk type
+ * @param data Payload
+ * @param len Payload length
+ * @param crc CRC of type and payload, or 0 to compute it here
+ * @return 0 on success, -1 on a write error
+ */
+static int write_chunk(FILE *fp, const char *type, const unsigned char *data,
+                       size_t len, uint32_t crc) {
+  unsigned char head[8], tail[4];
+  put_be32(head, (uint32_t)len);
+  memcpy(head + 4, type, 4);
+  if (!crc)
+    crc = crc_update(crc_update(0xFFFFFFFFu, head + 4, 4), data, len) ^
+          0xFFFFFFFFu;
+  put_be32(tail, crc);
+  return fwrite(head, 1, 8, fp) == 8 &&
+                 (len == 0 || fwrite(data, 1, len, fp) == len) &&
+                 fwrite(tail, 1, 4, fp) == 4
+             ? 0
+             : -1;
+}
+
+/**
+ * Writes an image as a PNG file using all pool threads
+ *
+ * The rows are cut into strips of about PNG_STRIP_BYTES filtered bytes.
+ * One parallel-for filters every strip into a buffer of its own (per-row
+ * choice among the five PNG filters by smallest sum of absolute values) and
+ * deflates it right away, pigz style: each strip may reference the last 32 KB
+ * of the strips before it, filtered again by its task, ends with a sync
+ * flush so its bits start on a byte boundary, and carries its own Adler-32,
+ * which are combined into the checksum of the whole stream. Each strip
+ * becomes one IDAT chunk, and a final chunk closes the zlib stream, so the
+ * file is a standard PNG that any decoder reads. Besides the image, memory
+ * holds the compressed strips and one strip buffer per running task.
+ *
+ * @param path File to create
+ * @param img Image to write (1 gray, 2 gray+alpha, 3 RGB, 4 RGBA channels)
+ * @param level 0 (stored, fastest) to 9 (smallest); clamped
+ *
+ * @return 0 on success, -1 on invalid image, allocation or write failure
+ */
+int png_write(const char *path, const Image *img, int level) {
+  static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  static const unsigned char color_type[5] = {0, 0, 4, 2, 6};
+  if (!img->data || img->channels < 1 || img->channels > 4)
+    return -1;
+  pthread_once(&tables_once, tables_init);
+  level = level < PNG_LEVEL_MIN   ? PNG_LEVEL_MIN
+          : level > PNG_LEVEL_MAX ? PNG_LEVEL_MAX
+                                  : level;
+  PngJob job = {.img = img,
+                .level = level,
+                .line = (size_t)img->width * img->channels + 1};
+  atomic_init(&job.failed, 0);
+  int rows = (int)(PNG_STRIP_BYTES / job.line);
+  rows = rows < 1 ? 1 : rows;
+  int nstrips = (img->height + rows - 1) / rows;
+  size_t total = job.line * img->height;
+  job.strips = (PngStrip *)calloc(nstrips, sizeof(PngStrip));
+  if (!job.strips)
+    return -1;
+  for (int i = 0; i < nstrips; i++) {
+    job.strips[i].y0 = i * rows;
+    job.strips[i].y1 = (i + 1) * rows < img->height ? (i + 1) * rows
+                                                    : img->height;
+  }
+
+  ThreadPool *pool = thread_pool_default();
+  uint64_t t0 = profile_enabled() ? profile_now() : 0;
+  thread_pool_parallel_for(pool, nstrips, png_strip_task, &job);
+  if (profile_enabled()) {
+    uint64_t t1 = profile_now();
+    profile_record("png_encode", t1 - t0, img->height, total);
+    t0 = t1;
+  }
+
+  int rc = atomic_load(&job.failed) ? -1 : 0;
+  size_t compressed = 0;
+  FILE *fp = rc == 0 ? fopen(path, "wb") : NULL;
+  if (rc == 0 && !fp) {
+    fprintf(stderr, "Error creating %s\n", path);
+    rc = -1;
+  }
+  if (fp) {
+    setvbuf(fp, NULL, _IOFBF, PNG_IO_BUFFER);
+    unsigned char ihdr[13] = {0};
+    put_be32(ihdr, (uint32_t)img->width);
+    put_be32(ihdr + 4, (uint32_t)img->height);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = color_type[img->channels];
+    rc = fwrite(signature, 1, 8, fp) == 8 &&
+                 write_chunk(fp, "IHDR", ihdr, sizeof(ihdr), 0) == 0
+             ? 0
+             : -1;
+    uint32_t adler = 1;
+    for (int i = 0; i < nstrips && rc == 0; i++) {
+      const PngStrip *st = &job.strips[i];
+      adler = adler32_combine(adler, st->adler,
+                              (st->y1 - st->y0) * job.line);
+      rc = write_chunk(fp, "IDAT", st->out, st->out_len, st->crc);
+      compressed += st->out_len;
+    }
+    // empty final fixed-Huffman block, then the Adler-32 of all rows
+    unsigned char tail[6] = {0x03, 0x00};
+    put_be32(tail + 2, adler);
+    if (rc == 0)
+      rc = write_chunk(fp, "IDAT", tail, sizeof(tail), 0);
+    if (rc == 0)
+      rc = write_chunk(fp, "IEND", NULL, 0, 0);
+    if (fclose(fp) != 0)
+      rc = -1;
+    if (rc != 0)
+      fprintf(stderr, "Error writing %s\n", path);
+  }
+  if (profile_enabled())
+    profile_record("png_write", profile_now() - t0, img->height, compressed);
+
+  for (int i = 0; i < nstrips; i++)
+    buffer_pool_put(job.strips[i].out, job.strips[i].out_cap);
+  free(job.strips);
+  return rc;
+}
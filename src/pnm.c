@@ -0,0 +1,252 @@
+#include "pnm.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// stdio buffer of an open stream; large enough that row reads and writes
+// turn into few system calls
+#define PNM_IO_BUFFER (1 << 20)
+
+/**
+ * Reads one unsigned decimal header field of a P5/P6 file
+ *
+ * Skips whitespace and '#' comments before the number.
+ *
+ * @param fp File positioned in the header
+ * @param out Parsed value
+ * @return 0 on success, -1 on a malformed header
+ */
+static int read_header_int(FILE *fp, int *out) {
+  int c = fgetc(fp);
+  while (c == '#' || isspace(c)) {
+    if (c == '#')
+      while (c != '\n' && c != EOF)
+        c = fgetc(fp);
+    c = fgetc(fp);
+  }
+  long v = 0;
+  if (!isdigit(c))
+    return -1;
+  for (; isdigit(c); c = fgetc(fp)) {
+    v = v * 10 + (c - '0');
+    if (v > 1 << 24)
+      return -1;
+  }
+  // exactly one whitespace character ends the field (and the header)
+  if (!isspace(c))
+    return -1;
+  *out = (int)v;
+  return 0;
+}
+
+/**
+ * Parses the "KEY value" lines of a PAM header up to ENDHDR
+ *
+ * @param fp File positioned after the "P7" line
+ * @param s Stream whose geometry is filled
+ * @param maxval Parsed MAXVAL
+ * @return 0 on success, -1 on a malformed header
+ */
+static int read_pam_header(FILE *fp, PnmStream *s, int *maxval) {
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    char key[32];
+    int value;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (strncmp(line, "ENDHDR", 6) == 0)
+      return 0;
+    if (sscanf(line, "%31s", key) != 1)
+      continue;
+    if (strcmp(key, "TUPLTYPE") == 0)
+      continue; // the channel count comes from DEPTH
+    if (sscanf(line, "%*s %d", &value) != 1 || value < 0 || value > 1 << 24)
+      return -1;
+    if (strcmp(key, "WIDTH") == 0)
+      s->width = value;
+    else if (strcmp(key, "HEIGHT") == 0)
+      s->height = value;
+    else if (strcmp(key, "DEPTH") == 0)
+      s->channels = value;
+    else if (strcmp(key, "MAXVAL") == 0)
+      *maxval = value;
+    else
+      return -1;
+  }
+  return -1;
+}
+
+/**
+ * Opens a binary Netpbm file for row-wise reading
+ *
+ * Accepts P5 (gray), P6 (RGB) and P7 (PAM, DEPTH 1 to 4) files with a
+ * MAXVAL of 255. After a successful call the file is positioned on the
+ * first pixel row.
+ *
+ * @param path File to open
+ * @param s Stream to initialize; close with pnm_close
+ *
+ * @return 0 on success, -1 if the file cannot be opened or is not a
+ * supported PNM (an error is printed to stderr)
+ */
+int pnm_open_read(const char *path, PnmStream *s) {
+  PnmStream empty = {0};
+  *s = empty;
+  s->fp = fopen(path, "rb");
+  if (!s->fp) {
+    fprintf(stderr, "Error opening %s\n", path);
+    return -1;
+  }
+  setvbuf(s->fp, NULL, _IOFBF, PNM_IO_BUFFER);
+  char magic[3] = {0};
+  int maxval = 0, rc = -1;
+  if (fread(magic, 1, 2, s->fp) == 2 && magic[0] == 'P') {
+    if (magic[1] == '5' || magic[1] == '6') {
+      s->channels = magic[1] == '5' ? 1 : 3;
+      rc = read_header_int(s->fp, &s->width) ||
+                   read_header_int(s->fp, &s->height) ||
+                   read_header_int(s->fp, &maxval)
+               ? -1
+               : 0;
+    } else if (magic[1] == '7' && fgetc(s->fp) == '\n') {
+      rc = read_pam_header(s->fp, s, &maxval);
+    }
+  }
+  if (rc != 0 || s->width < 1 || s->height < 1 || s->channels < 1 ||
+      s->channels > 4 || maxval != 255) {
+    fprintf(stderr, "%s: not an 8-bit P5, P6 or P7 file\n", path);
+    fclose(s->fp);
+    *s = empty;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Creates a binary Netpbm file for row-wise writing
+ *
+ * One channel is written as P5, three as P6 and two or four as P7 (PAM)
+ * with the GRAYSCALE_ALPHA or RGB_ALPHA tuple type.
+ *
+ * @param path File to create
+ * @param width Image width
+ * @param height Image height; exactly this many rows must be written
+ * @param channels Number of channels (1 to 4)
+ * @param s Stream to initialize; close with pnm_close
+ *
+ * @return 0 on success, -1 on invalid geometry or if the file cannot be
+ * created (an error is printed to stderr)
+ */
+int pnm_open_write(const char *path, int width, int height, int channels,
+                   PnmStream *s) {
+  static const char *const tupltype[] = {"GRAYSCALE", "GRAYSCALE_ALPHA",
+                                         "RGB", "RGB_ALPHA"};
+  PnmStream empty = {0};
+  *s = empty;
+  if (width < 1 || height < 1 || channels < 1 || channels > 4) {
+    fprintf(stderr, "%s: cannot store %dx%dx%d as PNM\n", path, width, height,
+            channels);
+    return -1;
+  }
+  s->fp = fopen(path, "wb");
+  if (!s->fp) {
+    fprintf(stderr, "Error creating %s\n", path);
+    return -1;
+  }
+  setvbuf(s->fp, NULL, _IOFBF, PNM_IO_BUFFER);
+  s->width = width;
+  s->height = height;
+  s->channels = channels;
+  if (channels == 1 || channels == 3)
+    fprintf(s->fp, "P%c\n%d %d\n255\n", channels == 1 ? '5' : '6', width,
+            height);
+  else
+    fprintf(s->fp,
+            "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\n"
+            "ENDHDR\n",
+            width, height, channels, tupltype[channels - 1]);
+  return 0;
+}
+
+/**
+ * Reads the next rows of an open PNM file
+ *
+ * @param ctx PnmStream opened with pnm_open_read
+ * @param rows Destination of the first row
+ * @param stride Bytes between destination rows
+ * @param count Number of rows; must not go past the last image row
+ *
+ * @return 0 on success, -1 on a short read (truncated file)
+ */
+int pnm_read_rows(void *ctx, unsigned char *rows, size_t stride, int count) {
+  PnmStream *s = (PnmStream *)ctx;
+  size_t row_bytes = (size_t)s->width * s->channels;
+  if (count < 0 || s->rows_done + count > s->height)
+    return -1;
+  if (stride == row_bytes) {
+    if (fread(rows, row_bytes, count, s->fp) != (size_t)count)
+      return -1;
+  } else {
+    for (int i = 0; i < count; i++)
+      if (fread(rows + (size_t)i * stride, 1, row_bytes, s->fp) != row_bytes)
+        return -1;
+  }
+  s->rows_done += count;
+  return 0;
+}
+
+/**
+ * Appends rows to a PNM file opened with pnm_open_write
+ *
+ * @param ctx PnmStream opened with pnm_open_write
+ * @param rows First row to write
+ * @param stride Bytes between source rows
+ * @param count Number of rows; must not go past the declared height
+ *
+ * @return 0 on success, -1 on a write error
+ */
+int pnm_write_rows(void *ctx, const unsigned char *rows, size_t stride,
+                   int count) {
+  PnmStream *s = (PnmStream *)ctx;
+  size_t row_bytes = (size_t)s->width * s->channels;
+  if (count < 0 || s->rows_done + count > s->height)
+    return -1;
+  if (stride == row_bytes) {
+    if (fwrite(rows, row_bytes, count, s->fp) != (size_t)count)
+      return -1;
+  } else {
+    for (int i = 0; i < count; i++)
+      if (fwrite(rows + (size_t)i * stride, 1, row_bytes, s->fp) != row_bytes)
+        return -1;
+  }
+  s->rows_done += count;
+  return 0;
+}
+
+/**
+ * Closes a PNM stream
+ *
+ * @param s Stream to close; safe on a zeroed or already closed stream
+ * @return 0 on success, -1 if flushing buffered rows failed
+ */
+int pnm_close(PnmStream *s) {
+  int rc = s->fp && fclose(s->fp) != 0 ? -1 : 0;
+  s->fp = NULL;
+  return rc;
+}
+
+/**
+ * Tells whether a path names a Netpbm file by its extension
+ *
+ * @param path File path
+ * @return Nonzero for .pnm, .pgm, .ppm and .pam (any case)
+ */
+int pnm_path(const char *path) {
+  static const char *const ext[] = {".pnm", ".pgm", ".ppm", ".pam"};
+  size_t len = strlen(path);
+  for (size_t i = 0; i < sizeof(ext) / sizeof(ext[0]); i++)
+    if (len > 4 && strcasecmp(path + len - 4, ext[i]) == 0)
+      return 1;
+  return 0;
+}
@@ -0,0 +1,230 @@
+#include "profile.h"
+#include "buffer_pool.h"
+#include "cpu_dispatch.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Distinct operator names and threads kept in a report; later ones are
+// folded into the last slot
+#define PROFILE_MAX_OPS 64
+#define PROFILE_MAX_THREADS 256
+
+/**
+ * Totals of one operator (or I/O phase) over the run
+ */
+typedef struct {
+  const char *name;
+  uint64_t calls, wall_ns;
+  uint64_t rows, bytes;
+  uint64_t tasks, task_ns;
+  uint64_t launches, launch_max_ns, launch_mean_ns;
+} ProfileOp;
+
+/**
+ * Row blocks executed by one thread
+ */
+typedef struct {
+  uint64_t tasks, rows, busy_ns;
+} ProfileThread;
+
+int profile_on;
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *profile_path;
+static uint64_t profile_t0;
+static ProfileOp profile_ops[PROFILE_MAX_OPS];
+static int profile_nops;
+static ProfileThread profile_threads[PROFILE_MAX_THREADS];
+static atomic_int profile_nthreads;
+static atomic_ullong profile_alloc_bytes;
+static _Thread_local int profile_tid = -1;
+
+/**
+ * Enables recording for the rest of the run
+ *
+ * Call before any operator runs (the flag is read without synchronization
+ * by the hooks).
+ *
+ * @param path Report destination, "-" for stderr
+ */
+void profile_start(const char *path) {
+  profile_path = path;
+  profile_t0 = profile_now();
+  profile_on = 1;
+}
+
+/**
+ * Monotonic clock
+ *
+ * @return Nanoseconds since an arbitrary origin
+ */
+uint64_t profile_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Finds or adds the totals of an operator; call with profile_lock held
+ *
+ * @param name Operator name (a string literal; compared by content)
+ * @return Its totals
+ */
+static ProfileOp *profile_op(const char *name) {
+  name = name ? name : "unnamed";
+  for (int i = 0; i < profile_nops; i++)
+    if (profile_ops[i].name == name || strcmp(profile_ops[i].name, name) == 0)
+      return &profile_ops[i];
+  if (profile_nops == PROFILE_MAX_OPS)
+    return &profile_ops[PROFILE_MAX_OPS - 1];
+  profile_ops[profile_nops].name = name;
+  return &profile_ops[profile_nops++];
+}
+
+/**
+ * Records one complete call of an operator or I/O phase
+ *
+ * @param op Operator name
+ * @param ns Wall time of the call
+ * @param rows Rows produced (0 if not meaningful)
+ * @param bytes Bytes read or written (0 if not meaningful)
+ */
+void profile_record(const char *op, uint64_t ns, int rows, size_t bytes) {
+  pthread_mutex_lock(&profile_lock);
+  ProfileOp *p = profile_op(op);
+  p->calls++;
+  p->wall_ns += ns;
+  p->rows += rows;
+  p->bytes += bytes;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Records one row block executed by the calling thread
+ *
+ * Threads are numbered in the order they first run a block.
+ *
+ * @param op Operator name
+ * @param ns Time spent in the block
+ * @param rows Rows in the block
+ */
+void profile_task(const char *op, uint64_t ns, int rows) {
+  if (profile_tid < 0) {
+    profile_tid = atomic_fetch_add(&profile_nthreads, 1);
+    if (profile_tid >= PROFILE_MAX_THREADS)
+      profile_tid = PROFILE_MAX_THREADS - 1;
+  }
+  pthread_mutex_lock(&profile_lock);
+  ProfileOp *p = profile_op(op);
+  p->tasks++;
+  p->task_ns += ns;
+  ProfileThread *t = &profile_threads[profile_tid];
+  t->tasks++;
+  t->rows += rows;
+  t->busy_ns += ns;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Records the balance of one parallel launch
+ *
+ * The slowest block bounds the launch; comparing it with the mean block time
+ * gives the load imbalance of the row split.
+ *
+ * @param op Operator name
+ * @param tasks Number of blocks
+ * @param max_ns Time of the slowest block
+ * @param sum_ns Total time of all blocks
+ */
+void profile_launch(const char *op, int tasks, uint64_t max_ns,
+                    uint64_t sum_ns) {
+  if (tasks < 1)
+    return;
+  pthread_mutex_lock(&profile_lock);
+  ProfileOp *p = profile_op(op);
+  p->launches++;
+  p->launch_max_ns += max_ns;
+  p->launch_mean_ns += sum_ns / tasks;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Counts the bytes of a pixel buffer allocation
+ *
+ * @param bytes Allocation size
+ */
+void profile_alloc(size_t bytes) {
+  atomic_fetch_add(&profile_alloc_bytes, bytes);
+}
+
+/**
+ * Writes the JSON report
+ *
+ * Per operator: calls, wall time, rows, bytes, block count and time, and the
+ * imbalance of its launches (sum of slowest blocks over sum of mean blocks,
+ * 1.0 when every thread finishes together). Per thread: blocks, rows and busy
+ * time. Also the run wall time, pixel bytes allocated, peak RSS and the
+ * buffer pool counters (blocks still outstanding at exit are leaks).
+ *
+ * @return 0 on success or when disabled, -1 if the report cannot be written
+ */
+int profile_report(void) {
+  if (!profile_on)
+    return 0;
+  FILE *fp = strcmp(profile_path, "-") == 0 ? stderr : fopen(profile_path, "w");
+  if (!fp) {
+    fprintf(stderr, "Cannot write profile to %s\n", profile_path);
+    return -1;
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  pthread_mutex_lock(&profile_lock);
+  fprintf(fp, "{\n  \"wall_ms\": %.3f,\n",
+          (profile_now() - profile_t0) / 1e6);
+  fprintf(fp, "  \"bytes_allocated\": %llu,\n",
+          (unsigned long long)atomic_load(&profile_alloc_bytes));
+  fprintf(fp, "  \"peak_rss_kb\": %ld,\n", ru.ru_maxrss);
+  fprintf(fp, "  \"isa\": \"%s\",\n", cpu_isa_name(cpu_isa()));
+  BufferPoolStats bp;
+  buffer_pool_stats(&bp);
+  fprintf(fp,
+          "  \"buffer_pool\": {\"hits\": %llu, \"misses\": %llu, "
+          "\"outstanding_blocks\": %zu, \"outstanding_bytes\": %zu, "
+          "\"peak_outstanding_bytes\": %zu, \"cached_bytes\": %zu},\n",
+          bp.hits, bp.misses, bp.outstanding_blocks, bp.outstanding_bytes,
+          bp.peak_outstanding_bytes, bp.cached_bytes);
+  fprintf(fp, "  \"operators\": [");
+  for (int i = 0; i < profile_nops; i++) {
+    const ProfileOp *p = &profile_ops[i];
+    fprintf(fp,
+            "%s\n    {\"name\": \"%s\", \"calls\": %llu, \"wall_ms\": %.3f, "
+            "\"rows\": %llu, \"bytes\": %llu, \"tasks\": %llu, "
+            "\"task_ms\": %.3f, \"imbalance\": %.3f}",
+            i ? "," : "", p->name, (unsigned long long)p->calls,
+            p->wall_ns / 1e6, (unsigned long long)p->rows,
+            (unsigned long long)p->bytes, (unsigned long long)p->tasks,
+            p->task_ns / 1e6,
+            p->launch_mean_ns ? (double)p->launch_max_ns / p->launch_mean_ns
+                              : 1.0);
+  }
+  fprintf(fp, "\n  ],\n  \"threads\": [");
+  int nt = atomic_load(&profile_nthreads);
+  nt = nt > PROFILE_MAX_THREADS ? PROFILE_MAX_THREADS : nt;
+  for (int i = 0; i < nt; i++) {
+    const ProfileThread *t = &profile_threads[i];
+    fprintf(fp,
+            "%s\n    {\"id\": %d, \"tasks\": %llu, \"rows\": %llu, "
+            "\"busy_ms\": %.3f}",
+            i ? "," : "", i, (unsigned long long)t->tasks,
+            (unsigned long long)t->rows, t->busy_ns / 1e6);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  pthread_mutex_unlock(&profile_lock);
+  if (fp != stderr && fclose(fp) != 0)
+    return -1;
+  return 0;
+}
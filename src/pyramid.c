@@ -0,0 +1,323 @@
+#include "pyramid.h"
+#include "cpu_dispatch.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Levels halved per pass over strips; a strip is 1 << PYRAMID_FUSE rows of
+// the pass input, small enough to stay in cache down to its last level
+#define PYRAMID_FUSE 4
+
+typedef void (*HalveFn)(const unsigned char *, const unsigned char *,
+                        unsigned char *, int, int);
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static HalveFn halve_row;
+
+/**
+ * One fused pass of pyramid_build: levels first + 1 .. first + depth are
+ * computed from level first
+ */
+typedef struct {
+  Image *levels;
+  int first;
+  int depth;
+} PyramidPass;
+
+/**
+ * Size of the next level along one axis
+ */
+static inline int half_size(int n) { return (n + 1) / 2; }
+
+/**
+ * Averages 2x2 blocks into output pixels [x, (in_w + 1) / 2)
+ *
+ * Each output channel is (a + b + c + d + 2) >> 2; the right neighbour of
+ * the last column of an odd width is that column itself. Inlined with a
+ * constant channel count by halve_row_scalar.
+ *
+ * @param r0 Upper input row
+ * @param r1 Lower input row (r0 again for the last row of an odd height)
+ * @param out Output row
+ * @param x First output pixel
+ * @param in_w Input width in pixels
+ * @param ch Number of interleaved channels
+ */
+static inline void halve_tail(const unsigned char *r0, const unsigned char *r1,
+                              unsigned char *out, int x, int in_w, int ch) {
+  for (int out_w = half_size(in_w); x < out_w; x++) {
+    size_t a = (size_t)2 * x * ch;
+    size_t b = 2 * x + 1 < in_w ? a + ch : a;
+    for (int c = 0; c < ch; c++)
+      out[(size_t)x * ch + c] =
+          (unsigned char)((r0[a + c] + r0[b + c] + r1[a + c] + r1[b + c] + 2) >>
+                          2);
+  }
+}
+
+/**
+ * Portable 2x2 average of one output row
+ *
+ * @param r0 Upper input row
+ * @param r1 Lower input row
+ * @param out Output row of (in_w + 1) / 2 pixels
+ * @param in_w Input width in pixels
+ * @param ch Number of interleaved channels
+ */
+static void halve_row_scalar(const unsigned char *r0, const unsigned char *r1,
+                             unsigned char *out, int in_w, int ch) {
+  switch (ch) {
+  case 1:
+    halve_tail(r0, r1, out, 0, in_w, 1);
+    break;
+  case 3:
+    halve_tail(r0, r1, out, 0, in_w, 3);
+    break;
+  case 4:
+    halve_tail(r0, r1, out, 0, in_w, 4);
+    break;
+  default:
+    halve_tail(r0, r1, out, 0, in_w, ch);
+  }
+}
+
+#ifdef CPU_X86
+/**
+ * Byte orders that put the two pixels of every horizontal pair next to each
+ * other, channel by channel, so pmaddubsw with ones adds the pair. RGB uses
+ * 12 of the 16 bytes (two pairs); -1 clears the rest.
+ */
+static const signed char pair_order[4][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15},
+    {0, 3, 1, 4, 2, 5, 6, 9, 7, 10, 8, 11, -1, -1, -1, -1},
+    {0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15},
+};
+
+/**
+ * SSE4.1 2x2 average: 16 input bytes per row (12 for RGB) give 8 (6)
+ * output bytes with pshufb + pmaddubsw; the rest goes to halve_tail
+ */
+__attribute__((target("sse4.1"))) static void
+halve_row_sse41(const unsigned char *r0, const unsigned char *r1,
+                unsigned char *out, int in_w, int ch) {
+  if (ch > 4) {
+    halve_tail(r0, r1, out, 0, in_w, ch);
+    return;
+  }
+  const __m128i order = _mm_loadu_si128((const __m128i *)pair_order[ch - 1]);
+  const __m128i ones = _mm_set1_epi8(1), two = _mm_set1_epi16(2);
+  size_t step = ch == 3 ? 12 : 16;
+  size_t full = (size_t)(in_w & ~1) * ch; // bytes of whole pairs
+  size_t j = 0;
+  for (; j + 16 <= full; j += step) {
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(r0 + j)),
+                                 order);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(r1 + j)),
+                                 order);
+    __m128i s = _mm_add_epi16(_mm_maddubs_epi16(a, ones),
+                              _mm_maddubs_epi16(b, ones));
+    s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+    // 8 bytes stored, of which RGB keeps 6; j + 16 <= full keeps the extra
+    // two inside the row
+    _mm_storel_epi64((__m128i *)(out + j / 2), _mm_packus_epi16(s, s));
+  }
+  halve_tail(r0, r1, out, (int)(j / (2 * ch)), in_w, ch);
+}
+#endif
+
+/**
+ * Selects the widest 2x2 kernel allowed by cpu_isa()
+ *
+ * Runs once through pthread_once when the first pyramid is built. The pair
+ * shuffle needs pshufb, so below SSE4.1 the kernel stays scalar. Wider
+ * vectors gain nothing measurable: a pass is bound by reading its source.
+ */
+static void select_isa(void) {
+  halve_row = halve_row_scalar;
+#ifdef CPU_X86
+  if (cpu_isa() >= CPU_ISA_SSE41)
+    halve_row = halve_row_sse41;
+#endif
+}
+
+/**
+ * Worker of one fused pass: halves strips of rows down several levels
+ *
+ * Row s of the deepest level of the pass is strip s: it covers rows
+ * [s << depth, (s + 1) << depth) of the pass input and the matching rows of
+ * every level in between. Each level of a strip is computed from the rows of
+ * the level above it just written by the same worker, so they are read back
+ * from cache; the pairs of rows (and the odd last row, paired with itself)
+ * never straddle two strips.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src: Input level of the pass
+ *          - dst: Deepest level of the pass
+ *          - y0, y1: Range of strips (rows of dst) for this worker
+ *          - ctx: PyramidPass with the levels
+ *
+ * @return NULL
+ */
+static void *worker_pyramid(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const PyramidPass *pass = (const PyramidPass *)a->ctx;
+  for (int s = a->y0; s < a->y1; s++)
+    for (int l = 1; l <= pass->depth; l++) {
+      const Image *in = &pass->levels[pass->first + l - 1];
+      const Image *out = &pass->levels[pass->first + l];
+      int shift = pass->depth - l;
+      int y1 = (s + 1) << shift;
+      if (y1 > out->height)
+        y1 = out->height;
+      for (int y = s << shift; y < y1; y++) {
+        const unsigned char *r0 = image_row(in, 2 * y);
+        const unsigned char *r1 =
+            2 * y + 1 < in->height ? image_row(in, 2 * y + 1) : r0;
+        halve_row(r0, r1, image_row(out, y), in->width, in->channels);
+      }
+    }
+  return NULL;
+}
+
+/**
+ * Builds a pyramid of successive 2x2 averages
+ *
+ * Levels are computed in passes of up to PYRAMID_FUSE levels. A pass splits
+ * the rows of its deepest level among the pool workers; every such row is a
+ * strip of 1 << depth input rows that the worker halves level after level
+ * while it is still cached, so each level, and the source in particular, is
+ * read from memory once.
+ *
+ * @param src Source image (levels[0] of the result is a view of it)
+ * @param count Number of levels wanted, source included; capped at
+ * PYRAMID_MAX_LEVELS and at the first 1x1 level
+ * @param py Pyramid to fill; release with pyramid_free
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on invalid arguments, memory allocation error or
+ * thread pool failure
+ */
+int pyramid_build(const Image *src, int count, Pyramid *py, int num_threads) {
+  memset(py, 0, sizeof(*py));
+  if (!src->data || src->width < 1 || src->height < 1 || count < 1) {
+    fprintf(stderr, "Pyramid: invalid source or level count\n");
+    return -1;
+  }
+  pthread_once(&isa_once, select_isa);
+  py->levels[0] = *src; // never released by pyramid_free
+  py->count = 1;
+  if (count > PYRAMID_MAX_LEVELS)
+    count = PYRAMID_MAX_LEVELS;
+  for (int l = 1; l < count; l++) {
+    const Image *up = &py->levels[l - 1];
+    if (up->width == 1 && up->height == 1)
+      break;
+    if (image_alloc_uninit(&py->levels[l], half_size(up->width),
+                           half_size(up->height), src->channels) != 0) {
+      fprintf(stderr, "Pyramid: failed to allocate level %d\n", l);
+      pyramid_free(py);
+      return -1;
+    }
+    py->count = l + 1;
+  }
+
+  for (int first = 0; first + 1 < py->count; first += PYRAMID_FUSE) {
+    PyramidPass pass = {py->levels, first, py->count - 1 - first};
+    if (pass.depth > PYRAMID_FUSE)
+      pass.depth = PYRAMID_FUSE;
+    WorkArgs base = {.src = &py->levels[first],
+                     .dst = &py->levels[first + pass.depth],
+                     .width = py->levels[first].width,
+                     .height = py->levels[first].height,
+                     .channels = src->channels,
+                     .ctx = &pass,
+                     .name = "pyramid"};
+    if (launch_threads_by_rows(worker_pyramid, base, num_threads) != 0) {
+      pyramid_free(py);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Releases the levels allocated by pyramid_build
+ *
+ * @param py Pyramid to release; the source view is left alone
+ */
+void pyramid_free(Pyramid *py) {
+  for (int l = 1; l < py->count; l++)
+    image_free(&py->levels[l]);
+  memset(py, 0, sizeof(*py));
+}
+
+/**
+ * Picks the level an output size is resampled from
+ *
+ * The smallest level that still covers width x height on both axes keeps
+ * every reduction from it below 2x, where the resize filters see enough
+ * source pixels.
+ *
+ * @param src_w Source width
+ * @param src_h Source height
+ * @param width Output width
+ * @param height Output height
+ *
+ * @return Level index, 0 for the source
+ */
+int pyramid_level_for(int src_w, int src_h, int width, int height) {
+  int l = 0, w = src_w, h = src_h;
+  while (l + 1 < PYRAMID_MAX_LEVELS && (w > 1 || h > 1) &&
+         half_size(w) >= width && half_size(h) >= height) {
+    w = half_size(w);
+    h = half_size(h);
+    l++;
+  }
+  return l;
+}
+
+/**
+ * Resizes one source to several output sizes through a pyramid
+ *
+ * Only the levels the outputs need are built. Each output is then resampled
+ * with its filter from the smallest level that covers it, which costs a
+ * fraction of the full-resolution reads of one resize per output.
+ *
+ * @param src Source image
+ * @param dsts Output images; their widths and heights give the target sizes
+ * and their channel counts must match src
+ * @param filters Resampling filter of each output
+ * @param count Number of outputs
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure (invalid arguments, memory allocation
+ * error or thread pool failure)
+ */
+int pyramid_resize_concurrent(const Image *src, Image *dsts,
+                              const ResizeFilter *filters, int count,
+                              int num_threads) {
+  int levels = 1;
+  for (int i = 0; i < count; i++) {
+    int l = pyramid_level_for(src->width, src->height, dsts[i].width,
+                              dsts[i].height);
+    if (l + 1 > levels)
+      levels = l + 1;
+  }
+  Pyramid py;
+  if (pyramid_build(src, levels, &py, num_threads) != 0)
+    return -1;
+  int rc = 0;
+  for (int i = 0; rc == 0 && i < count; i++) {
+    int l = pyramid_level_for(src->width, src->height, dsts[i].width,
+                              dsts[i].height);
+    rc = resize_filter_concurrent(&py.levels[l], &dsts[i], filters[i],
+                                  num_threads);
+  }
+  pyramid_free(&py);
+  return rc;
+}
@@ -1,182 +1,716 @@
 #include "resize.h"
+#include "cpu_dispatch.h"
+#include "profile.h"
 #include <math.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Fraction bits of the fixed-point filter weights; 8-bit samples times a
+// weight sum of about 1 << 22 leave headroom for negative lobes in int32
+#define RESIZE_PRECISION 22
+
+// Destination rows produced per vertical pass; bounds the intermediate buffer
+#define RESIZE_STRIP_ROWS 32
+
 /**
- * Arguments structure for image resize operations
+ * Filter weights of one resampling axis
  *
- * This structure extends the base WorkArgs structure with additional
- * parameters specific to resize operations, including the target dimensions.
- *
- * @param a Base work arguments structure containing common operation parameters
- * @param nw New width for the resized image
- * @param nh New height for the resized image
+ * Output sample i reads count[i] consecutive input samples starting at
+ * start[i], with weights coeff[i * ksize + k] in RESIZE_PRECISION fixed
+ * point. The weights of every output sample sum to exactly
+ * 1 << RESIZE_PRECISION, so flat areas are reproduced exactly.
  */
 typedef struct {
-  WorkArgs a;
-  int nw, nh;
-} ResizeArgs;
-
-/**
- * Performs bilinear interpolation to sample a pixel value from a 3D image
- * array.
- *
- * This function implements bilinear interpolation to calculate the pixel value
- * at non-integer coordinates by interpolating between the four nearest pixels.
- * The function handles boundary conditions by clamping coordinates to valid
- * ranges.
- *
- * @param src    3D array representing the image data [height][width][channels]
- * @param w      Width of the image in pixels
- * @param h      Height of the image in pixels
- * @param c      Channel index to sample from (e.g., 0=R, 1=G, 2=B for RGB)
- * @param xs     X-coordinate to sample (can be fractional)
- * @param ys     Y-coordinate to sample (can be fractional)
- *
- * @return       Interpolated pixel value as an unsigned char (0-255)
- *
- * @note         Coordinates outside image bounds are clamped to nearest valid
- * pixel
- * @note         Uses lrintf() for proper rounding of final interpolated value
- */
-static unsigned char bilinear(unsigned char ***src, int w, int h, int c,
-                              float xs, float ys) {
-  int x0 = (int)floorf(xs), y0 = (int)floorf(ys);
-  int x1 = x0 + 1, y1 = y0 + 1;
-  if (x0 < 0)
-    x0 = 0;
-  if (y0 < 0)
-    y0 = 0;
-  if (x1 >= w)
-    x1 = w - 1;
-  if (y1 >= h)
-    y1 = h - 1;
-  float tx = xs - x0, ty = ys - y0;
-  float v00 = src[y0][x0][c], v10 = src[y0][x1][c];
-  float v01 = src[y1][x0][c], v11 = src[y1][x1][c];
-  float v0 = v00 * (1 - tx) + v10 * tx;
-  float v1 = v01 * (1 - tx) + v11 * tx;
-  return (unsigned char)lrintf(v0 * (1 - ty) + v1 * ty);
-}
-
-/**
- * Worker thread function for image resizing using bilinear interpolation.
- *
- * This function performs bilinear interpolation to resize a portion of an
- * image. It calculates scaling factors and maps destination pixels to source
- * coordinates, then applies bilinear interpolation for each color channel.
- *
- * @param p Pointer to ResizeArgs structure containing:
- *          - a: WorkArgs with source/destination buffers, dimensions, and work
- * range
- *          - nw: New width (destination width)
- *          - nh: New height (destination height)
- *
- * @return NULL (standard pthread worker return value)
- *
- * @note The function processes rows from a->y0 to a->y1 (exclusive) for
- * parallelization
- * @note Uses center-point sampling with 0.5 pixel offset for better
- * interpolation
- * @note Assumes bilinear() function is available for pixel interpolation
+  int *start;
+  int *count;
+  int32_t *coeff;
+  int ksize;
+} ResizeAxis;
+
+/**
+ * Precomputed tables of one resize call, shared by all workers
  */
-static void *worker_resize(void *p) {
-  ResizeArgs *R = (ResizeArgs *)p;
-  WorkArgs *a = &R->a;
-  float sx = (float)a->width / (float)R->nw;
-  float sy = (float)a->height / (float)R->nh;
-  for (int y = a->y0; y < a->y1 && y < R->nh; y++) {
-    for (int x = 0; x < R->nw; x++) {
-      float xs = (x + 0.5f) * sx - 0.5f;
-      float ys = (y + 0.5f) * sy - 0.5f;
-      for (int c = 0; c < a->channels; c++) {
-        a->dst[y][x][c] = bilinear(a->src, a->width, a->height, c, xs, ys);
+typedef struct {
+  ResizeAxis h, v;
+  int need_h, need_v; // whether each axis changes size
+} ResizePlan;
+
+typedef void (*RowHFn)(const unsigned char *, unsigned char *,
+                       const ResizeAxis *, int, int);
+typedef void (*RowVFn)(const unsigned char *, int, size_t, unsigned char *,
+                       size_t, int, int, const int32_t *, int32_t *);
+
+// Row kernels picked by select_isa
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static RowHFn resize_row_h;
+static RowVFn resize_row_v;
+
+/**
+ * Continuous filter kernel and the half-width of its support at scale 1
+ */
+typedef struct {
+  double (*fn)(double x);
+  double support;
+} FilterDef;
+
+static double filter_box(double x) { return x > -0.5 && x <= 0.5 ? 1.0 : 0.0; }
+
+static double filter_triangle(double x) {
+  x = fabs(x);
+  return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+/**
+ * Cubic convolution kernel with a = -0.5 (Catmull-Rom spline)
+ */
+static double filter_catmull_rom(double x) {
+  const double a = -0.5;
+  x = fabs(x);
+  if (x < 1.0)
+    return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+  if (x < 2.0)
+    return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+  return 0.0;
+}
+
+static double sinc(double x) {
+  if (x == 0.0)
+    return 1.0;
+  x *= M_PI;
+  return sin(x) / x;
+}
+
+static double filter_lanczos3(double x) {
+  return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+static const FilterDef filters[] = {
+    [RESIZE_BILINEAR] = {filter_triangle, 1.0},
+    [RESIZE_BOX] = {filter_box, 0.5},
+    [RESIZE_CATMULL_ROM] = {filter_catmull_rom, 2.0},
+    [RESIZE_LANCZOS3] = {filter_lanczos3, 3.0},
+};
+
+static void resize_axis_free(ResizeAxis *ax) {
+  free(ax->start);
+  free(ax->count);
+  free(ax->coeff);
+  ax->start = ax->count = NULL;
+  ax->coeff = NULL;
+}
+
+/**
+ * Builds the fixed-point weight table for one axis
+ *
+ * Pixel centers are aligned ((i + 0.5) * scale in input coordinates). When
+ * shrinking, the filter is stretched by the scale factor so that every input
+ * pixel contributes (area averaging for the box filter); when enlarging it
+ * keeps its natural width, which makes the triangle filter plain bilinear
+ * interpolation. Taps outside the image are dropped and the remaining
+ * weights renormalized.
+ *
+ * @param ax Table to fill
+ * @param in_size Number of input samples
+ * @param out_size Number of output samples
+ * @param f Filter kernel
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int resize_axis_init(ResizeAxis *ax, int in_size, int out_size,
+                            const FilterDef *f) {
+  double scale = (double)in_size / out_size;
+  double fscale = scale > 1.0 ? scale : 1.0;
+  double support = f->support * fscale;
+  int ksize = (int)ceil(support) * 2 + 1;
+  ax->ksize = ksize;
+  ax->start = (int *)malloc(sizeof(int) * out_size);
+  ax->count = (int *)malloc(sizeof(int) * out_size);
+  ax->coeff = (int32_t *)calloc((size_t)out_size * ksize, sizeof(int32_t));
+  double *w = (double *)malloc(sizeof(double) * ksize);
+  if (!ax->start || !ax->count || !ax->coeff || !w) {
+    resize_axis_free(ax);
+    free(w);
+    return -1;
+  }
+  for (int i = 0; i < out_size; i++) {
+    double center = (i + 0.5) * scale;
+    int lo = (int)(center - support + 0.5);
+    int hi = (int)(center + support + 0.5);
+    lo = lo < 0 ? 0 : lo;
+    hi = hi > in_size ? in_size : hi;
+    int n = hi - lo;
+    double sum = 0.0;
+    for (int k = 0; k < n; k++) {
+      w[k] = f->fn((lo + k - center + 0.5) / fscale);
+      sum += w[k];
+    }
+    if (sum == 0.0)
+      sum = 1.0;
+    // the fixed-point weights must sum to one exactly: the rounding residue
+    // goes to the largest tap
+    int32_t *c = ax->coeff + (size_t)i * ksize;
+    int32_t total = 0;
+    int big = 0;
+    for (int k = 0; k < n; k++) {
+      c[k] = (int32_t)lrint(w[k] / sum * (1 << RESIZE_PRECISION));
+      total += c[k];
+      if (c[k] > c[big])
+        big = k;
+    }
+    c[big] += (1 << RESIZE_PRECISION) - total;
+    ax->start[i] = lo;
+    ax->count[i] = n;
+  }
+  free(w);
+  return 0;
+}
+
+/**
+ * Rounds and clamps a fixed-point accumulator to 8 bits
+ */
+static inline unsigned char clip8(int32_t acc) {
+  acc >>= RESIZE_PRECISION;
+  return (unsigned char)(acc < 0 ? 0 : (acc > 255 ? 255 : acc));
+}
+
+/**
+ * Horizontal pass over one row
+ *
+ * Inlined into resize_row_h with constant channel counts so the channel loop
+ * unrolls and the accumulators stay in registers.
+ *
+ * @param in Input row
+ * @param out Output row of out_w pixels
+ * @param ax Horizontal weight table
+ * @param out_w Output width in pixels
+ * @param ch Number of interleaved channels (at most 4)
+ */
+static inline void resize_row_h_ch(const unsigned char *in, unsigned char *out,
+                                   const ResizeAxis *ax, int out_w, int ch) {
+  for (int x = 0; x < out_w; x++) {
+    const int32_t *c = ax->coeff + (size_t)x * ax->ksize;
+    const unsigned char *s = in + (size_t)ax->start[x] * ch;
+    int32_t acc[4] = {0};
+    for (int i = 0; i < ch; i++)
+      acc[i] = 1 << (RESIZE_PRECISION - 1);
+    for (int k = 0; k < ax->count[x]; k++, s += ch)
+      for (int i = 0; i < ch; i++)
+        acc[i] += s[i] * c[k];
+    for (int i = 0; i < ch; i++)
+      out[(size_t)x * ch + i] = clip8(acc[i]);
+  }
+}
+
+/**
+ * Horizontal pass over one row for any channel count
+ *
+ * @param in Input row
+ * @param out Output row of out_w pixels
+ * @param ax Horizontal weight table
+ * @param out_w Output width in pixels
+ * @param ch Number of interleaved channels
+ */
+static void resize_row_h_scalar(const unsigned char *in, unsigned char *out,
+                                const ResizeAxis *ax, int out_w, int ch) {
+  switch (ch) {
+  case 1:
+    resize_row_h_ch(in, out, ax, out_w, 1);
+    return;
+  case 3:
+    resize_row_h_ch(in, out, ax, out_w, 3);
+    return;
+  case 4:
+    resize_row_h_ch(in, out, ax, out_w, 4);
+    return;
+  }
+  for (int c0 = 0; c0 < ch; c0 += 4) {
+    int n = ch - c0 < 4 ? ch - c0 : 4;
+    for (int x = 0; x < out_w; x++) {
+      const int32_t *c = ax->coeff + (size_t)x * ax->ksize;
+      const unsigned char *s = in + (size_t)ax->start[x] * ch + c0;
+      for (int i = 0; i < n; i++) {
+        int32_t acc = 1 << (RESIZE_PRECISION - 1);
+        for (int k = 0; k < ax->count[x]; k++)
+          acc += s[(size_t)k * ch + i] * c[k];
+        out[(size_t)x * ch + c0 + i] = clip8(acc);
       }
     }
   }
-  return NULL;
 }
 
 /**
- * Resizes an image using multiple threads for concurrent processing.
+ * Vertical pass producing one output row
  *
- * This function performs image resizing by distributing the work across
- * multiple threads, where each thread processes a portion of the output image
- * rows. The image is resized from the source dimensions (w x h) to the new
- * dimensions (nw x nh).
- *
- * @param src Pointer to 3D array containing source image data
- * [height][width][channels]
- * @param w Width of the source image in pixels
- * @param h Height of the source image in pixels
- * @param channels Number of color channels in the image (e.g., 3 for RGB, 4 for
- * RGBA)
- * @param dst Pointer to 3D array where resized image data will be stored
- * [nh][nw][channels]
- * @param nw Target width of the resized image in pixels
- * @param nh Target height of the resized image in pixels
- * @param num_threads Number of worker threads to use for concurrent processing
+ * Accumulates whole rows, so the inner loop is a multiply-add over
+ * contiguous bytes that the compiler vectorizes.
  *
- * @return 0 on success, -1 on failure (memory allocation error or thread
- * creation failure)
+ * @param rows Input rows; row r lives at rows + (r - row_lo) * stride
+ * @param row_lo First row held in rows
+ * @param stride Bytes between input rows
+ * @param out Output row
+ * @param row_len Values per row (width * channels)
+ * @param start First input row of the filter window
+ * @param count Number of input rows in the window
+ * @param c Weights of the window
+ * @param acc Scratch of row_len accumulators
+ */
+static void resize_row_v_scalar(const unsigned char *rows, int row_lo,
+                                size_t stride, unsigned char *out,
+                                size_t row_len, int start, int count,
+                                const int32_t *c, int32_t *acc) {
+  for (size_t j = 0; j < row_len; j++)
+    acc[j] = 1 << (RESIZE_PRECISION - 1);
+  for (int k = 0; k < count; k++) {
+    const unsigned char *r = rows + (size_t)(start + k - row_lo) * stride;
+    int32_t w = c[k];
+    for (size_t j = 0; j < row_len; j++)
+      acc[j] += r[j] * w;
+  }
+  for (size_t j = 0; j < row_len; j++)
+    out[j] = clip8(acc[j]);
+}
+
+#ifdef CPU_X86
+// ------- SIMD passes -------
+
+/*
+ * The weights need 23 signed bits, too wide for pmaddwd, so samples are
+ * widened to 32 bits and multiplied with pmulld (SSE4.1 and up). Rounding,
+ * the shift and the clamp to 8 bits match clip8, so every variant writes the
+ * same bytes.
+ */
+
+/**
+ * Vertical pass over columns [j, row_len), one value at a time (the tail of
+ * the SIMD loops)
+ */
+static void resize_v_tail(const unsigned char *base, size_t stride,
+                          unsigned char *out, size_t j, size_t row_len,
+                          int count, const int32_t *c) {
+  for (; j < row_len; j++) {
+    int32_t acc = 1 << (RESIZE_PRECISION - 1);
+    for (int k = 0; k < count; k++)
+      acc += base[(size_t)k * stride + j] * c[k];
+    out[j] = clip8(acc);
+  }
+}
+
+/**
+ * Horizontal pass for RGB and RGBA with all channels of a pixel in one
+ * vector, inlined with a constant channel count
+ */
+__attribute__((target("sse4.1"))) static inline void
+resize_row_h_sse41_ch(const unsigned char *in, unsigned char *out,
+                      const ResizeAxis *ax, int out_w, const int ch) {
+  const __m128i round = _mm_set1_epi32(1 << (RESIZE_PRECISION - 1));
+  for (int x = 0; x < out_w; x++) {
+    const int32_t *c = ax->coeff + (size_t)x * ax->ksize;
+    const unsigned char *s = in + (size_t)ax->start[x] * ch;
+    __m128i acc = round;
+    for (int k = 0; k < ax->count[x]; k++, s += ch) {
+      // RGB is assembled from 3 bytes so the last pixel of the row is never
+      // overrun (a byte-wise copy through memory would stall the load)
+      uint32_t px;
+      if (ch == 4)
+        memcpy(&px, s, 4);
+      else
+        px = s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16;
+      __m128i p = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int)px));
+      acc = _mm_add_epi32(acc, _mm_mullo_epi32(p, _mm_set1_epi32(c[k])));
+    }
+    acc = _mm_srai_epi32(acc, RESIZE_PRECISION);
+    acc = _mm_packs_epi32(acc, acc);
+    uint32_t px = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+    memcpy(out + (size_t)x * ch, &px, ch);
+  }
+}
+
+__attribute__((target("sse4.1"))) static void
+resize_row_h_sse41(const unsigned char *in, unsigned char *out,
+                   const ResizeAxis *ax, int out_w, int ch) {
+  if (ch == 4)
+    resize_row_h_sse41_ch(in, out, ax, out_w, 4);
+  else if (ch == 3)
+    resize_row_h_sse41_ch(in, out, ax, out_w, 3);
+  else
+    resize_row_h_scalar(in, out, ax, out_w, ch);
+}
+
+/*
+ * Vertical passes keep a block of columns in registers across all rows of
+ * the window instead of accumulating whole rows in memory.
+ */
+__attribute__((target("sse4.1"))) static void
+resize_row_v_sse41(const unsigned char *rows, int row_lo, size_t stride,
+                   unsigned char *out, size_t row_len, int start, int count,
+                   const int32_t *c, int32_t *acc) {
+  (void)acc;
+  const unsigned char *base = rows + (size_t)(start - row_lo) * stride;
+  const __m128i round = _mm_set1_epi32(1 << (RESIZE_PRECISION - 1));
+  size_t j = 0;
+  for (; j + 16 <= row_len; j += 16) {
+    __m128i a0 = round, a1 = round, a2 = round, a3 = round;
+    for (int k = 0; k < count; k++) {
+      __m128i w = _mm_set1_epi32(c[k]);
+      __m128i p =
+          _mm_loadu_si128((const __m128i *)(base + (size_t)k * stride + j));
+      a0 = _mm_add_epi32(a0, _mm_mullo_epi32(_mm_cvtepu8_epi32(p), w));
+      a1 = _mm_add_epi32(
+          a1, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(p, 4)), w));
+      a2 = _mm_add_epi32(
+          a2, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(p, 8)), w));
+      a3 = _mm_add_epi32(
+          a3, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(p, 12)), w));
+    }
+    __m128i lo = _mm_packs_epi32(_mm_srai_epi32(a0, RESIZE_PRECISION),
+                                 _mm_srai_epi32(a1, RESIZE_PRECISION));
+    __m128i hi = _mm_packs_epi32(_mm_srai_epi32(a2, RESIZE_PRECISION),
+                                 _mm_srai_epi32(a3, RESIZE_PRECISION));
+    _mm_storeu_si128((__m128i *)(out + j), _mm_packus_epi16(lo, hi));
+  }
+  resize_v_tail(base, stride, out, j, row_len, count, c);
+}
+
+__attribute__((target("avx2"))) static void
+resize_row_v_avx2(const unsigned char *rows, int row_lo, size_t stride,
+                  unsigned char *out, size_t row_len, int start, int count,
+                  const int32_t *c, int32_t *acc) {
+  (void)acc;
+  const unsigned char *base = rows + (size_t)(start - row_lo) * stride;
+  const __m256i round = _mm256_set1_epi32(1 << (RESIZE_PRECISION - 1));
+  // the in-lane packs leave 4-byte groups as 0 2 4 6 | 1 3 5 7
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  size_t j = 0;
+  for (; j + 32 <= row_len; j += 32) {
+    __m256i a0 = round, a1 = round, a2 = round, a3 = round;
+    for (int k = 0; k < count; k++) {
+      __m256i w = _mm256_set1_epi32(c[k]);
+      const unsigned char *r = base + (size_t)k * stride + j;
+#define WIDEN8(o)                                                              \
+  _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(r + (o))))
+      a0 = _mm256_add_epi32(a0, _mm256_mullo_epi32(WIDEN8(0), w));
+      a1 = _mm256_add_epi32(a1, _mm256_mullo_epi32(WIDEN8(8), w));
+      a2 = _mm256_add_epi32(a2, _mm256_mullo_epi32(WIDEN8(16), w));
+      a3 = _mm256_add_epi32(a3, _mm256_mullo_epi32(WIDEN8(24), w));
+#undef WIDEN8
+    }
+    __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(a0, RESIZE_PRECISION),
+                                    _mm256_srai_epi32(a1, RESIZE_PRECISION));
+    __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(a2, RESIZE_PRECISION),
+                                    _mm256_srai_epi32(a3, RESIZE_PRECISION));
+    _mm256_storeu_si256(
+        (__m256i *)(out + j),
+        _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order));
+  }
+  resize_v_tail(base, stride, out, j, row_len, count, c);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+resize_row_v_avx512(const unsigned char *rows, int row_lo, size_t stride,
+                    unsigned char *out, size_t row_len, int start, int count,
+                    const int32_t *c, int32_t *acc) {
+  (void)acc;
+  const unsigned char *base = rows + (size_t)(start - row_lo) * stride;
+  const __m512i round = _mm512_set1_epi32(1 << (RESIZE_PRECISION - 1));
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i max = _mm512_set1_epi32(255);
+  size_t j = 0;
+  for (; j + 64 <= row_len; j += 64) {
+    __m512i a[4] = {round, round, round, round};
+    for (int k = 0; k < count; k++) {
+      __m512i w = _mm512_set1_epi32(c[k]);
+      const unsigned char *r = base + (size_t)k * stride + j;
+      for (int i = 0; i < 4; i++)
+        a[i] = _mm512_add_epi32(
+            a[i], _mm512_mullo_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128(
+                                         (const __m128i *)(r + 16 * i))),
+                                     w));
+    }
+    // clamp in 32 bits, then narrow with plain truncation
+    for (int i = 0; i < 4; i++) {
+      __m512i v = _mm512_srai_epi32(a[i], RESIZE_PRECISION);
+      v = _mm512_min_epi32(_mm512_max_epi32(v, zero), max);
+      _mm_storeu_si128((__m128i *)(out + j + 16 * i), _mm512_cvtepi32_epi8(v));
+    }
+  }
+  resize_v_tail(base, stride, out, j, row_len, count, c);
+}
+#endif
+
+/**
+ * Selects the widest row passes allowed by cpu_isa()
  *
- * @note The destination image buffer must be pre-allocated before calling this
- * function
- * @note If thread creation fails, all previously created threads are properly
- * joined
- * @note Work is distributed evenly among threads with remainder rows assigned
- * to first threads
- */
-int resize_concurrent(unsigned char ***src, int w, int h, int channels,
-                      unsigned char ***dst, int nw, int nh, int num_threads) {
-  WorkArgs base = {
-      .src = src, .dst = dst, .width = w, .height = h, .channels = channels};
-
-  // Create array of ResizeArgs for each thread
-  ResizeArgs *thread_args = malloc(num_threads * sizeof(ResizeArgs));
-  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
-
-  // Check memory allocation
-  if (!thread_args || !threads) {
-    free(thread_args);
-    free(threads);
-    return -1;
+ * Runs once through pthread_once when the first plan is built. Both passes
+ * need pmulld, so below SSE4.1 they stay scalar; the horizontal pass, which
+ * blends one pixel at a time, tops out at SSE4.1.
+ */
+static void select_isa(void) {
+  resize_row_h = resize_row_h_scalar;
+  resize_row_v = resize_row_v_scalar;
+#ifdef CPU_X86
+  CpuIsa isa = cpu_isa();
+  if (isa >= CPU_ISA_SSE41) {
+    resize_row_h = resize_row_h_sse41;
+    resize_row_v = resize_row_v_sse41;
   }
+  if (isa >= CPU_ISA_AVX2)
+    resize_row_v = resize_row_v_avx2;
+  if (isa >= CPU_ISA_AVX512)
+    resize_row_v = resize_row_v_avx512;
+#endif
+}
 
-  int rows_per_thread = nh / num_threads;
-  int remainder = nh % num_threads;
+/**
+ * Worker thread function for two-pass separable resizing.
+ *
+ * Processes its destination rows in strips of RESIZE_STRIP_ROWS. For each
+ * strip, the source rows covered by the vertical filter windows are first
+ * resampled horizontally into a private buffer, then every destination row
+ * is produced by a vertical pass over that buffer. An axis whose size does
+ * not change skips its pass.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src: Source image
+ *          - dst: Destination image (its width and height are the new size)
+ *          - y0, y1: Destination row range for this worker
+ *          - ctx: ResizePlan with the weight tables
+ *
+ * @return NULL on success, WORKER_FAILED if the buffers cannot be allocated
+ */
+static void *worker_resize(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const ResizePlan *plan = (const ResizePlan *)a->ctx;
+  const ResizeAxis *v = &plan->v;
+  int ch = a->channels, nw = a->dst->width;
+  int need_h = plan->need_h, need_v = plan->need_v;
+  size_t row_len = (size_t)nw * ch;
 
-  for (int i = 0; i < num_threads; i++) {
-    thread_args[i].a = base;
-    thread_args[i].nw = nw;
-    thread_args[i].nh = nh;
+  if (!need_v) {
+    for (int y = a->y0; y < a->y1; y++)
+      resize_row_h(work_src_row(a, y), work_dst_row(a, y), &plan->h, nw,
+                   ch);
+    return NULL;
+  }
 
-    // Calculate row range for this thread
-    thread_args[i].a.y0 = i * rows_per_thread + (i < remainder ? i : remainder);
-    thread_args[i].a.y1 =
-        thread_args[i].a.y0 + rows_per_thread + (i < remainder ? 1 : 0);
+  // the largest window of source rows any strip needs
+  int span = 0;
+  for (int s0 = a->y0; s0 < a->y1; s0 += RESIZE_STRIP_ROWS) {
+    int s1 = s0 + RESIZE_STRIP_ROWS < a->y1 ? s0 + RESIZE_STRIP_ROWS : a->y1;
+    int n = v->start[s1 - 1] + v->count[s1 - 1] - v->start[s0];
+    span = n > span ? n : span;
+  }
+  unsigned char *buf = need_h ? (unsigned char *)malloc(row_len * span) : NULL;
+  int32_t *acc = (int32_t *)malloc(sizeof(int32_t) * row_len);
+  if ((need_h && !buf) || !acc) {
+    free(buf);
+    free(acc);
+    return WORKER_FAILED;
+  }
 
-    // Check pthread_create
-    if (pthread_create(&threads[i], NULL, worker_resize, &thread_args[i]) !=
-        0) {
-      // Join already created threads
-      for (int j = 0; j < i; j++) {
-        pthread_join(threads[j], NULL);
-      }
-      free(thread_args);
-      free(threads);
-      return -1;
+  for (int s0 = a->y0; s0 < a->y1; s0 += RESIZE_STRIP_ROWS) {
+    int s1 = s0 + RESIZE_STRIP_ROWS < a->y1 ? s0 + RESIZE_STRIP_ROWS : a->y1;
+    int lo = v->start[s0], hi = v->start[s1 - 1] + v->count[s1 - 1];
+    const unsigned char *rows = work_src_row(a, lo);
+    size_t stride = a->src->stride;
+    if (need_h) {
+      for (int y = lo; y < hi; y++)
+        resize_row_h(work_src_row(a, y), buf + (size_t)(y - lo) * row_len,
+                     &plan->h, nw, ch);
+      rows = buf;
+      stride = row_len;
     }
+    for (int y = s0; y < s1; y++)
+      resize_row_v(rows, lo, stride, work_dst_row(a, y), row_len,
+                   v->start[y], v->count[y],
+                   v->coeff + (size_t)y * v->ksize, acc);
+  }
+  free(buf);
+  free(acc);
+  return NULL;
+}
+
+/**
+ * Releases the tables of a resize plan
+ *
+ * @param plan Plan to release; safe on a zeroed or already released plan
+ */
+static void resize_plan_free(void *plan) {
+  ResizePlan *p = (ResizePlan *)plan;
+  resize_axis_free(&p->h);
+  resize_axis_free(&p->v);
+}
+
+/**
+ * Builds the horizontal and vertical weight tables of a resize
+ *
+ * @param plan Plan to fill; release with resize_plan_free
+ * @param in_w Source width
+ * @param in_h Source height
+ * @param out_w Destination width
+ * @param out_h Destination height
+ * @param filter Resampling filter
+ *
+ * @return 0 on success, -1 on invalid arguments or allocation failure (an
+ * error is printed to stderr)
+ */
+static int resize_plan_init(ResizePlan *plan, int in_w, int in_h, int out_w,
+                            int out_h, ResizeFilter filter) {
+  ResizePlan empty = {0};
+  *plan = empty;
+  pthread_once(&isa_once, select_isa);
+  uint64_t t0 = profile_enabled() ? profile_now() : 0;
+  if ((unsigned)filter >= sizeof(filters) / sizeof(filters[0]) || out_w < 1 ||
+      out_h < 1) {
+    fprintf(stderr, "Resize: invalid filter or destination\n");
+    return -1;
+  }
+  if (resize_axis_init(&plan->h, in_w, out_w, &filters[filter]) ||
+      resize_axis_init(&plan->v, in_h, out_h, &filters[filter])) {
+    fprintf(stderr, "Resize: failed to allocate filter tables\n");
+    resize_plan_free(plan);
+    return -1;
   }
+  plan->need_h = out_w != in_w;
+  plan->need_v = out_h != in_h;
+  if (profile_enabled())
+    profile_record("resize_tables", profile_now() - t0, out_h,
+                   sizeof(int32_t) * ((size_t)plan->h.ksize * out_w +
+                                      (size_t)plan->v.ksize * out_h));
+  return 0;
+}
 
-  // Wait for all threads
-  for (int i = 0; i < num_threads; i++) {
-    pthread_join(threads[i], NULL);
+/**
+ * Resizes an image with a selectable resampling filter using multiple threads.
+ *
+ * Filter weights for every output column and row are computed once per call
+ * in fixed point; the workers then run a horizontal and a vertical pass over
+ * 8-bit data. When shrinking, each filter is widened by the scale factor so
+ * that all covered source pixels contribute, which avoids aliasing on large
+ * reductions.
+ *
+ * @param src Source image (e.g., 3 channels for RGB, 4 for RGBA)
+ * @param dst Destination image; its width and height give the target size and
+ * its channel count must match src
+ * @param filter Resampling filter
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure (invalid arguments, memory allocation
+ * error or thread pool failure)
+ */
+int resize_filter_concurrent(const Image *src, Image *dst, ResizeFilter filter,
+                             int num_threads) {
+  if (dst->channels != src->channels) {
+    fprintf(stderr, "Resize: channel count mismatch\n");
+    return -1;
   }
+  ResizePlan plan;
+  if (resize_plan_init(&plan, src->width, src->height, dst->width,
+                       dst->height, filter) != 0)
+    return -1;
+  WorkArgs base = {.src = src,
+                   .dst = dst,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .ctx = &plan,
+                   .name = "resize",
+                   .schedule = SCHED_GUIDED};
+  int rc = launch_threads_by_rows(worker_resize, base, num_threads);
+  resize_plan_free(&plan);
+  return rc;
+}
+
+/**
+ * Frees a heap-allocated resize plan owned by a pipeline stage
+ */
+static void resize_plan_release(void *plan) {
+  resize_plan_free(plan);
+  free(plan);
+}
+
+/**
+ * Source rows read by the vertical filter windows of output rows [y0, y1)
+ */
+static void resize_footprint(const PipelineStage *st, int y0, int y1, int *lo,
+                             int *hi) {
+  const ResizePlan *plan = (const ResizePlan *)st->state;
+  if (!plan->need_v) {
+    *lo = y0;
+    *hi = y1;
+    return;
+  }
+  *lo = plan->v.start[y0];
+  *hi = plan->v.start[y1 - 1] + plan->v.count[y1 - 1];
+}
 
-  free(thread_args);
-  free(threads);
+/**
+ * Prepares resize_filter_concurrent as a pipeline stage
+ *
+ * The weight tables are built once here and shared by every strip; the
+ * footprint of a strip is the union of its vertical filter windows.
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param out_w Output width
+ * @param out_h Output height
+ * @param filter Resampling filter
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int resize_stage(int width, int height, int channels, int out_w, int out_h,
+                 ResizeFilter filter, PipelineStage *st) {
+  PipelineStage empty = {0};
+  *st = empty;
+  ResizePlan *plan = (ResizePlan *)malloc(sizeof(ResizePlan));
+  if (!plan)
+    return -1;
+  if (resize_plan_init(plan, width, height, out_w, out_h, filter) != 0) {
+    free(plan);
+    return -1;
+  }
+  st->worker = worker_resize;
+  st->args.width = width;
+  st->args.height = height;
+  st->args.channels = channels;
+  st->args.ctx = plan;
+  st->args.name = "resize";
+  st->width = out_w;
+  st->height = out_h;
+  st->footprint = resize_footprint;
+  st->state = plan;
+  st->release = resize_plan_release;
   return 0;
 }
+
+/**
+ * Resizes an image using multiple threads for concurrent processing.
+ *
+ * Same as resize_filter_concurrent with RESIZE_BILINEAR: plain bilinear
+ * interpolation when enlarging, a triangle filter covering every source pixel
+ * when shrinking.
+ *
+ * @param src Source image (e.g., 3 channels for RGB, 4 for RGBA)
+ * @param dst Destination image; its width and height give the target size and
+ * its channel count must match src
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure (memory allocation error or thread
+ * pool failure)
+ *
+ * @note The destination image buffer must be pre-allocated before calling this
+ * function
+ * @note Output rows are split among the shared pool workers by
+ * launch_threads_by_rows
+ */
+int resize_concurrent(const Image *src, Image *dst, int num_threads) {
+  return resize_filter_concurrent(src, dst, RESIZE_BILINEAR, num_threads);
+}
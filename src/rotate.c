@@ -1,60 +1,34 @@
 #include "rotate.h"
+#include "sampler.h"
 #include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Edge of the square tiles walked by the exact orientation paths, in pixels
+#define ORIENT_TILE 32
 
 /**
- * Performs bilinear interpolation to sample a pixel value from a 3D image
- * array.
- *
- * This function calculates an interpolated pixel value at floating-point
- * coordinates by sampling the four nearest integer pixel coordinates and
- * computing a weighted average based on the fractional parts of the input
- * coordinates.
- *
- * The interpolation works in two steps:
- * 1. Linear interpolation along the x-axis between (x0,y0)-(x1,y0) and
- * (x0,y1)-(x1,y1)
- * 2. Linear interpolation along the y-axis between the results from step 1
- *
- * Boundary conditions are handled by clamping coordinates to valid image
- * bounds.
- *
- * @param src    3D array representing the source image
- * [height][width][channels]
- * @param w      Width of the source image in pixels
- * @param h      Height of the source image in pixels
- * @param c      Channel index to sample from
- * @param xf     Floating-point x-coordinate to sample at
- * @param yf     Floating-point y-coordinate to sample at
- *
- * @return       Interpolated pixel value as an unsigned char, rounded to
- * nearest integer
+ * Integer pixel map of an exact orientation change
+ *
+ * Destination pixel (x, y) reads source pixel
+ * (ox + ax * x + bx * y, oy + ay * x + by * y), with every coefficient in
+ * {-1, 0, 1}, which covers the rotations by multiples of 90 degrees and the
+ * flips.
  */
-static unsigned char bilinear(unsigned char ***src, int w, int h, int c,
-                              float xf, float yf) {
-  int x0 = (int)floorf(xf), y0 = (int)floorf(yf);
-  int x1 = x0 + 1, y1 = y0 + 1;
-  if (x0 < 0)
-    x0 = 0;
-  if (y0 < 0)
-    y0 = 0;
-  if (x1 >= w)
-    x1 = w - 1;
-  if (y1 >= h)
-    y1 = h - 1;
-  float tx = xf - x0, ty = yf - y0;
-  float v00 = src[y0][x0][c], v10 = src[y0][x1][c];
-  float v01 = src[y1][x0][c], v11 = src[y1][x1][c];
-  float v0 = v00 * (1 - tx) + v10 * tx;
-  float v1 = v01 * (1 - tx) + v11 * tx;
-  return (unsigned char)lrintf(v0 * (1 - ty) + v1 * ty);
-}
+typedef struct {
+  int ox, ax, bx;
+  int oy, ay, by;
+} OrientMap;
 
 /**
  * Worker thread function for image rotation using bilinear interpolation.
  *
  * This function rotates a portion of an image by applying a rotation matrix
  * to map destination pixels back to source coordinates (inverse mapping).
- * Uses bilinear interpolation for smooth pixel value computation.
+ * The inverse map is affine, so every output row is a straight line through
+ * the source, handed to the shared sampler with its start and step.
  *
  * @param p Pointer to WorkArgs structure containing:
  *          - ang_rad: Rotation angle in radians
@@ -74,24 +48,206 @@ static unsigned char bilinear(unsigned char ***src, int w, int h, int c,
 static void *worker_rotate(void *p) {
   WorkArgs *a = (WorkArgs *)p;
   float cosA = cosf(a->ang_rad), sinA = sinf(a->ang_rad);
-  float cx = a->cx, cy = a->cy;
+  double cx = a->cx, cy = a->cy;
+  SampleSource s = sample_source(a);
   for (int y = a->y0; y < a->y1; y++) {
-    for (int x = 0; x < a->width; x++) {
-      float xd = x - cx, yd = y - cy;
-      // inverse mapping
-      float xs = cosA * xd + sinA * yd + cx;
-      float ys = -sinA * xd + cosA * yd + cy;
-      for (int c = 0; c < a->channels; c++) {
-        unsigned char val = 0;
-        if (xs >= 0 && xs < a->width && ys >= 0 && ys < a->height)
-          val = bilinear(a->src, a->width, a->height, c, xs, ys);
-        a->dst[y][x][c] = val;
+    double yd = y - cy;
+    // inverse mapping of (0, y); each output pixel steps by (cos, -sin)
+    double xs = cosA * -cx + sinA * yd + cx;
+    double ys = sinA * cx + cosA * yd + cy;
+    sample_bilinear_line(&s, xs, ys, cosA, -sinA, work_dst_row(a, y),
+                         a->width);
+  }
+  return NULL;
+}
+
+/**
+ * Copies one pixel of a known channel count
+ *
+ * The switch lets the compiler turn the common channel counts into fixed-size
+ * moves instead of a memcpy call per pixel.
+ *
+ * @param d Destination pixel
+ * @param s Source pixel
+ * @param ch Number of channels
+ */
+static inline void copy_px(unsigned char *d, const unsigned char *s, int ch) {
+  switch (ch) {
+  case 1:
+    d[0] = s[0];
+    break;
+  case 3:
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+    break;
+  case 4:
+    memcpy(d, s, 4);
+    break;
+  default:
+    memcpy(d, s, ch);
+  }
+}
+
+/**
+ * Worker thread function for exact orientation changes (multiples of 90
+ * degrees and flips)
+ *
+ * Walks its destination rows in ORIENT_TILE x ORIENT_TILE tiles. For a
+ * transpose-like map, consecutive destination pixels step down a source
+ * column, so a tile keeps the ORIENT_TILE source rows it reads in cache while
+ * every destination row of the tile is written. Maps that keep source rows
+ * horizontal (flips, 180 degrees) simply walk each row backwards, and
+ * vertical flips become one memcpy per row.
+ *
+ * @param p Pointer to WorkArgs structure containing:
+ *          - src: Source image data
+ *          - dst: Destination image data buffer
+ *          - y0, y1: Destination row range for this worker thread
+ *          - channels: Number of color channels
+ *          - ctx: OrientMap describing the pixel map
+ *
+ * @return NULL (standard pthread worker return value)
+ */
+static void *worker_orient(void *p) {
+  WorkArgs *a = (WorkArgs *)p;
+  const OrientMap *m = (const OrientMap *)a->ctx;
+  const Image *src = a->src;
+  int ch = a->channels, w = a->dst->width;
+  ptrdiff_t step_x = (ptrdiff_t)m->ax * ch + (ptrdiff_t)m->ay * src->stride;
+
+  if (step_x == ch) {
+    for (int y = a->y0; y < a->y1; y++)
+      memcpy(work_dst_row(a, y),
+             work_src_row(a, m->oy + m->by * y) + (m->ox + m->bx * y) * ch,
+             (size_t)w * ch);
+    return NULL;
+  }
+  for (int ty = a->y0; ty < a->y1; ty += ORIENT_TILE) {
+    int ty1 = ty + ORIENT_TILE < a->y1 ? ty + ORIENT_TILE : a->y1;
+    for (int tx = 0; tx < w; tx += ORIENT_TILE) {
+      int tx1 = tx + ORIENT_TILE < w ? tx + ORIENT_TILE : w;
+      for (int y = ty; y < ty1; y++) {
+        // source pixel of (0, y); rows are addressed relative to src_y0
+        const unsigned char *s0 =
+            work_src_row(a, m->oy + m->by * y) + (m->ox + m->bx * y) * ch;
+        unsigned char *o = work_dst_row(a, y) + (size_t)tx * ch;
+        const unsigned char *s = s0 + tx * step_x;
+        for (int x = tx; x < tx1; x++, o += ch, s += step_x)
+          copy_px(o, s, ch);
       }
     }
   }
   return NULL;
 }
 
+/**
+ * Runs an exact orientation map after checking the destination geometry
+ *
+ * @param src Source image
+ * @param dst Destination image
+ * @param m Pixel map
+ * @param transposed Nonzero when the map swaps width and height
+ * @param name Operator name in profiling reports
+ * @param num_threads Number of worker threads
+ *
+ * @return 0 on success, -1 if dst does not have the mapped geometry
+ */
+static int orient_concurrent(const Image *src, Image *dst, const OrientMap *m,
+                             int transposed, const char *name,
+                             int num_threads) {
+  int w = transposed ? src->height : src->width;
+  int h = transposed ? src->width : src->height;
+  if (dst->width != w || dst->height != h || dst->channels != src->channels) {
+    fprintf(stderr, "Orientation: destination must be %dx%dx%d\n", w, h,
+            src->channels);
+    return -1;
+  }
+  WorkArgs base = {.src = src,
+                   .dst = dst,
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .ctx = m,
+                   .name = name};
+  return launch_threads_by_rows(worker_orient, base, num_threads);
+}
+
+/**
+ * Pixel map of a clockwise rotation by quarter_turns * 90 degrees
+ *
+ * @param w Source width
+ * @param h Source height
+ * @param quarter_turns Number of clockwise quarter turns (any integer)
+ * @return The map
+ */
+static OrientMap quarter_turn_map(int w, int h, int quarter_turns) {
+  switch (((quarter_turns % 4) + 4) % 4) {
+  case 0: // dst(x, y) = src(x, y)
+    return (OrientMap){0, 1, 0, 0, 0, 1};
+  case 1: // dst(x, y) = src(y, H - 1 - x)
+    return (OrientMap){0, 0, 1, h - 1, -1, 0};
+  case 2: // dst(x, y) = src(W - 1 - x, H - 1 - y)
+    return (OrientMap){w - 1, -1, 0, h - 1, 0, -1};
+  default: // dst(x, y) = src(W - 1 - y, x)
+    return (OrientMap){w - 1, 0, -1, 0, 1, 0};
+  }
+}
+
+/**
+ * Pixel map of a mirror image
+ *
+ * @param w Source width
+ * @param h Source height
+ * @param axis Mirror axis
+ * @return The map
+ */
+static OrientMap flip_map(int w, int h, FlipAxis axis) {
+  return axis == FLIP_HORIZONTAL ? (OrientMap){w - 1, -1, 0, 0, 0, 1}
+                                 : (OrientMap){0, 1, 0, h - 1, 0, -1};
+}
+
+/**
+ * Rotates an image clockwise by a multiple of 90 degrees without resampling.
+ *
+ * Every output pixel is an exact copy of one source pixel, so the operation
+ * is lossless and reversible. Odd quarter turns swap the output dimensions,
+ * so nothing is clipped.
+ *
+ * @param src Source image
+ * @param dst Destination image: src->height x src->width for odd quarter
+ * turns, same geometry as src otherwise
+ * @param quarter_turns Number of clockwise quarter turns (any integer;
+ * negative values turn counterclockwise)
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure (wrong destination geometry or thread
+ * launch error)
+ */
+int rotate90_concurrent(const Image *src, Image *dst, int quarter_turns,
+                        int num_threads) {
+  OrientMap m = quarter_turn_map(src->width, src->height, quarter_turns);
+  return orient_concurrent(src, dst, &m, quarter_turns % 2 != 0, "rotate90",
+                           num_threads);
+}
+
+/**
+ * Mirrors an image horizontally or vertically.
+ *
+ * @param src Source image
+ * @param dst Destination image with the same geometry as src
+ * @param axis FLIP_HORIZONTAL mirrors left-right, FLIP_VERTICAL top-bottom
+ * @param num_threads Number of worker threads to use for concurrent processing
+ *
+ * @return 0 on success, -1 on failure (wrong destination geometry or thread
+ * launch error)
+ */
+int flip_concurrent(const Image *src, Image *dst, FlipAxis axis,
+                    int num_threads) {
+  OrientMap m = flip_map(src->width, src->height, axis);
+  return orient_concurrent(src, dst, &m, 0, "flip", num_threads);
+}
+
 /**
  * Rotates an image using multiple threads for concurrent processing.
  *
@@ -99,13 +255,8 @@ static void *worker_rotate(void *p) {
  * worker threads to process different rows concurrently for improved
  * performance. The rotation is performed around the center of the image.
  *
- * @param src Pointer to the source image data (3D array:
- * [height][width][channels])
- * @param dst Pointer to the destination image data (3D array:
- * [height][width][channels])
- * @param width Width of the image in pixels
- * @param height Height of the image in pixels
- * @param channels Number of color channels (e.g., 3 for RGB, 4 for RGBA)
+ * @param src Source image (e.g., 3 channels for RGB, 4 for RGBA)
+ * @param dst Destination image with the same geometry as src
  * @param ang_deg Rotation angle in degrees (positive values rotate clockwise)
  * @param num_threads Number of worker threads to use for concurrent processing
  *
@@ -114,17 +265,156 @@ static void *worker_rotate(void *p) {
  * @note The rotation center is calculated as ((width-1)/2, (height-1)/2)
  * @note The angle is internally converted from degrees to radians for
  * computation
+ * @note Multiples of 90 degrees whose rotated canvas equals dst (180 degrees,
+ * or any quarter turn of a square image) use the exact rotate90_concurrent
+ * path instead of resampling
  */
-int rotate_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                      int height, int channels, float ang_deg,
+int rotate_concurrent(const Image *src, Image *dst, float ang_deg,
                       int num_threads) {
+  float turns = ang_deg / 90.0f;
+  if (turns == rintf(turns) && fabsf(turns) < 1e6f) {
+    int q = (int)turns;
+    if (q % 2 == 0 || src->width == src->height)
+      return rotate90_concurrent(src, dst, q, num_threads);
+  }
   WorkArgs base = {.src = src,
                    .dst = dst,
-                   .width = width,
-                   .height = height,
-                   .channels = channels};
-  base.cx = (width - 1) / 2.0f;
-  base.cy = (height - 1) / 2.0f;
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .name = "rotate",
+                   .schedule = SCHED_GUIDED};
+  base.cx = (src->width - 1) / 2.0f;
+  base.cy = (src->height - 1) / 2.0f;
   base.ang_rad = ang_deg * (float)M_PI / 180.0f;
   return launch_threads_by_rows(worker_rotate, base, num_threads);
 }
+
+/**
+ * Source rows read by an exact orientation map for output rows [y0, y1)
+ *
+ * The map is affine, so the extreme source rows are reached at the corners
+ * of the output band; transposes therefore need every source row.
+ */
+static void orient_footprint(const PipelineStage *st, int y0, int y1, int *lo,
+                             int *hi) {
+  const OrientMap *m = (const OrientMap *)st->state;
+  int xs[2] = {0, st->width - 1}, ys[2] = {y0, y1 - 1};
+  *lo = st->args.height;
+  *hi = 0;
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 2; j++) {
+      int sy = m->oy + m->ay * xs[i] + m->by * ys[j];
+      *lo = sy < *lo ? sy : *lo;
+      *hi = sy + 1 > *hi ? sy + 1 : *hi;
+    }
+}
+
+/**
+ * Source rows sampled by the bilinear warp for output rows [y0, y1)
+ *
+ * The inverse-mapped row coordinate is linear in x and y, so its extremes are
+ * at the corners of the output band. One row of margin on each side absorbs
+ * float rounding between this estimate and the worker's per-pixel values.
+ */
+static void warp_footprint(const PipelineStage *st, int y0, int y1, int *lo,
+                           int *hi) {
+  const WorkArgs *a = &st->args;
+  float sinA = sinf(a->ang_rad), cosA = cosf(a->ang_rad);
+  float xd[2] = {-a->cx, a->width - 1 - a->cx};
+  float yd[2] = {y0 - a->cy, y1 - 1 - a->cy};
+  float mn = INFINITY, mx = -INFINITY;
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 2; j++) {
+      float ys = -sinA * xd[i] + cosA * yd[j] + a->cy;
+      mn = ys < mn ? ys : mn;
+      mx = ys > mx ? ys : mx;
+    }
+  float l = floorf(mn) - 1, h = floorf(mx) + 3;
+  *lo = l < 0 ? 0 : l > a->height ? a->height : (int)l;
+  *hi = h > a->height ? a->height : h < *lo ? *lo : (int)h;
+}
+
+/**
+ * Fills a stage running worker_orient with a heap copy of a map, reported
+ * under name when profiling
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int orient_stage(int width, int height, int channels,
+                        const OrientMap *m, int transposed, const char *name,
+                        PipelineStage *st) {
+  OrientMap *copy = (OrientMap *)malloc(sizeof(OrientMap));
+  if (!copy)
+    return -1;
+  *copy = *m;
+  st->worker = worker_orient;
+  st->args.width = width;
+  st->args.height = height;
+  st->args.channels = channels;
+  st->args.ctx = copy;
+  st->args.name = name;
+  st->width = transposed ? height : width;
+  st->height = transposed ? width : height;
+  st->footprint = orient_footprint;
+  st->state = copy;
+  return 0;
+}
+
+/**
+ * Prepares a rotation as a pipeline stage
+ *
+ * Multiples of 90 degrees become exact pixel moves, and odd quarter turns
+ * swap the output dimensions (as rotate90_concurrent); other angles resample
+ * onto a canvas of the input size (as rotate_concurrent).
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param ang_deg Clockwise rotation angle in degrees
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+int rotate_stage(int width, int height, int channels, float ang_deg,
+                 PipelineStage *st) {
+  PipelineStage empty = {0};
+  *st = empty;
+  float turns = ang_deg / 90.0f;
+  if (turns == rintf(turns) && fabsf(turns) < 1e6f) {
+    OrientMap m = quarter_turn_map(width, height, (int)turns);
+    return orient_stage(width, height, channels, &m, (int)turns % 2 != 0,
+                        "rotate90", st);
+  }
+  st->worker = worker_rotate;
+  st->args.width = width;
+  st->args.height = height;
+  st->args.channels = channels;
+  st->args.cx = (width - 1) / 2.0f;
+  st->args.cy = (height - 1) / 2.0f;
+  st->args.ang_rad = ang_deg * (float)M_PI / 180.0f;
+  st->args.name = "rotate";
+  st->width = width;
+  st->height = height;
+  st->footprint = warp_footprint;
+  return 0;
+}
+
+/**
+ * Prepares flip_concurrent as a pipeline stage
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param axis Mirror axis
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+int flip_stage(int width, int height, int channels, FlipAxis axis,
+               PipelineStage *st) {
+  PipelineStage empty = {0};
+  *st = empty;
+  OrientMap m = flip_map(width, height, axis);
+  return orient_stage(width, height, channels, &m, 0, "flip", st);
+}
@@ -0,0 +1,459 @@
+#include "sampler.h"
+#include "cpu_dispatch.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Positions are stepped along a line in 32.32 fixed point, so rounding the
+// step does not drift by a visible fraction even across 2^24 pixels
+#define POS_BITS 32
+#define POS_TO_FRAC (POS_BITS - SAMPLE_FRAC_BITS)
+// Weight of a whole pixel along one axis, and the normalization of the sum
+#define W_ONE (1 << SAMPLE_FRAC_BITS)
+#define SUM_SHIFT (2 * SAMPLE_FRAC_BITS)
+#define SUM_ROUND (1 << (SUM_SHIFT - 1))
+
+typedef void (*LineFn)(const SampleSource *, int64_t, int64_t, int64_t,
+                       int64_t, unsigned char *, int);
+
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+static LineFn impl_line;
+static const char *impl_name = "scalar";
+
+/**
+ * Neighbourhood of one sample: the two source rows and columns it blends and
+ * its fractional offsets from the upper-left neighbour
+ */
+typedef struct {
+  const unsigned char *r0, *r1; // upper and lower row
+  int x0, x1;                   // left and right column
+  int fx, fy;                   // offsets in 1/W_ONE pixel
+} Taps;
+
+/**
+ * Locates a fixed-point position in the source
+ *
+ * The position is rounded to the nearest 1/W_ONE pixel; a position in the
+ * last half step before the right or bottom edge rounds onto the clamped
+ * edge pixel, which it samples with full weight.
+ *
+ * @param s Source
+ * @param x Column in 32.32 fixed point
+ * @param y Row in 32.32 fixed point
+ * @param t Receives the neighbourhood
+ *
+ * @return Nonzero if the position lies inside the image
+ */
+static inline int locate(const SampleSource *s, int64_t x, int64_t y,
+                         Taps *t) {
+  if (x < 0 || y < 0 || x >= (int64_t)s->width << POS_BITS ||
+      y >= (int64_t)s->height << POS_BITS)
+    return 0;
+  int64_t qx = (x + ((int64_t)1 << (POS_TO_FRAC - 1))) >> POS_TO_FRAC;
+  int64_t qy = (y + ((int64_t)1 << (POS_TO_FRAC - 1))) >> POS_TO_FRAC;
+  int x0 = (int)(qx >> SAMPLE_FRAC_BITS), y0 = (int)(qy >> SAMPLE_FRAC_BITS);
+  t->fx = (int)(qx & (W_ONE - 1));
+  t->fy = (int)(qy & (W_ONE - 1));
+  if (x0 > s->width - 1)
+    x0 = s->width - 1;
+  if (y0 > s->height - 1)
+    y0 = s->height - 1;
+  int y1 = y0 + 1 < s->height ? y0 + 1 : y0;
+  t->x0 = x0;
+  t->x1 = x0 + 1 < s->width ? x0 + 1 : x0;
+  t->r0 = s->data + (size_t)(y0 - s->y0) * s->stride;
+  t->r1 = s->data + (size_t)(y1 - s->y0) * s->stride;
+  return 1;
+}
+
+/**
+ * Blends the channels of one sample with integer weights
+ *
+ * Reference arithmetic of every path: upper pair and lower pair are weighted
+ * separately and summed, so the SIMD versions give identical bytes.
+ *
+ * @param t Neighbourhood from locate
+ * @param ch Number of channels
+ * @param out Output pixel
+ */
+static inline void blend_scalar(const Taps *t, int ch, unsigned char *out) {
+  int w00 = (W_ONE - t->fx) * (W_ONE - t->fy), w10 = t->fx * (W_ONE - t->fy);
+  int w01 = (W_ONE - t->fx) * t->fy, w11 = t->fx * t->fy;
+  const unsigned char *p00 = t->r0 + t->x0 * ch, *p10 = t->r0 + t->x1 * ch;
+  const unsigned char *p01 = t->r1 + t->x0 * ch, *p11 = t->r1 + t->x1 * ch;
+  for (int c = 0; c < ch; c++) {
+    int32_t top = p00[c] * w00 + p10[c] * w10;
+    int32_t bottom = p01[c] * w01 + p11[c] * w11;
+    out[c] = (unsigned char)((top + bottom + SUM_ROUND) >> SUM_SHIFT);
+  }
+}
+
+static void line_scalar(const SampleSource *s, int64_t x, int64_t y,
+                        int64_t dx, int64_t dy, unsigned char *out, int n) {
+  int ch = s->channels;
+  for (int i = 0; i < n; i++, x += dx, y += dy, out += ch) {
+    Taps t;
+    if (locate(s, x, y, &t))
+      blend_scalar(&t, ch, out);
+    else
+      memset(out, 0, ch);
+  }
+}
+
+#ifdef CPU_X86
+/**
+ * Packs the weights of a left and a right neighbour for pmaddwd
+ *
+ * @return left in the low half and right in the high half
+ */
+static inline int weight_pair(int left, int right) {
+  return (int)((uint32_t)(uint16_t)left | ((uint32_t)(uint16_t)right << 16));
+}
+
+/**
+ * Packed weight pairs of the upper and the lower row of a sample
+ *
+ * @param t Neighbourhood from locate
+ * @param wt Receives the upper-left and upper-right weights
+ * @param wb Receives the lower-left and lower-right weights
+ */
+static inline void row_weights(const Taps *t, int *wt, int *wb) {
+  int gx = W_ONE - t->fx, gy = W_ONE - t->fy;
+  *wt = weight_pair(gx * gy, t->fx * gy);
+  *wb = weight_pair(gx * t->fy, t->fx * t->fy);
+}
+
+/**
+ * Tells whether both neighbours of a row can be read with one 8-byte load
+ *
+ * True when the right neighbour is the next pixel and the load stays inside
+ * the row: the pair spans 2 * ch bytes, so the load reads 8 - 2 * ch bytes
+ * past it (2 for RGB, none for RGBA). The clamped edge columns go through
+ * blend_scalar.
+ */
+static inline int pair_loadable(const SampleSource *s, const Taps *t,
+                                int ch) {
+  return t->x1 == t->x0 + 1 && (t->x0 * ch + 8 <= s->width * ch);
+}
+
+// ------- SSE2: one pixel per iteration -------
+
+/*
+ * The 8-byte load of a row holds the left and the right neighbour; widening
+ * and interleaving it with itself shifted by one pixel pairs every channel of
+ * the left neighbour with the same channel of the right one, so pmaddwd with
+ * the packed weight pair yields the row's contribution of all channels.
+ */
+__attribute__((target("sse2"))) static inline uint32_t
+blend_sse2(const Taps *t, const int ch) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i top = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((const __m128i *)(t->r0 + t->x0 * ch)), zero);
+  __m128i bot = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((const __m128i *)(t->r1 + t->x0 * ch)), zero);
+  if (ch == 4) {
+    top = _mm_unpacklo_epi16(top, _mm_srli_si128(top, 8));
+    bot = _mm_unpacklo_epi16(bot, _mm_srli_si128(bot, 8));
+  } else {
+    top = _mm_unpacklo_epi16(top, _mm_srli_si128(top, 6));
+    bot = _mm_unpacklo_epi16(bot, _mm_srli_si128(bot, 6));
+  }
+  int wt, wb;
+  row_weights(t, &wt, &wb);
+  __m128i acc = _mm_add_epi32(_mm_madd_epi16(top, _mm_set1_epi32(wt)),
+                              _mm_madd_epi16(bot, _mm_set1_epi32(wb)));
+  acc = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(SUM_ROUND)),
+                       SUM_SHIFT);
+  acc = _mm_packs_epi32(acc, acc);
+  return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+}
+
+__attribute__((target("sse2"))) static inline void
+line_sse2_ch(const SampleSource *s, int64_t x, int64_t y, int64_t dx,
+             int64_t dy, unsigned char *out, int n, const int ch) {
+  for (int i = 0; i < n; i++, x += dx, y += dy, out += ch) {
+    Taps t;
+    if (!locate(s, x, y, &t)) {
+      memset(out, 0, ch);
+    } else if (pair_loadable(s, &t, ch)) {
+      uint32_t px = blend_sse2(&t, ch);
+      memcpy(out, &px, ch);
+    } else {
+      blend_scalar(&t, ch, out);
+    }
+  }
+}
+
+__attribute__((target("sse2"))) static void
+line_sse2(const SampleSource *s, int64_t x, int64_t y, int64_t dx, int64_t dy,
+          unsigned char *out, int n) {
+  if (s->channels == 4)
+    line_sse2_ch(s, x, y, dx, dy, out, n, 4);
+  else if (s->channels == 3)
+    line_sse2_ch(s, x, y, dx, dy, out, n, 3);
+  else
+    line_scalar(s, x, y, dx, dy, out, n);
+}
+
+// ------- AVX2: two pixels per iteration -------
+
+/**
+ * Broadcasts one value to the low 128-bit lane and another to the high lane
+ */
+__attribute__((target("avx2"))) static inline __m256i lanes_epi32(int lo,
+                                                                  int hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32(lo)),
+                                 _mm_set1_epi32(hi), 1);
+}
+
+/*
+ * Same scheme as SSE2 with one pixel in each 128-bit lane: the byte shifts,
+ * unpacks and packs all work inside lanes, so the lanes never mix.
+ */
+__attribute__((target("avx2"))) static inline void
+blend2_avx2(const Taps *a, const Taps *b, const int ch, uint32_t *pa,
+            uint32_t *pb) {
+  __m256i top = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(
+      _mm_loadl_epi64((const __m128i *)(a->r0 + a->x0 * ch)),
+      _mm_loadl_epi64((const __m128i *)(b->r0 + b->x0 * ch))));
+  __m256i bot = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(
+      _mm_loadl_epi64((const __m128i *)(a->r1 + a->x0 * ch)),
+      _mm_loadl_epi64((const __m128i *)(b->r1 + b->x0 * ch))));
+  if (ch == 4) {
+    top = _mm256_unpacklo_epi16(top, _mm256_srli_si256(top, 8));
+    bot = _mm256_unpacklo_epi16(bot, _mm256_srli_si256(bot, 8));
+  } else {
+    top = _mm256_unpacklo_epi16(top, _mm256_srli_si256(top, 6));
+    bot = _mm256_unpacklo_epi16(bot, _mm256_srli_si256(bot, 6));
+  }
+  int at, ab, bt, bb;
+  row_weights(a, &at, &ab);
+  row_weights(b, &bt, &bb);
+  __m256i wt = lanes_epi32(at, bt), wb = lanes_epi32(ab, bb);
+  __m256i acc = _mm256_add_epi32(_mm256_madd_epi16(top, wt),
+                                 _mm256_madd_epi16(bot, wb));
+  acc = _mm256_srai_epi32(_mm256_add_epi32(acc, _mm256_set1_epi32(SUM_ROUND)),
+                          SUM_SHIFT);
+  acc = _mm256_packs_epi32(acc, acc);
+  acc = _mm256_packus_epi16(acc, acc);
+  *pa = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(acc));
+  *pb = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(acc, 1));
+}
+
+__attribute__((target("avx2"))) static inline void
+line_avx2_ch(const SampleSource *s, int64_t x, int64_t y, int64_t dx,
+             int64_t dy, unsigned char *out, int n, const int ch) {
+  int i = 0;
+  while (i < n) {
+    Taps ta, tb;
+    if (!locate(s, x, y, &ta)) {
+      memset(out, 0, ch);
+    } else if (i + 1 < n && pair_loadable(s, &ta, ch) &&
+               locate(s, x + dx, y + dy, &tb) && pair_loadable(s, &tb, ch)) {
+      uint32_t pa, pb;
+      blend2_avx2(&ta, &tb, ch, &pa, &pb);
+      memcpy(out, &pa, ch);
+      memcpy(out + ch, &pb, ch);
+      i += 2;
+      x += 2 * dx;
+      y += 2 * dy;
+      out += 2 * ch;
+      continue;
+    } else {
+      blend_scalar(&ta, ch, out);
+    }
+    i++;
+    x += dx;
+    y += dy;
+    out += ch;
+  }
+}
+
+__attribute__((target("avx2"))) static void
+line_avx2(const SampleSource *s, int64_t x, int64_t y, int64_t dx, int64_t dy,
+          unsigned char *out, int n) {
+  if (s->channels == 4)
+    line_avx2_ch(s, x, y, dx, dy, out, n, 4);
+  else if (s->channels == 3)
+    line_avx2_ch(s, x, y, dx, dy, out, n, 3);
+  else
+    line_scalar(s, x, y, dx, dy, out, n);
+}
+// ------- AVX-512 (F + BW): four pixels per iteration -------
+
+/**
+ * Puts the i-th of four values in every 32-bit element of 128-bit lane i
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+lanes4_epi32(int a, int b, int c, int d) {
+  const __m512i spread =
+      _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+  return _mm512_permutexvar_epi32(
+      spread, _mm512_castsi128_si512(_mm_setr_epi32(a, b, c, d)));
+}
+
+/**
+ * Loads the neighbour pairs of one row of four samples, widened to 16 bits
+ *
+ * @param t Four neighbourhoods, all pair_loadable
+ * @param lower Nonzero for the lower rows
+ * @param ch Number of channels
+ * @return Pair of sample i in 128-bit lane i
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+load_pairs4(const Taps *t, int lower, const int ch) {
+  __m128i p[4];
+  for (int i = 0; i < 4; i++)
+    p[i] = _mm_loadl_epi64(
+        (const __m128i *)((lower ? t[i].r1 : t[i].r0) + t[i].x0 * ch));
+  __m256i pairs = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_unpacklo_epi64(p[0], p[1])),
+      _mm_unpacklo_epi64(p[2], p[3]), 1);
+  return _mm512_cvtepu8_epi16(pairs);
+}
+
+/*
+ * The AVX2 scheme with one sample in each of the four 128-bit lanes; the
+ * pixels end up in the low 32 bits of the lanes and are gathered into one
+ * 128-bit vector.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m128i
+blend4_avx512(const Taps *t, const int ch) {
+  __m512i top = load_pairs4(t, 0, ch), bot = load_pairs4(t, 1, ch);
+  if (ch == 4) {
+    top = _mm512_unpacklo_epi16(top, _mm512_bsrli_epi128(top, 8));
+    bot = _mm512_unpacklo_epi16(bot, _mm512_bsrli_epi128(bot, 8));
+  } else {
+    top = _mm512_unpacklo_epi16(top, _mm512_bsrli_epi128(top, 6));
+    bot = _mm512_unpacklo_epi16(bot, _mm512_bsrli_epi128(bot, 6));
+  }
+  int wt[4], wb[4];
+  for (int i = 0; i < 4; i++)
+    row_weights(&t[i], &wt[i], &wb[i]);
+  __m512i acc = _mm512_add_epi32(
+      _mm512_madd_epi16(top, lanes4_epi32(wt[0], wt[1], wt[2], wt[3])),
+      _mm512_madd_epi16(bot, lanes4_epi32(wb[0], wb[1], wb[2], wb[3])));
+  acc = _mm512_srai_epi32(_mm512_add_epi32(acc, _mm512_set1_epi32(SUM_ROUND)),
+                          SUM_SHIFT);
+  acc = _mm512_packs_epi32(acc, acc);
+  acc = _mm512_packus_epi16(acc, acc);
+  const __m512i firsts =
+      _mm512_setr_epi32(0, 4, 8, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  return _mm512_castsi512_si128(_mm512_permutexvar_epi32(firsts, acc));
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline void
+line_avx512_ch(const SampleSource *s, int64_t x, int64_t y, int64_t dx,
+               int64_t dy, unsigned char *out, int n, const int ch) {
+  int i = 0;
+  while (i < n) {
+    Taps t[4];
+    int k = 0;
+    if (i + 4 <= n)
+      while (k < 4 && locate(s, x + k * dx, y + k * dy, &t[k]) &&
+             pair_loadable(s, &t[k], ch))
+        k++;
+    if (k == 4) {
+      __m128i px = blend4_avx512(t, ch);
+      if (ch == 4) {
+        _mm_storeu_si128((__m128i *)out, px);
+      } else {
+        uint32_t v[4];
+        _mm_storeu_si128((__m128i *)v, px);
+        for (k = 0; k < 4; k++)
+          memcpy(out + k * ch, &v[k], ch);
+      }
+      i += 4;
+      x += 4 * dx;
+      y += 4 * dy;
+      out += 4 * ch;
+      continue;
+    }
+    // edges and partial groups, one pixel at a time
+    if (!locate(s, x, y, &t[0])) {
+      memset(out, 0, ch);
+    } else if (pair_loadable(s, &t[0], ch)) {
+      uint32_t px = blend_sse2(&t[0], ch);
+      memcpy(out, &px, ch);
+    } else {
+      blend_scalar(&t[0], ch, out);
+    }
+    i++;
+    x += dx;
+    y += dy;
+    out += ch;
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+line_avx512(const SampleSource *s, int64_t x, int64_t y, int64_t dx,
+            int64_t dy, unsigned char *out, int n) {
+  if (s->channels == 4)
+    line_avx512_ch(s, x, y, dx, dy, out, n, 4);
+  else if (s->channels == 3)
+    line_avx512_ch(s, x, y, dx, dy, out, n, 3);
+  else
+    line_scalar(s, x, y, dx, dy, out, n);
+}
+#endif
+
+/**
+ * Selects the widest line kernel allowed by cpu_isa()
+ *
+ * Runs once through pthread_once on the first sampler call. SSE4.1 adds
+ * nothing to the blend, so that level runs the SSE2 code.
+ */
+static void select_isa(void) {
+  impl_line = line_scalar;
+#ifdef CPU_X86
+  CpuIsa isa = cpu_isa();
+  if (isa >= CPU_ISA_AVX512) {
+    impl_line = line_avx512;
+    impl_name = "avx512";
+  } else if (isa >= CPU_ISA_AVX2) {
+    impl_line = line_avx2;
+    impl_name = "avx2";
+  } else if (isa >= CPU_ISA_SSE2) {
+    impl_line = line_sse2;
+    impl_name = "sse2";
+  }
+#endif
+}
+
+/**
+ * Samples a source bilinearly along a line
+ *
+ * The start and the step are converted to 32.32 fixed point once; each pixel
+ * then costs integer adds to find its neighbours and one set of weights
+ * shared by all of its channels.
+ *
+ * @param src Source image (or pipeline window holding the rows reached)
+ * @param x Source column of the first output pixel
+ * @param y Source row of the first output pixel
+ * @param dx Column step between output pixels
+ * @param dy Row step between output pixels
+ * @param out Output pixels (n * src->channels bytes)
+ * @param n Number of output pixels
+ */
+void sample_bilinear_line(const SampleSource *src, double x, double y,
+                          double dx, double dy, unsigned char *out, int n) {
+  pthread_once(&isa_once, select_isa);
+  const double one = (double)((int64_t)1 << POS_BITS);
+  impl_line(src, llround(x * one), llround(y * one), llround(dx * one),
+            llround(dy * one), out, n);
+}
+
+/**
+ * Returns the instruction set picked for the sampler
+ *
+ * @return "avx512", "avx2", "sse2" or "scalar"
+ */
+const char *sample_isa(void) {
+  pthread_once(&isa_once, select_isa);
+  return impl_name;
+}
@@ -0,0 +1,714 @@
+#include "server.h"
+#include "ops.h"
+#include "profile.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Longest "id" echoed back, in bytes of JSON text
+#define SERVER_MAX_ID 256
+// Deepest nesting of objects and arrays accepted in a job line
+#define SERVER_MAX_DEPTH 32
+
+/**
+ * State shared by every connection of a server
+ */
+typedef struct {
+  int num_threads;
+  int png_level;
+  pthread_mutex_t lock;
+  pthread_cond_t idle_cv;          // signaled when a connection ends
+  int clients[SERVER_MAX_CLIENTS]; // sockets being served
+  int nclients;
+  double *ms; // latency of every executed job, in ms
+  size_t count, cap;
+  int failed;
+  int rejected; // lines answered without running a job
+} Server;
+
+/**
+ * One connection handed to its thread
+ */
+typedef struct {
+  Server *sv;
+  int fd;
+} Client;
+
+/**
+ * Fields of a job line; strings point into the decoded line
+ */
+typedef struct {
+  char *in, *out, *ops;
+  const char *id; // raw JSON text of the id, or NULL
+  size_t id_len;
+} Job;
+
+/**
+ * Buffered reader splitting a file descriptor into lines
+ */
+typedef struct {
+  int fd;
+  char buf[SERVER_MAX_LINE + 1];
+  size_t start, len; // unread bytes are buf[start, len)
+} LineReader;
+
+// Write end of the pipe the signal handler wakes the accept loop through
+static int stop_fd = -1;
+
+static void on_stop(int sig) {
+  (void)sig;
+  ssize_t put = write(stop_fd, "", 1);
+  (void)put; // a full pipe already wakes the loop
+}
+
+/**
+ * Reads the next line, without its newline and NUL-terminated in place
+ *
+ * @param r Reader
+ * @param line Receives the line (valid until the next call)
+ *
+ * @return Length of the line, -1 at end of input or on a read error, -2 for
+ * a line longer than SERVER_MAX_LINE (skipped up to its newline)
+ */
+static long read_line(LineReader *r, char **line) {
+  int skipping = 0;
+  for (;;) {
+    char *nl = memchr(r->buf + r->start, '\n', r->len - r->start);
+    if (nl) {
+      *nl = '\0';
+      *line = r->buf + r->start;
+      long n = nl - *line;
+      r->start = nl + 1 - r->buf;
+      if (skipping)
+        return -2;
+      return n;
+    }
+    if (r->start > 0) {
+      memmove(r->buf, r->buf + r->start, r->len - r->start);
+      r->len -= r->start;
+      r->start = 0;
+    }
+    if (r->len == SERVER_MAX_LINE) {
+      skipping = 1;
+      r->len = 0;
+    }
+    ssize_t got = read(r->fd, r->buf + r->len, SERVER_MAX_LINE - r->len);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0) {
+      if (got < 0 || r->len == 0)
+        return -1;
+      // last line without a newline
+      r->buf[r->len] = '\0';
+      *line = r->buf;
+      long n = (long)r->len;
+      r->start = r->len = 0;
+      return skipping ? -2 : n;
+    }
+    r->len += (size_t)got;
+  }
+}
+
+/**
+ * Writes a whole buffer
+ *
+ * @return 0 on success, -1 if the peer is gone or on a write error
+ */
+static int write_all(int fd, const char *s, size_t n) {
+  while (n > 0) {
+    ssize_t put = write(fd, s, n);
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0)
+      return -1;
+    s += put;
+    n -= (size_t)put;
+  }
+  return 0;
+}
+
+static const char *skip_ws(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    p++;
+  return p;
+}
+
+/**
+ * Finds the end of a JSON string
+ *
+ * @param p Opening quote
+ * @return Pointer past the closing quote, or NULL if the string is
+ * unterminated or holds a control character or a malformed escape
+ */
+static char *scan_string(char *p) {
+  for (p++; *p != '"'; p++) {
+    if ((unsigned char)*p < 0x20)
+      return NULL;
+    if (*p == '\\') {
+      p++;
+      if (*p == 'u') {
+        for (int i = 1; i <= 4; i++)
+          if (!p[i] || !strchr("0123456789abcdefABCDEF", p[i]))
+            return NULL;
+        p += 4;
+      } else if (!*p || !strchr("\"\\/bfnrt", *p)) {
+        return NULL;
+      }
+    }
+  }
+  return p + 1;
+}
+
+/**
+ * Decodes a JSON string scanned by scan_string in place
+ *
+ * \u escapes are stored as UTF-8; surrogate pairs and NUL are rejected,
+ * since the result names a file.
+ *
+ * @param p Opening quote; the decoded text starts at p + 1
+ * @return Decoded, NUL-terminated text, or NULL on an unsupported escape
+ */
+static char *decode_string(char *p) {
+  char *w = p + 1, *out = w;
+  for (p++; *p != '"'; p++) {
+    if (*p != '\\') {
+      *w++ = *p;
+      continue;
+    }
+    p++;
+    switch (*p) {
+    case 'b':
+      *w++ = '\b';
+      break;
+    case 'f':
+      *w++ = '\f';
+      break;
+    case 'n':
+      *w++ = '\n';
+      break;
+    case 'r':
+      *w++ = '\r';
+      break;
+    case 't':
+      *w++ = '\t';
+      break;
+    case 'u': {
+      char hex[5] = {p[1], p[2], p[3], p[4], '\0'};
+      unsigned long c = strtoul(hex, NULL, 16);
+      if (c == 0 || (c >= 0xD800 && c <= 0xDFFF))
+        return NULL;
+      if (c < 0x80) {
+        *w++ = (char)c;
+      } else if (c < 0x800) {
+        *w++ = (char)(0xC0 | c >> 6);
+        *w++ = (char)(0x80 | (c & 0x3F));
+      } else {
+        *w++ = (char)(0xE0 | c >> 12);
+        *w++ = (char)(0x80 | (c >> 6 & 0x3F));
+        *w++ = (char)(0x80 | (c & 0x3F));
+      }
+      p += 4;
+      break;
+    }
+    default: // " \ /
+      *w++ = *p;
+    }
+  }
+  *w = '\0';
+  return out;
+}
+
+/**
+ * Finds the end of a JSON number, true, false or null
+ *
+ * @return Pointer past the value, or NULL if p does not start one
+ */
+static const char *scan_scalar(const char *p) {
+  static const char *const words[] = {"true", "false", "null"};
+  for (int i = 0; i < 3; i++)
+    if (strncmp(p, words[i], strlen(words[i])) == 0)
+      return p + strlen(words[i]);
+  const char *q = p;
+  if (*q == '-')
+    q++;
+  if (*q < '0' || *q > '9')
+    return NULL;
+  while (*q && strchr("0123456789.eE+-", *q))
+    q++;
+  char *end;
+  strtod(p, &end);
+  return end == q ? q : NULL;
+}
+
+/**
+ * Finds the end of any JSON value
+ *
+ * Objects and arrays are checked member by member down to SERVER_MAX_DEPTH
+ * levels; strings and scalars as by scan_string and scan_scalar.
+ *
+ * @param p First character of the value
+ * @param depth Nesting level of the value (1 for a member of the job)
+ * @return Pointer past the value, or NULL if it is malformed or too deep
+ */
+static char *scan_value(char *p, int depth) {
+  if (*p == '"')
+    return scan_string(p);
+  if (*p != '{' && *p != '[')
+    return (char *)scan_scalar(p);
+  if (depth > SERVER_MAX_DEPTH)
+    return NULL;
+  char close = *p == '{' ? '}' : ']';
+  p = (char *)skip_ws(p + 1);
+  if (*p == close)
+    return p + 1;
+  for (;;) {
+    if (close == '}') {
+      if (*p != '"' || !(p = scan_string(p)))
+        return NULL;
+      p = (char *)skip_ws(p);
+      if (*p != ':')
+        return NULL;
+      p = (char *)skip_ws(p + 1);
+    }
+    if (!(p = scan_value(p, depth + 1)))
+      return NULL;
+    p = (char *)skip_ws(p);
+    if (*p == close)
+      return p + 1;
+    if (*p != ',')
+      return NULL;
+    p = (char *)skip_ws(p + 1);
+  }
+}
+
+/**
+ * Parses a job line in place
+ *
+ * The line must be one JSON object. Unknown keys are ignored whatever their
+ * value, and "id" may be any value of up to SERVER_MAX_ID bytes of text.
+ *
+ * @param line Line text; strings are decoded in place
+ * @param job Parsed fields
+ *
+ * @return 0 on success, -1 on malformed JSON or a missing "in" or "out"
+ */
+static int parse_job(char *line, Job *job) {
+  Job empty = {0};
+  *job = empty;
+  char *p = (char *)skip_ws(line);
+  if (*p != '{')
+    return -1;
+  p = (char *)skip_ws(p + 1);
+  while (*p != '}') {
+    if (*p != '"')
+      return -1;
+    char *key = p + 1, *end = scan_string(p);
+    if (!end)
+      return -1;
+    size_t klen = (size_t)(end - 1 - key);
+    p = (char *)skip_ws(end);
+    if (*p != ':')
+      return -1;
+    char *value = (char *)skip_ws(p + 1);
+    end = scan_value(value, 1);
+    if (!end)
+      return -1;
+    p = (char *)skip_ws(end);
+    if (*p != ',' && *p != '}')
+      return -1;
+    if (*p == ',' && *(p = (char *)skip_ws(p + 1)) != '"')
+      return -1;
+
+    char **field = NULL;
+    if (klen == 2 && strncmp(key, "in", 2) == 0)
+      field = &job->in;
+    else if (klen == 3 && strncmp(key, "out", 3) == 0)
+      field = &job->out;
+    else if (klen == 3 && strncmp(key, "ops", 3) == 0)
+      field = &job->ops;
+    if (field) {
+      if (*value != '"' || !(*field = decode_string(value)))
+        return -1;
+    } else if (klen == 2 && strncmp(key, "id", 2) == 0) {
+      if (end - value > SERVER_MAX_ID)
+        return -1;
+      job->id = value;
+      job->id_len = (size_t)(end - value);
+    }
+  }
+  if (*skip_ws(p + 1))
+    return -1;
+  return job->in && *job->in && job->out && *job->out ? 0 : -1;
+}
+
+/**
+ * Adds one executed job to the latency statistics
+ */
+static void record_job(Server *sv, double ms, int ok) {
+  pthread_mutex_lock(&sv->lock);
+  if (sv->count == sv->cap) {
+    size_t cap = sv->cap ? 2 * sv->cap : 1024;
+    double *grown = (double *)realloc(sv->ms, sizeof(double) * cap);
+    if (grown) {
+      sv->ms = grown;
+      sv->cap = cap;
+    }
+  }
+  if (sv->count < sv->cap)
+    sv->ms[sv->count++] = ms;
+  sv->failed += !ok;
+  pthread_mutex_unlock(&sv->lock);
+}
+
+/**
+ * Counts one line rejected before running a job (too long, invalid job or
+ * invalid ops); such lines stay out of the latency statistics
+ */
+static void record_rejected(Server *sv) {
+  pthread_mutex_lock(&sv->lock);
+  sv->rejected++;
+  pthread_mutex_unlock(&sv->lock);
+}
+
+/**
+ * Answer text of a failed ops_file
+ *
+ * @param rc OpsError returned by ops_file
+ */
+static const char *job_error(int rc) {
+  switch (rc) {
+  case OPS_ERR_READ:
+    return "cannot read input";
+  case OPS_ERR_PROCESS:
+    return "processing failed";
+  case OPS_ERR_WRITE:
+    return "cannot write output";
+  default:
+    return "failed";
+  }
+}
+
+/**
+ * Runs the job of one line and formats its answer
+ *
+ * @param sv Server settings and statistics
+ * @param line Request line (modified)
+ * @param t0 Time the line was read (profile_now)
+ * @param answer Buffer receiving the answer line, newline included
+ * @param cap Size of answer
+ *
+ * @return Length of the answer
+ */
+static int serve_job(Server *sv, char *line, uint64_t t0, char *answer,
+                     size_t cap) {
+  Job job;
+  OpChain chain = {0};
+  const char *error = NULL;
+  int w = 0, h = 0, ch = 0, ran = 0;
+  if (parse_job(line, &job) != 0) {
+    error = "invalid job";
+  } else if (job.ops && *job.ops && ops_parse(job.ops, &chain) != 0) {
+    error = "invalid ops";
+  } else {
+    ran = 1;
+    int rc = ops_file(&chain, job.in, job.out, sv->num_threads, sv->png_level,
+                      &w, &h, &ch);
+    if (rc != 0)
+      error = job_error(rc);
+  }
+  ops_free(&chain);
+
+  uint64_t ns = profile_now() - t0;
+  if (ran)
+    record_job(sv, ns / 1e6, !error);
+  else
+    record_rejected(sv);
+  if (!error && profile_enabled())
+    profile_record("job", ns, h, (size_t)w * h * ch);
+  const char *id = job.id ? job.id : "null";
+  int id_len = job.id ? (int)job.id_len : 4;
+  if (error)
+    return snprintf(answer, cap, "{\"id\": %.*s, \"ok\": false, "
+                    "\"error\": \"%s\"}\n", id_len, id, error);
+  return snprintf(answer, cap, "{\"id\": %.*s, \"ok\": true, \"width\": %d, "
+                  "\"height\": %d, \"channels\": %d, \"ms\": %.3f}\n",
+                  id_len, id, w, h, ch, ns / 1e6);
+}
+
+/**
+ * Answers every job line of one input until it ends
+ *
+ * @param sv Server
+ * @param in_fd Descriptor the jobs are read from
+ * @param out_fd Descriptor the answers are written to
+ */
+static void serve_stream(Server *sv, int in_fd, int out_fd) {
+  LineReader *r = (LineReader *)malloc(sizeof(LineReader));
+  if (!r) {
+    fprintf(stderr, "Server: failed to allocate a line buffer\n");
+    return;
+  }
+  r->fd = in_fd;
+  r->start = r->len = 0;
+  char answer[SERVER_MAX_ID + 256];
+  char *line;
+  long n;
+  while ((n = read_line(r, &line)) != -1) {
+    uint64_t t0 = profile_now();
+    int len;
+    if (n == -2) {
+      len = snprintf(answer, sizeof(answer), "{\"id\": null, \"ok\": false, "
+                     "\"error\": \"line too long\"}\n");
+      record_rejected(sv);
+    } else if (*skip_ws(line) == '\0') {
+      continue;
+    } else {
+      len = serve_job(sv, line, t0, answer, sizeof(answer));
+    }
+    if (write_all(out_fd, answer, (size_t)len) != 0)
+      break;
+  }
+  free(r);
+}
+
+/**
+ * Thread serving one socket connection
+ *
+ * @param p Client; freed here, and its socket closed
+ * @return NULL
+ */
+static void *client_thread(void *p) {
+  Client *c = (Client *)p;
+  Server *sv = c->sv;
+  serve_stream(sv, c->fd, c->fd);
+  pthread_mutex_lock(&sv->lock);
+  for (int i = 0; i < sv->nclients; i++)
+    if (sv->clients[i] == c->fd) {
+      sv->clients[i] = sv->clients[--sv->nclients];
+      break;
+    }
+  pthread_cond_broadcast(&sv->idle_cv);
+  pthread_mutex_unlock(&sv->lock);
+  close(c->fd);
+  free(c);
+  return NULL;
+}
+
+/**
+ * Starts a thread for an accepted connection
+ *
+ * @param sv Server
+ * @param fd Connected socket; closed here if it cannot be served
+ */
+static void start_client(Server *sv, int fd) {
+  Client *c = (Client *)malloc(sizeof(Client));
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_mutex_lock(&sv->lock);
+  int room = sv->nclients < SERVER_MAX_CLIENTS;
+  if (room && c)
+    sv->clients[sv->nclients++] = fd;
+  pthread_mutex_unlock(&sv->lock);
+  if (!room || !c) {
+    fprintf(stderr, "Server: refusing a connection (%s)\n",
+            c ? "too many clients" : "out of memory");
+    free(c);
+    close(fd);
+    return;
+  }
+  c->sv = sv;
+  c->fd = fd;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, client_thread, c) != 0) {
+    perror("pthread_create");
+    // undo the registration; client_thread never ran
+    pthread_mutex_lock(&sv->lock);
+    sv->nclients--;
+    pthread_mutex_unlock(&sv->lock);
+    close(fd);
+    free(c);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+/**
+ * Creates the listening socket
+ *
+ * A socket file left by a previous run is replaced, unless a server still
+ * answers on it.
+ *
+ * @param path Socket path
+ * @return Listening descriptor, or -1 on error (printed to stderr)
+ */
+static int listen_socket(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      fprintf(stderr, "A server is already listening on %s\n", path);
+      close(fd);
+      return -1;
+    }
+    unlink(path);
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Accepts connections until SIGINT or SIGTERM, then drains them
+ *
+ * The signal handler writes to a pipe that is polled with the listening
+ * socket, whichever thread receives the signal. On shutdown the read side
+ * of every connection is closed, so each finishes the job it is running,
+ * answers it and ends.
+ *
+ * @param sv Server
+ * @param path Socket path
+ * @return 0 on a clean shutdown, -1 if the socket cannot be set up
+ */
+static int serve_socket(Server *sv, const char *path) {
+  int lfd = listen_socket(path);
+  int pipe_fds[2];
+  if (lfd < 0)
+    return -1;
+  if (pipe(pipe_fds) != 0) {
+    perror("pipe");
+    close(lfd);
+    unlink(path);
+    return -1;
+  }
+  stop_fd = pipe_fds[1];
+  struct sigaction sa, old_int, old_term;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &old_int);
+  sigaction(SIGTERM, &sa, &old_term);
+  fprintf(stderr, "Serving jobs on %s (%d threads)\n", path, sv->num_threads);
+
+  struct pollfd fds[2] = {{lfd, POLLIN, 0}, {pipe_fds[0], POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    if (fds[1].revents)
+      break;
+    if (fds[0].revents & POLLIN) {
+      int cfd = accept(lfd, NULL, NULL);
+      if (cfd >= 0)
+        start_client(sv, cfd);
+      else if (errno != EINTR && errno != ECONNABORTED)
+        perror("accept");
+    }
+  }
+
+  close(lfd);
+  unlink(path);
+  pthread_mutex_lock(&sv->lock);
+  for (int i = 0; i < sv->nclients; i++)
+    shutdown(sv->clients[i], SHUT_RD);
+  while (sv->nclients > 0)
+    pthread_cond_wait(&sv->idle_cv, &sv->lock);
+  pthread_mutex_unlock(&sv->lock);
+  sigaction(SIGINT, &old_int, NULL);
+  sigaction(SIGTERM, &old_term, NULL);
+  stop_fd = -1;
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  return 0;
+}
+
+static int compare_ms(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Prints the number of jobs and their latency distribution to stderr
+ *
+ * Only executed jobs are timed; rejected lines are counted apart, since
+ * their microsecond answers would drag the percentiles down.
+ */
+static void print_summary(Server *sv) {
+  if (sv->rejected > 0)
+    fprintf(stderr, "Rejected %d line(s)\n", sv->rejected);
+  if (sv->count == 0) {
+    fprintf(stderr, "Served no jobs\n");
+    return;
+  }
+  qsort(sv->ms, sv->count, sizeof(double), compare_ms);
+  double sum = 0.0;
+  for (size_t i = 0; i < sv->count; i++)
+    sum += sv->ms[i];
+  fprintf(stderr,
+          "Served %zu job(s), %d failed; latency ms: mean %.3f, p50 %.3f, "
+          "p99 %.3f, max %.3f\n",
+          sv->count, sv->failed, sum / sv->count, sv->ms[sv->count / 2],
+          sv->ms[(size_t)(sv->count * 0.99)], sv->ms[sv->count - 1]);
+}
+
+/**
+ * Serves jobs from stdin or a Unix domain socket (see server.h)
+ *
+ * The caller starts the shared pool once; every job then reuses its
+ * workers, the pooled pixel buffers and the tables built on first use, so a
+ * job costs its I/O and pixel work only.
+ *
+ * @param path "-" for stdin/stdout, otherwise the socket path
+ * @param num_threads Number of pool tasks per operator
+ * @param png_level Compression level of PNG outputs
+ *
+ * @return 0 on success, -1 if the socket cannot be set up
+ */
+int server_run(const char *path, int num_threads, int png_level) {
+  Server sv = {.num_threads = num_threads, .png_level = png_level};
+  pthread_mutex_init(&sv.lock, NULL);
+  pthread_cond_init(&sv.idle_cv, NULL);
+  // a client that disconnects early must not kill the server
+  struct sigaction ign, old_pipe;
+  memset(&ign, 0, sizeof(ign));
+  ign.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ign, &old_pipe);
+  int rc = 0;
+  if (strcmp(path, "-") == 0)
+    serve_stream(&sv, STDIN_FILENO, STDOUT_FILENO);
+  else
+    rc = serve_socket(&sv, path);
+  if (rc == 0)
+    print_summary(&sv);
+  sigaction(SIGPIPE, &old_pipe, NULL);
+  free(sv.ms);
+  pthread_cond_destroy(&sv.idle_cv);
+  pthread_mutex_destroy(&sv.lock);
+  return rc;
+}
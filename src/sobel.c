@@ -1,199 +1,528 @@
 #include "sobel.h"
-#include <math.h>
+#include "cpu_dispatch.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Luminance weights 0.30, 0.59, 0.11 in Q16; they sum to exactly 1 << 16
+#define LUMA_R 19661
+#define LUMA_G 38666
+#define LUMA_B 7209
+// LUMA_G does not fit pmaddwd's signed 16-bit weights: G * LUMA_G is taken
+// as (G << 15) + G * LUMA_G_LOW
+#define LUMA_G_LOW (LUMA_G - 32768)
+
+typedef void (*LumaRowFn)(const unsigned char *, unsigned char *, int, int);
+typedef void (*SobelRowFn)(const unsigned char *, const unsigned char *,
+                           const unsigned char *, unsigned char *, int);
+
 /**
- * Clamps an integer value to the valid range for an unsigned char (0-255).
+ * Table of floor(sqrt(n)) for every n below 2^16
  *
- * This function ensures that the input value is within the valid range for
- * an 8-bit unsigned integer. Values below 0 are clamped to 0, and values
- * above 255 are clamped to 255.
+ * Larger squared magnitudes always saturate to 255, so the table covers
+ * every value the scalar path can look up. Built once on first use.
+ */
+static unsigned char isqrt_lut[1 << 16];
+static pthread_once_t sobel_once = PTHREAD_ONCE_INIT;
+// Row kernels picked by sobel_init
+static LumaRowFn luma_row;
+static SobelRowFn sobel_row;
+
+/**
+ * Converts one source row to 8-bit luminance
+ *
+ * Single-channel and gray+alpha rows are copied as they are; color rows use
+ * the Q16 weights above with truncation, which needs no float math, cannot
+ * exceed 255 and agrees with the float formula on all but ~0.4% of colors.
+ * The SIMD variants compute the same sums, so every variant gives the same
+ * bytes.
+ *
+ * @param in Source row
+ * @param out Output row of width bytes
+ * @param width Row width in pixels
+ * @param channels Number of interleaved channels in the source row
+ */
+static void luma_row_scalar(const unsigned char *in, unsigned char *out,
+                            int width, int channels) {
+  if (channels < 3) {
+    for (int x = 0; x < width; x++)
+      out[x] = in[(size_t)x * channels];
+    return;
+  }
+  if (channels == 3) {
+    for (int x = 0; x < width; x++)
+      out[x] = (unsigned char)((LUMA_R * in[3 * x] + LUMA_G * in[3 * x + 1] +
+                                LUMA_B * in[3 * x + 2]) >> 16);
+    return;
+  }
+  for (int x = 0; x < width; x++) {
+    const unsigned char *px = in + (size_t)x * channels;
+    out[x] = (unsigned char)((LUMA_R * px[0] + LUMA_G * px[1] +
+                              LUMA_B * px[2]) >> 16);
+  }
+}
+
+/**
+ * Scalar Sobel magnitudes of columns [x, width)
  *
- * @param v The integer value to clamp
- * @return The clamped value as an unsigned char in the range [0, 255]
+ * Reference arithmetic of every variant, and the tail of the SIMD loops.
  */
-static inline unsigned char clampi(int v) {
-  return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+static void sobel_tail(const unsigned char *t, const unsigned char *m,
+                       const unsigned char *b, unsigned char *out, int x,
+                       int width) {
+  for (; x < width; x++) {
+    int gx = (t[x - 1] + 2 * m[x - 1] + b[x - 1]) -
+             (t[x + 1] + 2 * m[x + 1] + b[x + 1]);
+    int gy = (t[x - 1] + 2 * t[x] + t[x + 1]) -
+             (b[x - 1] + 2 * b[x] + b[x + 1]);
+    int mag2 = gx * gx + gy * gy;
+    out[x] = mag2 >= (1 << 16) ? 255 : isqrt_lut[mag2];
+  }
 }
 
 /**
- * Converts a pixel to grayscale value using luminance weights.
+ * Computes the Sobel magnitude of one row from three luminance rows
+ *
+ * The 3x3 operators are applied in separable form: gx is the [1 2 1] column
+ * smoothing of the horizontal difference and gy the [1 2 1] row smoothing of
+ * the vertical difference. The magnitude floor(sqrt(gx^2 + gy^2)) saturates
+ * at 255. Every luminance row carries one zero column on each side, so the
+ * loops need no border tests.
  *
- * For single-channel images, returns the pixel value directly.
- * For multi-channel images, applies the standard RGB to grayscale conversion
- * formula using weighted average: 0.30*R + 0.59*G + 0.11*B
+ * @param t Row above, pointing at column 0 of a zero-padded row
+ * @param m Current row, same layout
+ * @param b Row below, same layout
+ * @param out Output magnitudes, width bytes
+ * @param width Row width in pixels
  *
- * @param px Pointer to pixel data array
- * @param channels Number of channels in the pixel data (1 for grayscale, 3+ for
- * color)
- * @return Grayscale value as unsigned char (0-255)
+ * @note The SIMD variants take the squared magnitude from one pmaddwd on
+ * interleaved (gx, gy) pairs and the root from sqrtps, which is exact after
+ * truncation for integers below 2^16
+ */
+static void sobel_row_scalar(const unsigned char *t, const unsigned char *m,
+                             const unsigned char *b, unsigned char *out,
+                             int width) {
+  sobel_tail(t, m, b, out, 0, width);
+}
+
+#ifdef CPU_X86
+// ------- SSE2 / SSE4.1: 8 magnitudes per iteration -------
+
+/**
+ * Squared gradient magnitudes of columns [x, x + 8) as two vectors of four
+ * 32-bit values
  */
-static inline unsigned char to_gray(unsigned char *px, int channels) {
-  if (channels == 1)
-    return px[0];
-  return (unsigned char)(0.30f * px[0] + 0.59f * px[1] + 0.11f * px[2]);
+__attribute__((target("sse2"))) static inline void
+sobel_mag2_sse2(const unsigned char *t, const unsigned char *m,
+                const unsigned char *b, int x, __m128i *lo, __m128i *hi) {
+  const __m128i zero = _mm_setzero_si128();
+#define LOAD8(p, o)                                                            \
+  _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)((p) + x + (o))), zero)
+  __m128i tl = LOAD8(t, -1), tc = LOAD8(t, 0), tr = LOAD8(t, 1);
+  __m128i ml = LOAD8(m, -1), mr = LOAD8(m, 1);
+  __m128i bl = LOAD8(b, -1), bc = LOAD8(b, 0), br = LOAD8(b, 1);
+#undef LOAD8
+  // gx = (tl + 2 ml + bl) - (tr + 2 mr + br)
+  __m128i gx = _mm_sub_epi16(
+      _mm_add_epi16(_mm_add_epi16(tl, bl), _mm_add_epi16(ml, ml)),
+      _mm_add_epi16(_mm_add_epi16(tr, br), _mm_add_epi16(mr, mr)));
+  // gy = (tl + 2 tc + tr) - (bl + 2 bc + br)
+  __m128i gy = _mm_sub_epi16(
+      _mm_add_epi16(_mm_add_epi16(tl, tr), _mm_add_epi16(tc, tc)),
+      _mm_add_epi16(_mm_add_epi16(bl, br), _mm_add_epi16(bc, bc)));
+  *lo = _mm_madd_epi16(_mm_unpacklo_epi16(gx, gy), _mm_unpacklo_epi16(gx, gy));
+  *hi = _mm_madd_epi16(_mm_unpackhi_epi16(gx, gy), _mm_unpackhi_epi16(gx, gy));
 }
 
 /**
- * Clamps x and y coordinates to valid image boundaries
+ * Square roots of capped squared magnitudes, packed to 8 bytes
+ */
+__attribute__((target("sse2"))) static inline void
+sobel_store8_sse2(__m128i lo, __m128i hi, unsigned char *out) {
+  lo = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(lo)));
+  hi = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(hi)));
+  __m128i mag = _mm_packs_epi32(lo, hi);
+  _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(mag, mag));
+}
+
+__attribute__((target("sse2"))) static void
+sobel_row_sse2(const unsigned char *t, const unsigned char *m,
+               const unsigned char *b, unsigned char *out, int width) {
+  const __m128i cap = _mm_set1_epi32(0xffff);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i lo, hi;
+    sobel_mag2_sse2(t, m, b, x, &lo, &hi);
+    // min(v, 0xffff) on non-negative int32 without SSE4.1
+    lo = _mm_sub_epi32(lo, _mm_and_si128(_mm_cmpgt_epi32(lo, cap),
+                                         _mm_sub_epi32(lo, cap)));
+    hi = _mm_sub_epi32(hi, _mm_and_si128(_mm_cmpgt_epi32(hi, cap),
+                                         _mm_sub_epi32(hi, cap)));
+    sobel_store8_sse2(lo, hi, out + x);
+  }
+  sobel_tail(t, m, b, out, x, width);
+}
+
+__attribute__((target("sse4.1"))) static void
+sobel_row_sse41(const unsigned char *t, const unsigned char *m,
+                const unsigned char *b, unsigned char *out, int width) {
+  const __m128i cap = _mm_set1_epi32(0xffff);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i lo, hi;
+    sobel_mag2_sse2(t, m, b, x, &lo, &hi);
+    sobel_store8_sse2(_mm_min_epi32(lo, cap), _mm_min_epi32(hi, cap),
+                      out + x);
+  }
+  sobel_tail(t, m, b, out, x, width);
+}
+
+// ------- AVX2 / AVX-512: 16 and 32 magnitudes per iteration -------
+
+/*
+ * The luminance loads are widened across the whole register, so gx and gy
+ * hold consecutive columns; the in-lane unpacks and the in-lane pack that
+ * follows them restore that order.
+ */
+__attribute__((target("avx2"))) static void
+sobel_row_avx2(const unsigned char *t, const unsigned char *m,
+               const unsigned char *b, unsigned char *out, int width) {
+  const __m256i cap = _mm256_set1_epi32(0xffff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+#define LOAD16(p, o)                                                           \
+  _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)((p) + x + (o))))
+    __m256i tl = LOAD16(t, -1), tc = LOAD16(t, 0), tr = LOAD16(t, 1);
+    __m256i ml = LOAD16(m, -1), mr = LOAD16(m, 1);
+    __m256i bl = LOAD16(b, -1), bc = LOAD16(b, 0), br = LOAD16(b, 1);
+#undef LOAD16
+    __m256i gx = _mm256_sub_epi16(
+        _mm256_add_epi16(_mm256_add_epi16(tl, bl), _mm256_add_epi16(ml, ml)),
+        _mm256_add_epi16(_mm256_add_epi16(tr, br), _mm256_add_epi16(mr, mr)));
+    __m256i gy = _mm256_sub_epi16(
+        _mm256_add_epi16(_mm256_add_epi16(tl, tr), _mm256_add_epi16(tc, tc)),
+        _mm256_add_epi16(_mm256_add_epi16(bl, br), _mm256_add_epi16(bc, bc)));
+    __m256i lo = _mm256_unpacklo_epi16(gx, gy);
+    __m256i hi = _mm256_unpackhi_epi16(gx, gy);
+    lo = _mm256_min_epi32(_mm256_madd_epi16(lo, lo), cap);
+    hi = _mm256_min_epi32(_mm256_madd_epi16(hi, hi), cap);
+    lo = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(lo)));
+    hi = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(hi)));
+    __m256i mag = _mm256_packs_epi32(lo, hi);
+    _mm_storeu_si128((__m128i *)(out + x),
+                     _mm_packus_epi16(_mm256_castsi256_si128(mag),
+                                      _mm256_extracti128_si256(mag, 1)));
+  }
+  sobel_tail(t, m, b, out, x, width);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+sobel_row_avx512(const unsigned char *t, const unsigned char *m,
+                 const unsigned char *b, unsigned char *out, int width) {
+  const __m512i cap = _mm512_set1_epi32(0xffff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+#define LOAD32(p, o)                                                           \
+  _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)((p) + x + (o))))
+    __m512i tl = LOAD32(t, -1), tc = LOAD32(t, 0), tr = LOAD32(t, 1);
+    __m512i ml = LOAD32(m, -1), mr = LOAD32(m, 1);
+    __m512i bl = LOAD32(b, -1), bc = LOAD32(b, 0), br = LOAD32(b, 1);
+#undef LOAD32
+    __m512i gx = _mm512_sub_epi16(
+        _mm512_add_epi16(_mm512_add_epi16(tl, bl), _mm512_add_epi16(ml, ml)),
+        _mm512_add_epi16(_mm512_add_epi16(tr, br), _mm512_add_epi16(mr, mr)));
+    __m512i gy = _mm512_sub_epi16(
+        _mm512_add_epi16(_mm512_add_epi16(tl, tr), _mm512_add_epi16(tc, tc)),
+        _mm512_add_epi16(_mm512_add_epi16(bl, br), _mm512_add_epi16(bc, bc)));
+    __m512i lo = _mm512_unpacklo_epi16(gx, gy);
+    __m512i hi = _mm512_unpackhi_epi16(gx, gy);
+    lo = _mm512_min_epi32(_mm512_madd_epi16(lo, lo), cap);
+    hi = _mm512_min_epi32(_mm512_madd_epi16(hi, hi), cap);
+    lo = _mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(lo)));
+    hi = _mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(hi)));
+    // roots are at most 255, so the word-to-byte narrowing never saturates
+    _mm256_storeu_si256((__m256i *)(out + x),
+                        _mm512_cvtepi16_epi8(_mm512_packs_epi32(lo, hi)));
+  }
+  sobel_tail(t, m, b, out, x, width);
+}
+
+// ------- Luminance: 16 (SSE) or 32 (AVX2) pixels per iteration -------
+
+/**
+ * Luminance of four pixels held as 32-bit R, G, B, X values
  *
- * This function ensures that the given x and y coordinates stay within
- * the valid bounds of an image with the specified width and height.
- * Coordinates that fall outside the boundaries are adjusted to the
- * nearest valid edge value.
+ * R and B are weighted by one pmaddwd on the masked words, G by a second one
+ * on its low weight plus a shift (see LUMA_G_LOW).
  *
- * @param x Pointer to the x coordinate to be clamped (modified in-place)
- * @param y Pointer to the y coordinate to be clamped (modified in-place)
- * @param width The width of the image (valid x range: 0 to width-1)
- * @param height The height of the image (valid y range: 0 to height-1)
+ * @return Four 32-bit luminance values
  */
-static inline void clamp_xy(int *x, int *y, int width, int height) {
-  if (*x < 0)
-    *x = 0;
-  if (*x >= width)
-    *x = width - 1;
-  if (*y < 0)
-    *y = 0;
-  if (*y >= height)
-    *y = height - 1;
+__attribute__((target("sse2"))) static inline __m128i luma4_sse2(__m128i px) {
+  const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+  const __m128i g_mask = _mm_set1_epi32(0xff);
+  const __m128i rb_w = _mm_set1_epi32(LUMA_R | LUMA_B << 16);
+  const __m128i g_w = _mm_set1_epi32(LUMA_G_LOW);
+  __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), g_mask);
+  __m128i sum = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(px, rb_mask), rb_w),
+                              _mm_madd_epi16(g, g_w));
+  return _mm_srli_epi32(_mm_add_epi32(sum, _mm_slli_epi32(g, 15)), 16);
 }
 
 /**
- * Fills a 3x3 neighborhood memory array with grayscale values for Sobel edge
- * detection
- *
- * This function extracts a 3x3 pixel neighborhood around the specified
- * coordinates (x,y) from the input image buffer and converts each pixel to
- * grayscale. The resulting values are stored in a linear array for use in
- * convolution operations. Boundary pixels are handled by padding with zeros
- * when accessing pixels outside the image bounds.
- *
- * @param buffer 3D array representing the image [height][width][channels]
- * @param width Width of the image in pixels
- * @param height Height of the image in pixels
- * @param channels Number of color channels per pixel
- * @param x X-coordinate of the center pixel
- * @param y Y-coordinate of the center pixel
- * @param op_mem Output array of size 9 to store the 3x3 neighborhood grayscale
- * values Arranged as: [top-left, top-center, top-right, middle-left, center,
- * middle-right, bottom-left, bottom-center, bottom-right]
- */
-static void makeOpMem(unsigned char ***buffer, int width, int height,
-                      int channels, int x, int y, unsigned char *op_mem) {
-  int bottom = y - 1 < 0;
-  int top = y + 1 >= height;
-  int left = x - 1 < 0;
-  int right = x + 1 >= width;
-
-  // Get grayscale values for the 3x3 neighborhood
-  op_mem[0] = (!bottom && !left) ? to_gray(buffer[y - 1][x - 1], channels) : 0;
-  op_mem[1] = !bottom ? to_gray(buffer[y - 1][x], channels) : 0;
-  op_mem[2] = (!bottom && !right) ? to_gray(buffer[y - 1][x + 1], channels) : 0;
-
-  op_mem[3] = !left ? to_gray(buffer[y][x - 1], channels) : 0;
-  op_mem[4] = to_gray(buffer[y][x], channels);
-  op_mem[5] = !right ? to_gray(buffer[y][x + 1], channels) : 0;
-
-  op_mem[6] = (!top && !left) ? to_gray(buffer[y + 1][x - 1], channels) : 0;
-  op_mem[7] = !top ? to_gray(buffer[y + 1][x], channels) : 0;
-  op_mem[8] = (!top && !right) ? to_gray(buffer[y + 1][x + 1], channels) : 0;
+ * Packs four vectors of four 32-bit luminance values to 16 bytes
+ */
+__attribute__((target("sse2"))) static inline void
+luma_store16_sse2(__m128i a, __m128i b, __m128i c, __m128i d,
+                  unsigned char *out) {
+  _mm_storeu_si128((__m128i *)out,
+                   _mm_packus_epi16(_mm_packs_epi32(a, b),
+                                    _mm_packs_epi32(c, d)));
 }
 
+__attribute__((target("sse2"))) static void
+luma_row_sse2(const unsigned char *in, unsigned char *out, int width,
+              int channels) {
+  if (channels != 4) {
+    luma_row_scalar(in, out, width, channels);
+    return;
+  }
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m128i *p = (const __m128i *)(in + (size_t)x * 4);
+    luma_store16_sse2(luma4_sse2(_mm_loadu_si128(p)),
+                      luma4_sse2(_mm_loadu_si128(p + 1)),
+                      luma4_sse2(_mm_loadu_si128(p + 2)),
+                      luma4_sse2(_mm_loadu_si128(p + 3)), out + x);
+  }
+  luma_row_scalar(in + (size_t)x * 4, out + x, width - x, 4);
+}
+
+/*
+ * RGB rows are spread to one pixel per 32-bit element with pshufb: each
+ * 16-byte load starts at a pixel and supplies four of them, so the last load
+ * of a block reads four bytes past its 16 pixels and the loop stops two
+ * pixels early.
+ */
+__attribute__((target("sse4.1"))) static void
+luma_row_sse41(const unsigned char *in, unsigned char *out, int width,
+               int channels) {
+  if (channels != 3) {
+    luma_row_sse2(in, out, width, channels);
+    return;
+  }
+  const __m128i spread =
+      _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  int x = 0;
+  for (; x + 18 <= width; x += 16) {
+    const unsigned char *p = in + (size_t)x * 3;
+#define RGB4(o)                                                                \
+  luma4_sse2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + (o))),   \
+                              spread))
+    luma_store16_sse2(RGB4(0), RGB4(12), RGB4(24), RGB4(36), out + x);
+#undef RGB4
+  }
+  luma_row_scalar(in + (size_t)x * 3, out + x, width - x, 3);
+}
+
+/**
+ * AVX2 form of luma4_sse2 on eight pixels
+ */
+__attribute__((target("avx2"))) static inline __m256i luma8_avx2(__m256i px) {
+  const __m256i rb_mask = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i g_mask = _mm256_set1_epi32(0xff);
+  const __m256i rb_w = _mm256_set1_epi32(LUMA_R | LUMA_B << 16);
+  const __m256i g_w = _mm256_set1_epi32(LUMA_G_LOW);
+  __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), g_mask);
+  __m256i sum = _mm256_add_epi32(
+      _mm256_madd_epi16(_mm256_and_si256(px, rb_mask), rb_w),
+      _mm256_madd_epi16(g, g_w));
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_slli_epi32(g, 15)),
+                           16);
+}
+
+/**
+ * Packs four vectors of eight 32-bit luminance values (pixels 0-3 in the
+ * low lane, 4-7 in the high lane) to 32 bytes
+ *
+ * The in-lane packs leave 4-pixel groups in the order 0 2 4 6 | 1 3 5 7,
+ * which one dword permute restores.
+ */
+__attribute__((target("avx2"))) static inline void
+luma_store32_avx2(__m256i a, __m256i b, __m256i c, __m256i d,
+                  unsigned char *out) {
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                      _mm256_packs_epi32(c, d));
+  _mm256_storeu_si256((__m256i *)out,
+                      _mm256_permutevar8x32_epi32(bytes, order));
+}
+
+__attribute__((target("avx2"))) static void
+luma_row_avx2(const unsigned char *in, unsigned char *out, int width,
+              int channels) {
+  int x = 0;
+  if (channels == 4) {
+    for (; x + 32 <= width; x += 32) {
+      const __m256i *p = (const __m256i *)(in + (size_t)x * 4);
+      luma_store32_avx2(luma8_avx2(_mm256_loadu_si256(p)),
+                        luma8_avx2(_mm256_loadu_si256(p + 1)),
+                        luma8_avx2(_mm256_loadu_si256(p + 2)),
+                        luma8_avx2(_mm256_loadu_si256(p + 3)), out + x);
+    }
+  } else if (channels == 3) {
+    // pixels 0-3 of each group of eight from p, 4-7 from p + 12
+    const __m256i spread = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3,
+        4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    for (; x + 34 <= width; x += 32) {
+      const unsigned char *p = in + (size_t)x * 3;
+#define RGB8(o)                                                                \
+  luma8_avx2(_mm256_shuffle_epi8(                                              \
+      _mm256_loadu2_m128i((const __m128i *)(p + (o) + 12),                     \
+                          (const __m128i *)(p + (o))),                         \
+      spread))
+      luma_store32_avx2(RGB8(0), RGB8(24), RGB8(48), RGB8(72), out + x);
+#undef RGB8
+    }
+  } else {
+    luma_row_scalar(in, out, width, channels);
+    return;
+  }
+  luma_row_scalar(in + (size_t)x * channels, out + x, width - x, channels);
+}
+#endif
+
 /**
- * Performs a 1D convolution operation between an input array and a kernel.
+ * Fills isqrt_lut with integer square roots and picks the row kernels
  *
- * This function computes the convolution by multiplying corresponding elements
- * of the input array X with the reversed kernel Y, then summing all products.
- * The kernel is accessed in reverse order (Y[c_size-i-1]) which is typical
- * for convolution operations.
+ * Walks n upwards and bumps the root whenever (root + 1)^2 is reached, so the
+ * table is built with integer arithmetic only. The kernels are the widest
+ * variants allowed by cpu_isa(); the luminance conversion tops out at AVX2.
+ */
+static void sobel_init(void) {
+  unsigned r = 0;
+  for (unsigned n = 0; n < (1u << 16); n++) {
+    if ((r + 1) * (r + 1) <= n)
+      r++;
+    isqrt_lut[n] = (unsigned char)r;
+  }
+  luma_row = luma_row_scalar;
+  sobel_row = sobel_row_scalar;
+#ifdef CPU_X86
+  static const LumaRowFn lumas[] = {luma_row_scalar, luma_row_sse2,
+                                    luma_row_sse41, luma_row_avx2,
+                                    luma_row_avx2};
+  static const SobelRowFn rows[] = {sobel_row_scalar, sobel_row_sse2,
+                                    sobel_row_sse41, sobel_row_avx2,
+                                    sobel_row_avx512};
+  luma_row = lumas[cpu_isa()];
+  sobel_row = rows[cpu_isa()];
+#endif
+}
+
+/**
+ * Writes edge magnitudes into an interleaved destination row
  *
- * @param X Pointer to the input array of unsigned char values
- * @param Y Pointer to the convolution kernel array of int values
- * @param c_size Size of both arrays (must be the same for both X and Y)
- * @return The computed convolution result as an integer sum
+ * The magnitude goes to the gray channel (1-2 channels) or to R, G and B
+ * (3+ channels); the remaining channels are copied from the source row.
+ * RGB and RGBA get constant-stride loops the compiler can unroll.
+ *
+ * @param mag Edge magnitudes, width bytes
+ * @param in Source row, used for the pass-through channels
+ * @param out Destination row
+ * @param width Row width in pixels
+ * @param channels Number of interleaved channels
  */
-static int convolution(unsigned char *X, int *Y, int c_size) {
-  int sum = 0;
-  for (int i = 0; i < c_size; i++) {
-    sum += X[i] * Y[c_size - i - 1];
+static void expand_row(const unsigned char *mag, const unsigned char *in,
+                       unsigned char *out, int width, int channels) {
+  if (channels == 3) {
+    for (int x = 0; x < width; x++)
+      out[3 * x] = out[3 * x + 1] = out[3 * x + 2] = mag[x];
+    return;
+  }
+  if (channels == 4) {
+    for (int x = 0; x < width; x++) {
+      out[4 * x] = out[4 * x + 1] = out[4 * x + 2] = mag[x];
+      out[4 * x + 3] = in[4 * x + 3];
+    }
+    return;
+  }
+  int gray = channels >= 3 ? 3 : 1;
+  for (int x = 0; x < width; x++) {
+    unsigned char *px = out + (size_t)x * channels;
+    const unsigned char *sp = in + (size_t)x * channels;
+    for (int c = 0; c < gray; c++)
+      px[c] = mag[x];
+    for (int c = gray; c < channels; c++)
+      px[c] = sp[c];
   }
-  return sum;
 }
 
 /**
  * Worker thread function that applies Sobel edge detection to a portion of an
  * image
  *
- * This function implements the Sobel edge detection algorithm using horizontal
- * and vertical convolution kernels to detect edges in an image. It processes a
- * specific range of rows as determined by the WorkArgs structure, making it
- * suitable for parallel processing.
- *
- * The Sobel operator uses two 3x3 kernels:
- * - Horizontal kernel: [-1, 0, 1, -2, 0, 2, -1, 0, 1] (detects vertical edges)
- * - Vertical kernel: [1, 2, 1, 0, 0, 0, -1, -2, -1] (detects horizontal edges)
- *
- * The edge magnitude is calculated as sqrt(gx² + gy²) where gx and gy are the
- * horizontal and vertical gradients respectively. The result is clamped to the
- * range [0, 255] for 8-bit output.
+ * Each source row is converted to luminance exactly once per worker into a
+ * ring of three zero-padded rows (the block plus a one-row halo above and
+ * below), so the gradient loops only ever read 8-bit luminance. Rows and
+ * columns outside the image count as zero, as in the original operator.
  *
  * @param p Pointer to WorkArgs structure containing:
  *          - src: Source image data
  *          - dst: Destination image data
  *          - width: Image width in pixels
  *          - height: Image height in pixels
- *          - channels: Number of color channels (1 for grayscale, 3+ for color)
+ *          - channels: Number of color channels
  *          - y0: Starting row for this worker thread
  *          - y1: Ending row (exclusive) for this worker thread
  *
- * @return NULL (standard pthread worker function return)
+ * @return NULL on success, WORKER_FAILED if the row buffers cannot be
+ * allocated
  *
- * @note For multi-channel images, the same edge value is applied to all
- * channels
- * @note Requires makeOpMem() and convolution() helper functions to be available
- * @note Uses sqrt() from math.h and abs() from stdlib.h
+ * @note The edge value goes to the gray channel (1-2 channel images) or to
+ * R, G and B (color images); any alpha channel is copied from the source
  */
 static void *worker_sobel(void *p) {
   WorkArgs *a = (WorkArgs *)p;
+  int w = a->width, h = a->height, ch = a->channels;
+  size_t lstride = (size_t)w + 2;
+  unsigned char *ring = (unsigned char *)calloc(3 * lstride + w, 1);
+  if (!ring)
+    return WORKER_FAILED;
+  unsigned char *mag = ring + 3 * lstride;
 
-  // Sobel kernels from reference implementation
-  int sobel_h[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
-  int sobel_v[] = {1, 2, 1, 0, 0, 0, -1, -2, -1};
-
-  // Temporary memory for each pixel operation
-  unsigned char op_mem[9];
+  // ring slot of row y is (y + 3) % 3; rows outside the image stay zero
+  unsigned char *row_at[3];
+  for (int i = 0; i < 3; i++)
+    row_at[i] = ring + i * lstride + 1;
+  for (int y = a->y0 - 1; y <= a->y0; y++)
+    if (y >= 0 && y < h)
+      luma_row(work_src_row(a, y), row_at[(y + 3) % 3], w, ch);
 
   for (int y = a->y0; y < a->y1; y++) {
-    for (int x = 0; x < a->width; x++) {
-      // Make operation memory for current pixel
-      makeOpMem(a->src, a->width, a->height, a->channels, x, y, op_mem);
-
-      // Calculate horizontal and vertical gradients
-      int gx = abs(convolution(op_mem, sobel_h, 9));
-      int gy = abs(convolution(op_mem, sobel_v, 9));
-
-      // Calculate contour (magnitude) - using sqrt like in reference
-      int magnitude = (int)sqrt(gx * gx + gy * gy);
-
-      // Clamp to 0-255 range
-      if (magnitude > 255)
-        magnitude = 255;
-
-      unsigned char edge_val = (unsigned char)magnitude;
-
-      // Set output pixel
-      if (a->channels == 1) {
-        a->dst[y][x][0] = edge_val;
-      } else {
-        a->dst[y][x][0] = edge_val;
-        a->dst[y][x][1] = edge_val;
-        a->dst[y][x][2] = edge_val;
-      }
+    unsigned char *next = row_at[(y + 4) % 3];
+    if (y + 1 < h)
+      luma_row(work_src_row(a, y + 1), next, w, ch);
+    else
+      memset(next, 0, w);
+
+    unsigned char *top = row_at[(y + 2) % 3];
+    unsigned char *cur = row_at[(y + 3) % 3];
+    unsigned char *out = work_dst_row(a, y);
+    if (ch == 1) {
+      sobel_row(top, cur, next, out, w);
+      continue;
     }
+    sobel_row(top, cur, next, mag, w);
+    expand_row(mag, work_src_row(a, y), out, w, ch);
   }
-
+  free(ring);
   return NULL;
 }
 
@@ -204,13 +533,8 @@ static void *worker_sobel(void *p) {
  * dividing the work among multiple threads. Each thread processes a subset of
  * image rows to compute the Sobel gradient magnitude for edge detection.
  *
- * @param src Pointer to 3D array containing source image data
- * [height][width][channels]
- * @param dst Pointer to 3D array to store filtered image data
- * [height][width][channels]
- * @param width Width of the image in pixels
- * @param height Height of the image in pixels
- * @param channels Number of color channels in the image (e.g., 3 for RGB)
+ * @param src Source image (e.g., 3 channels for RGB)
+ * @param dst Destination image with the same geometry as src
  * @param num_threads Number of worker threads to use for parallel processing
  *
  * @return Status code indicating success or failure of the operation
@@ -219,12 +543,36 @@ static void *worker_sobel(void *p) {
  * memory
  * @note Thread-safe implementation divides image rows among worker threads
  */
-int sobel_concurrent(unsigned char ***src, unsigned char ***dst, int width,
-                     int height, int channels, int num_threads) {
+int sobel_concurrent(const Image *src, Image *dst, int num_threads) {
+  pthread_once(&sobel_once, sobel_init);
   WorkArgs base = {.src = src,
                    .dst = dst,
-                   .width = width,
-                   .height = height,
-                   .channels = channels};
+                   .width = src->width,
+                   .height = src->height,
+                   .channels = src->channels,
+                   .name = "sobel"};
   return launch_threads_by_rows(worker_sobel, base, num_threads);
 }
+
+/**
+ * Prepares sobel_concurrent as a pipeline stage (halo of one row)
+ *
+ * @param width Input width
+ * @param height Input height
+ * @param channels Number of channels
+ * @param st Stage to fill; release with pipeline_stage_release
+ *
+ * @return 0 (the stage needs no private state)
+ */
+int sobel_stage(int width, int height, int channels, PipelineStage *st) {
+  pthread_once(&sobel_once, sobel_init);
+  PipelineStage empty = {0};
+  *st = empty;
+  st->worker = worker_sobel;
+  st->args.width = st->width = width;
+  st->args.height = st->height = height;
+  st->args.channels = channels;
+  st->args.name = "sobel";
+  st->halo = 1;
+  return 0;
+}
@@ -0,0 +1,300 @@
+#include "thread_pool.h"
+#include "affinity.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * A parallel-for submitted to the pool
+ *
+ * Lives on the stack of the submitting thread. Task indices are claimed with
+ * an atomic counter so idle workers and the submitter can share the work
+ * without taking the pool lock per claim; completion is counted under the
+ * pool lock so the submitter can sleep on done_cv.
+ */
+typedef struct PoolJob {
+  PoolTaskFn fn;
+  void *ctx;
+  int num_tasks;
+  atomic_int next_task;     // next unclaimed task index
+  int done;                 // finished tasks (guarded by the pool lock)
+  struct PoolJob *next_job; // next job in the pool's pending list
+} PoolJob;
+
+struct ThreadPool {
+  pthread_mutex_t lock;
+  pthread_cond_t work_cv; // signaled when a job is queued or on shutdown
+  pthread_cond_t done_cv; // signaled when the last task of a job finishes
+  PoolJob *jobs;          // jobs that may still have unclaimed tasks
+  int shutdown;
+  int num_workers;
+  pthread_t *workers;
+  atomic_int next_slot; // placement slots handed to starting workers
+};
+
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool *default_pool = NULL;
+
+/**
+ * Runs a claimed task and keeps claiming tasks of the same job until none are
+ * left
+ *
+ * The next index is claimed before the current one is reported as done, so
+ * the job (owned by the submitter's stack) is guaranteed alive whenever it is
+ * touched here.
+ *
+ * @param pool Pool the job was submitted to
+ * @param job Job the task belongs to
+ * @param task Index already claimed by the caller (may be out of range)
+ */
+static void run_tasks(ThreadPool *pool, PoolJob *job, int task) {
+  int n = job->num_tasks;
+  while (task < n) {
+    job->fn(job->ctx, task);
+    int next = atomic_fetch_add(&job->next_task, 1);
+    pthread_mutex_lock(&pool->lock);
+    if (++job->done == n)
+      pthread_cond_broadcast(&pool->done_cv);
+    pthread_mutex_unlock(&pool->lock);
+    task = next;
+  }
+}
+
+/**
+ * Removes a job from the pending list if it is still there
+ *
+ * @param pool Pool whose lock is held by the caller
+ * @param job Job to unlink
+ */
+static void unlink_job(ThreadPool *pool, PoolJob *job) {
+  for (PoolJob **pp = &pool->jobs; *pp; pp = &(*pp)->next_job) {
+    if (*pp == job) {
+      *pp = job->next_job;
+      return;
+    }
+  }
+}
+
+/**
+ * Main loop of a pool worker
+ *
+ * Sleeps on work_cv until a job is pending, claims tasks from the most
+ * recently submitted job (which favors nested parallel-fors) and drops jobs
+ * from the list once all their tasks are claimed. On start the worker takes
+ * the next placement slot (slot 0 is the submitting thread), which pins it
+ * to a CPU when IMAGEMUGGLE_PIN is set (see affinity.h).
+ *
+ * @param p Pointer to the owning ThreadPool
+ *
+ * @return NULL (standard pthread worker return value)
+ */
+static void *pool_worker(void *p) {
+  ThreadPool *pool = (ThreadPool *)p;
+  affinity_init_thread(1 + atomic_fetch_add(&pool->next_slot, 1));
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && !pool->jobs)
+      pthread_cond_wait(&pool->work_cv, &pool->lock);
+    if (pool->shutdown)
+      break;
+    PoolJob *job = pool->jobs;
+    int task = atomic_fetch_add(&job->next_task, 1);
+    if (task >= job->num_tasks) {
+      pool->jobs = job->next_job;
+      continue;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    run_tasks(pool, job, task);
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * Creates a pool of long-lived worker threads
+ *
+ * The submitting thread always takes part in its own parallel-for, so a pool
+ * of num_threads starts num_threads - 1 workers. Idle workers block on a
+ * condition variable and cost nothing until work is submitted.
+ *
+ * @param num_threads Total parallelism. Values below 1 are treated as 1.
+ *
+ * @return The new pool, or NULL on allocation or pthread_create failure
+ *
+ * @note Release the pool with thread_pool_destroy
+ */
+ThreadPool *thread_pool_create(int num_threads) {
+  if (num_threads < 1)
+    num_threads = 1;
+  ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+  if (!pool)
+    return NULL;
+  atomic_init(&pool->next_slot, 0);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_cv, NULL);
+  pthread_cond_init(&pool->done_cv, NULL);
+  pool->workers = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+  if (!pool->workers) {
+    thread_pool_destroy(pool);
+    return NULL;
+  }
+  for (int i = 0; i < num_threads - 1; i++) {
+    if (pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0) {
+      perror("pthread_create");
+      thread_pool_destroy(pool);
+      return NULL;
+    }
+    pool->num_workers++;
+  }
+  return pool;
+}
+
+/**
+ * Shuts a pool down and releases it
+ *
+ * Sets the shutdown flag, wakes every worker and joins them. All parallel-for
+ * calls must have returned before the pool is destroyed.
+ *
+ * @param pool Pool to destroy. Can be NULL.
+ */
+void thread_pool_destroy(ThreadPool *pool) {
+  if (!pool)
+    return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_cv);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->num_workers; i++)
+    pthread_join(pool->workers[i], NULL);
+  pthread_cond_destroy(&pool->done_cv);
+  pthread_cond_destroy(&pool->work_cv);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool);
+}
+
+/**
+ * Returns the parallelism of a pool
+ *
+ * @param pool Pool to query
+ *
+ * @return Number of workers plus the submitting thread
+ */
+int thread_pool_size(const ThreadPool *pool) {
+  return pool ? pool->num_workers + 1 : 1;
+}
+
+/**
+ * Runs fn(ctx, i) for every i in [0, num_tasks) on the pool and waits
+ *
+ * The job is published to the workers and the calling thread immediately
+ * starts claiming tasks itself. Several threads may submit concurrently, and a
+ * task may submit a nested parallel-for: the nested submitter works on its own
+ * job, so it never waits on tasks that nobody is running.
+ *
+ * @param pool Pool to run on; NULL runs every task on the calling thread
+ * @param num_tasks Number of task indices
+ * @param fn Task body
+ * @param ctx Opaque pointer passed to every call of fn
+ *
+ * @return 0 once every task has finished
+ */
+int thread_pool_parallel_for(ThreadPool *pool, int num_tasks, PoolTaskFn fn,
+                             void *ctx) {
+  if (num_tasks <= 0)
+    return 0;
+  if (!pool || pool->num_workers == 0 || num_tasks == 1) {
+    for (int i = 0; i < num_tasks; i++)
+      fn(ctx, i);
+    return 0;
+  }
+  PoolJob job = {.fn = fn, .ctx = ctx, .num_tasks = num_tasks};
+  atomic_init(&job.next_task, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  job.next_job = pool->jobs;
+  pool->jobs = &job;
+  pthread_cond_broadcast(&pool->work_cv);
+  pthread_mutex_unlock(&pool->lock);
+
+  run_tasks(pool, &job, atomic_fetch_add(&job.next_task, 1));
+
+  pthread_mutex_lock(&pool->lock);
+  unlink_job(pool, &job);
+  while (job.done < num_tasks)
+    pthread_cond_wait(&pool->done_cv, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+/**
+ * Returns the configured default thread count
+ *
+ * Reads the IMAGEMUGGLE_THREADS environment variable and falls back to the
+ * number of online CPUs when it is unset or invalid.
+ *
+ * @return Thread count, at least 1
+ */
+int thread_pool_default_threads(void) {
+  const char *env = getenv("IMAGEMUGGLE_THREADS");
+  if (env) {
+    int n = atoi(env);
+    if (n > 0)
+      return n;
+  }
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+/**
+ * (Re)creates the process-wide pool with the given parallelism
+ *
+ * The calling thread becomes placement slot 0 of the pool, so with
+ * IMAGEMUGGLE_PIN it is pinned next to the workers it submits to.
+ *
+ * @param num_threads Total parallelism of the shared pool
+ *
+ * @return 0 on success, -1 if the pool could not be created
+ *
+ * @note Must not be called while operators are running on the shared pool
+ */
+int thread_pool_default_init(int num_threads) {
+  affinity_init_thread(0);
+  pthread_mutex_lock(&default_lock);
+  if (default_pool && thread_pool_size(default_pool) != num_threads) {
+    thread_pool_destroy(default_pool);
+    default_pool = NULL;
+  }
+  if (!default_pool)
+    default_pool = thread_pool_create(num_threads);
+  int rc = default_pool ? 0 : -1;
+  pthread_mutex_unlock(&default_lock);
+  return rc;
+}
+
+/**
+ * Returns the process-wide pool, creating it on first use
+ *
+ * @return The shared pool, or NULL if it could not be created
+ */
+ThreadPool *thread_pool_default(void) {
+  pthread_mutex_lock(&default_lock);
+  if (!default_pool)
+    default_pool = thread_pool_create(thread_pool_default_threads());
+  ThreadPool *pool = default_pool;
+  pthread_mutex_unlock(&default_lock);
+  return pool;
+}
+
+/**
+ * Joins the workers of the process-wide pool and releases it
+ */
+void thread_pool_default_shutdown(void) {
+  pthread_mutex_lock(&default_lock);
+  thread_pool_destroy(default_pool);
+  default_pool = NULL;
+  pthread_mutex_unlock(&default_lock);
+}
@@ -1,107 +1,187 @@
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // Define USE_STB if stb headers are provided under -Ithird_party
 #ifdef USE_STB
+// Decoded buffers are adopted by Image and released by image_free, so stb
+// must allocate with the C heap
+#define STBI_MALLOC(size) malloc(size)
+#define STBI_REALLOC(p, size) realloc(p, size)
+#define STBI_FREE(p) free(p)
 #define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image.h"
-#include "stb_image_write.h"
 #endif
 
+#include "png_writer.h"
+#include "profile.h"
+#include "thread_pool.h"
 #include "utils_conc.h"
 
+// Smallest chunk handed out by the dynamic and guided schedules; every chunk
+// is a separate worker call that refills its halo rows and scratch
+#define ROW_CHUNK_MIN 8
+// Chunks per thread of the dynamic schedule
+#define ROW_CHUNKS_PER_THREAD 8
+
 /**
- * Creates a 3D matrix with contiguous memory layout for image data
- *
- * Allocates memory for a 3D matrix structure that can be accessed as
- * m[y][x][channel]. The actual data is stored in a contiguous block for better
- * cache performance, while maintaining the convenience of 3D array indexing
- * through pointer tables.
- *
- * @param height Number of rows in the matrix
- * @param width Number of columns in the matrix
- * @param channels Number of channels per pixel (e.g., 3 for RGB, 4 for RGBA)
- *
- * @return Pointer to the 3D matrix structure on success, NULL on memory
- * allocation failure
- *
- * @note The returned matrix should be freed using a corresponding free3DMatrix
- * function
- * @note Memory layout: contiguous data block + height pointers + (height *
- * width) pointers
- * @warning Returns NULL if any memory allocation fails; all previously
- * allocated memory is cleaned up
+ * Row blocks of one launch_threads_by_rows call, shared by the pool tasks
  */
-unsigned char ***create3DMatrix(int height, int width, int channels) {
-  // contiguous layout: [height * width * channels] + pointer tables
-  unsigned char *data =
-      (unsigned char *)calloc((size_t)height * width * channels, 1);
-  if (!data)
-    return NULL;
-  unsigned char ***m =
-      (unsigned char ***)malloc(sizeof(unsigned char **) * height);
-  if (!m) {
-    free(data);
-    return NULL;
-  }
-  for (int y = 0; y < height; y++) {
-    m[y] = (unsigned char **)malloc(sizeof(unsigned char *) * width);
-    if (!m[y]) {
-      for (int i = 0; i < y; i++)
-        free(m[i]);
-      free(m);
-      free(data);
-      return NULL;
-    }
-    for (int x = 0; x < width; x++) {
-      m[y][x] = data + ((size_t)y * width + x) * channels;
-    }
-  }
-  return m;
+typedef struct {
+  void *(*worker)(void *);
+  WorkArgs *args;    // one per task; y0/y1 preset for the static schedule
+  RowSchedule schedule;
+  int rows, tasks;
+  int chunk;         // chunk rows of the dynamic schedule
+  atomic_int next;   // first unclaimed row (dynamic and guided)
+  uint64_t *task_ns; // time of every task when profiling, else NULL
+  atomic_int failed; // set when a block returns WORKER_FAILED
+} RowJob;
+
+/**
+ * Claims the next chunk of rows of a dynamic or guided launch
+ *
+ * Guided chunks are a share of the remaining rows (remaining / 2 tasks), so
+ * the first claims are large and the tail is split finely among the threads
+ * that finish early.
+ *
+ * @param job Launch
+ * @param y0 First row of the chunk
+ * @param y1 One past the last row
+ * @return Nonzero if a chunk was claimed, 0 when all rows are taken
+ */
+static int claim_rows(RowJob *job, int *y0, int *y1) {
+  int start = atomic_load(&job->next), size;
+  do {
+    if (start >= job->rows)
+      return 0;
+    size = job->schedule == SCHED_GUIDED
+               ? (job->rows - start) / (2 * job->tasks)
+               : job->chunk;
+    size = size < ROW_CHUNK_MIN ? ROW_CHUNK_MIN : size;
+  } while (!atomic_compare_exchange_weak(&job->next, &start, start + size));
+  *y0 = start;
+  *y1 = start + size < job->rows ? start + size : job->rows;
+  return 1;
 }
 
 /**
- * Launches worker threads to process image data by dividing rows among threads
+ * Runs the operator worker on one row range and records it when profiling
  *
- * This function creates multiple threads to process an image or data structure
- * by dividing the total number of rows evenly among the specified number of
- * threads. Each thread receives a copy of the base WorkArgs with modified y0
- * and y1 values to define its row processing range.
+ * @param job Launch
+ * @param a Worker arguments with the range set
+ * @return Time spent in the worker (0 when profiling is off)
+ */
+static uint64_t run_rows(RowJob *job, WorkArgs *a) {
+  uint64_t t0 = job->task_ns ? profile_now() : 0;
+  if (a->y0 < a->y1 && job->worker(a) == WORKER_FAILED)
+    atomic_store(&job->failed, 1);
+  if (!job->task_ns)
+    return 0;
+  uint64_t ns = profile_now() - t0;
+  profile_task(a->name, ns, a->y1 - a->y0);
+  return ns;
+}
+
+/**
+ * Pool task body: runs the operator worker on its row block (static) or on
+ * chunks claimed until no rows are left (dynamic, guided)
  *
- * @param worker Function pointer to the worker function that each thread will
- * execute. The function should accept a void* parameter (WorkArgs*) and return
+ * @param ctx Pointer to the RowJob of the launch
+ * @param task Index of the task
+ */
+static void run_row_block(void *ctx, int task) {
+  RowJob *job = (RowJob *)ctx;
+  WorkArgs *a = &job->args[task];
+  uint64_t ns = 0;
+  if (job->schedule == SCHED_STATIC)
+    ns = run_rows(job, a);
+  else
+    while (!atomic_load(&job->failed) && claim_rows(job, &a->y0, &a->y1))
+      ns += run_rows(job, a);
+  if (job->task_ns)
+    job->task_ns[task] = ns;
+}
+
+/**
+ * Schedule forced by IMAGEMUGGLE_SCHEDULE (static, dynamic or guided), or -1
+ */
+static int schedule_override = -1;
+static pthread_once_t schedule_once = PTHREAD_ONCE_INIT;
+
+static void schedule_override_init(void) {
+  static const char *const names[] = {"static", "dynamic", "guided"};
+  const char *env = getenv("IMAGEMUGGLE_SCHEDULE");
+  for (int i = 0; env && i < 3; i++)
+    if (strcmp(env, names[i]) == 0)
+      schedule_override = i;
+}
+
+/**
+ * Runs a worker over the destination rows using the shared thread pool
+ *
+ * This function splits the rows of the destination image among num_threads
+ * pool tasks according to base.schedule and submits them as one parallel-for
+ * to the process-wide pool (see thread_pool_default). Each task receives a
+ * copy of the base WorkArgs with modified y0 and y1 values to define its row
+ * processing range. Pool workers are created once and reused, so repeated
+ * operator calls do not pay for thread creation.
+ *
+ * - SCHED_STATIC: one contiguous block of ceil(rows / num_threads) rows per
+ *   task; the cheapest split for operators of uniform cost per row.
+ * - SCHED_DYNAMIC: tasks repeatedly claim fixed chunks (about
+ *   ROW_CHUNKS_PER_THREAD per task) from an atomic counter.
+ * - SCHED_GUIDED: claimed chunks shrink with the remaining rows, for
+ *   operators whose row cost varies (rotation, resampling).
+ *
+ * The IMAGEMUGGLE_SCHEDULE environment variable (static, dynamic, guided)
+ * overrides the operator's choice for experiments.
+ *
+ * @param worker Function pointer to the worker function that processes one
+ * block. The function should accept a void* parameter (WorkArgs*) and return
  * void*.
  * @param base Base WorkArgs structure containing common parameters for all
- * threads. The height field is used to determine total rows to process.
- * @param num_threads Number of threads to create. If less than 1, defaults
- * to 1.
- *
- * @return 0 on success, -1 on failure (malloc error or pthread_create error)
- *
- * @note The function automatically handles row boundaries to ensure no thread
- *       processes rows beyond the total height.
- * @note All threads are joined before the function returns, ensuring completion
- *       of all work before cleanup.
- * @note Memory for thread IDs and arguments is automatically allocated and
- * freed.
+ * blocks. The height of base.dst determines the total rows to process.
+ * @param num_threads Number of pool tasks. If less than 1, defaults to 1.
+ *
+ * @return 0 on success, -1 on failure (malloc error, pool creation error or a
+ * block returning WORKER_FAILED)
+ *
+ * @note The function automatically handles row boundaries to ensure no block
+ *       covers rows beyond the total height.
+ * @note All blocks have completed when the function returns.
  */
 int launch_threads_by_rows(void *(*worker)(void *), WorkArgs base,
                            int num_threads) {
   if (num_threads < 1)
     num_threads = 1;
-  pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * num_threads);
+  ThreadPool *pool = thread_pool_default();
+  if (!pool) {
+    fprintf(stderr, "Failed to create thread pool\n");
+    return -1;
+  }
   WorkArgs *args = (WorkArgs *)malloc(sizeof(WorkArgs) * num_threads);
-  if (!tids || !args) {
+  if (!args) {
     perror("malloc");
-    free(tids);
-    free(args);
     return -1;
   }
-  int rows = base.height;
+  pthread_once(&schedule_once, schedule_override_init);
+  RowJob job = {.worker = worker,
+                .args = args,
+                .schedule = schedule_override >= 0
+                                ? (RowSchedule)schedule_override
+                                : base.schedule,
+                .rows = base.dst->height,
+                .tasks = num_threads};
+  int rows = job.rows;
+  if (num_threads == 1)
+    job.schedule = SCHED_STATIC;
+  job.chunk = rows / (num_threads * ROW_CHUNKS_PER_THREAD);
+  atomic_init(&job.next, 0);
+  atomic_init(&job.failed, 0);
   int per_thread = (int)ceil((double)rows / num_threads);
   for (int i = 0; i < num_threads; i++) {
     args[i] = base;
@@ -111,110 +191,93 @@ int launch_threads_by_rows(void *(*worker)(void *), WorkArgs base,
       args[i].y0 = rows;
     if (args[i].y1 > rows)
       args[i].y1 = rows;
-    if (pthread_create(&tids[i], NULL, worker, &args[i]) != 0) {
-      perror("pthread_create");
-      free(tids);
-      free(args);
-      return -1;
+  }
+  uint64_t t0 = 0;
+  if (profile_enabled()) {
+    job.task_ns = (uint64_t *)calloc(num_threads, sizeof(uint64_t));
+    t0 = profile_now();
+  }
+  thread_pool_parallel_for(pool, num_threads, run_row_block, &job);
+  if (job.task_ns) {
+    uint64_t max = 0, sum = 0;
+    for (int i = 0; i < num_threads; i++) {
+      max = job.task_ns[i] > max ? job.task_ns[i] : max;
+      sum += job.task_ns[i];
     }
+    profile_launch(base.name, num_threads, max, sum);
+    profile_record(base.name, profile_now() - t0, rows, 0);
+    free(job.task_ns);
   }
-  for (int i = 0; i < num_threads; i++)
-    pthread_join(tids[i], NULL);
-  free(tids);
   free(args);
-  return 0;
+  return atomic_load(&job.failed) ? -1 : 0;
 }
 
 /**
- * Loads a PNG image from file and converts it to a 3D matrix format
+ * Loads a PNG image from file into a flat image
  *
- * This function loads a PNG image using the stb_image library and converts the
- * linear pixel data into a 3D matrix where pixels can be accessed as
- * matrix[y][x][channel]. Requires USE_STB to be defined and stb_image headers
- * to be included.
+ * This function loads a PNG image using the stb_image library. The decoder
+ * already produces tightly packed interleaved rows, so its buffer is adopted
+ * by the Image as is (no second allocation, no copy); pixel (x, y) channel c
+ * is at image_px(img, x, y)[c]. Requires USE_STB to be defined and stb_image
+ * headers to be included.
  *
  * @param path Path to the PNG file to load
- * @param out_px Pointer to store the allocated 3D pixel matrix (y, x, channels)
- * @param w Pointer to store the image width
- * @param h Pointer to store the image height
- * @param ch Pointer to store the number of channels (e.g., 3 for RGB, 4 for
- * RGBA)
+ * @param out Image to initialize with the decoded pixels; its width, height
+ * and channels fields describe the loaded file
  *
  * @return 0 on success, -1 on failure (file not found, memory allocation error,
  *         or USE_STB not defined)
  *
- * @note The caller is responsible for freeing the allocated 3D matrix memory
+ * @note The caller is responsible for releasing the image with image_free
  * @note Prints warning to stderr if USE_STB is not defined
  * @note Prints error to stderr if file cannot be loaded
  */
 // ------- Optional: I/O with stb --------
-int loadPNG(const char *path, unsigned char ****out_px, int *w, int *h,
-            int *ch) {
+int loadPNG(const char *path, Image *out) {
 #ifndef USE_STB
+  (void)path;
+  (void)out;
   fprintf(stderr,
           "[WARN] loadPNG requires stb (define USE_STB and include headers)\n");
   return -1;
 #else
   int x, y, c;
+  uint64_t t0 = profile_enabled() ? profile_now() : 0;
   unsigned char *data = stbi_load(path, &x, &y, &c, 0);
   if (!data) {
     fprintf(stderr, "Error loading %s\n", path);
     return -1;
   }
-  *w = x;
-  *h = y;
-  *ch = c;
-  unsigned char ***m = create3DMatrix(y, x, c);
-  if (!m) {
+  // the decoder output is already a tightly packed image: adopt it
+  if (image_adopt(out, data, x, y, c) != 0) {
     stbi_image_free(data);
     return -1;
   }
-  for (int yy = 0; yy < y; yy++) {
-    for (int xx = 0; xx < x; xx++) {
-      memcpy(m[yy][xx], data + (size_t)(yy * x + xx) * c, (size_t)c);
-    }
-  }
-  stbi_image_free(data);
-  *out_px = m;
+  if (profile_enabled())
+    profile_record("load_png", profile_now() - t0, y, out->stride * y);
   return 0;
 #endif
 }
 
 /**
- * Saves a 3D pixel array as a PNG image file
+ * Saves a flat image as a PNG file
  *
- * This function converts a 3-dimensional pixel array into a flat buffer and
- * saves it as a PNG image using the STB image library. The function requires
- * STB to be available (USE_STB must be defined).
+ * Uses the parallel PNG writer (see png_write): rows are filtered and
+ * deflated in strips on the shared thread pool, so saving scales with the
+ * pool instead of running on one core. Does not need stb.
  *
  * @param path The file path where the PNG image will be saved
- * @param px 3D array of pixel data [height][width][channels]
- * @param w Width of the image in pixels
- * @param h Height of the image in pixels
- * @param ch Number of channels per pixel (e.g., 3 for RGB, 4 for RGBA)
- *
- * @return 0 on success, -1 on failure (memory allocation error, STB not
- * available, or PNG write failure)
+ * @param img Image to save (width, height, channels and stride are honored)
+ * @param level Compression level, PNG_LEVEL_MIN (fastest) to PNG_LEVEL_MAX
+ * (smallest); PNG_LEVEL_DEFAULT is a good balance
  *
- * @note Requires STB image library to be compiled with USE_STB defined
- * @warning Function prints a warning to stderr if STB is not available
+ * @return 0 on success, -1 on failure (invalid image or write failure)
  */
-int savePNG(const char *path, unsigned char ***px, int w, int h, int ch) {
-#ifndef USE_STB
-  fprintf(stderr,
-          "[WARN] savePNG requires stb (define USE_STB and include headers)\n");
-  return -1;
-#else
-  unsigned char *flat = (unsigned char *)malloc((size_t)w * h * ch);
-  if (!flat)
-    return -1;
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++) {
-      memcpy(flat + (size_t)(y * w + x) * ch, px[y][x], (size_t)ch);
-    }
-  }
-  int ok = stbi_write_png(path, w, h, ch, flat, w * ch);
-  free(flat);
-  return ok ? 0 : -1;
-#endif
+int savePNG(const char *path, const Image *img, int level) {
+  uint64_t t0 = profile_enabled() ? profile_now() : 0;
+  int rc = png_write(path, img, level);
+  if (profile_enabled())
+    profile_record("save_png", profile_now() - t0, img->height,
+                   (size_t)img->width * img->channels * img->height);
+  return rc;
 }